@@ -0,0 +1,485 @@
+#pragma once
+
+#include "builder.hpp"
+#include "syntax.hpp"
+#include "ast.hpp"
+
+#include <cassert>
+#include <vector>
+
+// Builds the ast directly while parsing, without an intermediate
+// parse tree. Use like this:
+//
+// ```
+// builder::ActionBuilder builder;
+// pegtl::parse<Grammar, builder::Action, builder::ActionControl<control>::type>(
+//	in, builder);
+// ```
+//
+// Finished nodes are pushed on a value stack and consumed by the
+// action of the enclosing rule. The control remembers the stack
+// size when a rule is started and throws away everything pushed since
+// then when the rule fails, so backtracking never leaves half-built
+// nodes around. The nodes themselves stay in the module arena until
+// the module is destroyed.
+namespace builder {
+
+class ActionBuilder : public BuilderBase {
+public:
+	struct Mark {
+		std::size_t nodes;
+		std::size_t idents;
+		std::size_t vars; // mark of the variable table
+	};
+
+	// Returns the expression that was built last, useful when only
+	// an expression is parsed.
+	ast::Expression* popExpr() {
+		assert(!nodes_.empty());
+		auto ret = get<ast::Expression>(nodes_.size() - 1);
+		nodes_.pop_back();
+		return ret;
+	}
+
+	// Called by the control
+	void push() {
+		marks_.push_back({nodes_.size(), idents_.size(), decls_.vars.mark()});
+	}
+
+	void pop() {
+		marks_.pop_back();
+	}
+
+	void rollback() {
+		auto& mark = marks_.back();
+		nodes_.resize(mark.nodes);
+		idents_.resize(mark.idents);
+		decls_.vars.restore(mark.vars);
+		marks_.pop_back();
+	}
+
+	// Called by the actions.
+	// Mark of the rule that is currently being applied.
+	const Mark& mark() const {
+		return marks_.back();
+	}
+
+	std::size_t nodeCount() const { return nodes_.size(); }
+
+	// All nodes from the given index to the top of the stack.
+	nytl::span<ast::Node* const> nodes(std::size_t first) const {
+		assert(first <= nodes_.size());
+		return {nodes_.data() + first, nodes_.size() - first};
+	}
+
+	template<typename T>
+	T* get(std::size_t i) const {
+		assert(i < nodes_.size());
+		return static_cast<T*>(nodes_[i]);
+	}
+
+	// Removes all nodes and identifiers pushed since the rule started.
+	void drop() {
+		auto& mark = marks_.back();
+		nodes_.resize(mark.nodes);
+		idents_.resize(mark.idents);
+	}
+
+	// Drops everything pushed since the rule started and pushes the
+	// given node (that may be null) instead.
+	void reduce(ast::Node* node) {
+		drop();
+		nodes_.push_back(node);
+	}
+
+	void pushNode(ast::Node* node) {
+		nodes_.push_back(node);
+	}
+
+	void set(std::size_t i, ast::Node* node) {
+		assert(i < nodes_.size());
+		nodes_[i] = node;
+	}
+
+	void pushIdent(std::string_view name) {
+		idents_.push_back(name);
+	}
+
+	std::string_view ident(std::size_t i) const {
+		assert(i < idents_.size());
+		return idents_[i];
+	}
+
+	// Identifiers are only interned once they are used in a node, not
+	// already when they are matched since that might be undone.
+	ast::Symbol symbol(std::size_t i) const {
+		return ast::Symbol(ident(i));
+	}
+
+	std::size_t identCount() const { return idents_.size(); }
+
+	// Rules that open a scope call this when they are applied, it
+	// removes the variables declared since the rule started.
+	// Failed rules always remove their variables.
+	void leaveScope() {
+		decls_.vars.restore(mark().vars);
+	}
+
+	std::size_t varCount() const { return decls_.vars.mark(); }
+	ast::VariableDeclaration* var(std::size_t i) const { return decls_.vars[i]; }
+
+	// The function whose body is being parsed
+	ast::Function* function() const { return current_.function; }
+
+	// Make the semantic functions available to the actions
+	using BuilderBase::numberLiteral;
+	using BuilderBase::literal;
+	using BuilderBase::identifierExpr;
+	using BuilderBase::declareVariable;
+	using BuilderBase::memberAccess;
+	using BuilderBase::functionCall;
+	using BuilderBase::negate;
+	using BuilderBase::binaryOp;
+	using BuilderBase::binaryExpr;
+	using BuilderBase::findType;
+	using BuilderBase::addStruct;
+	using BuilderBase::declareFunction;
+	using BuilderBase::addFunction;
+	using BuilderBase::create;
+
+private:
+	std::vector<ast::Node*> nodes_;
+	std::vector<std::string_view> idents_;
+	std::vector<Mark> marks_;
+};
+
+template<template<typename...> class Base>
+struct ActionControl {
+	template<typename Rule>
+	struct type : Base<Rule> {
+		template<typename ParseInput>
+		static void start(const ParseInput& in, ActionBuilder& b) {
+			b.push();
+			Base<Rule>::start(in, b);
+		}
+
+		template<typename ParseInput>
+		static void success(const ParseInput& in, ActionBuilder& b) {
+			b.pop();
+			Base<Rule>::success(in, b);
+		}
+
+		template<typename ParseInput>
+		static void failure(const ParseInput& in, ActionBuilder& b) {
+			b.rollback();
+			Base<Rule>::failure(in, b);
+		}
+	};
+};
+
+template<typename Rule> struct Action : pegtl::nothing<Rule> {};
+
+template<> struct Action<syn::Identifier> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, ActionBuilder& b) {
+		b.pushIdent(in.string_view());
+	}
+};
+
+// literals
+template<> struct Action<syn::TrueLiteral> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		b.reduce(b.literal(true));
+	}
+};
+
+template<> struct Action<syn::FalseLiteral> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		b.reduce(b.literal(false));
+	}
+};
+
+template<> struct Action<syn::SuffixedNumberLiteral> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, ActionBuilder& b) {
+		auto str = in.string_view();
+		auto end = str.find_first_not_of("0123456789.");
+		end = (end == str.npos) ? str.size() : end;
+		b.reduce(b.numberLiteral(str.substr(0, end), str.substr(end)));
+	}
+};
+
+// expressions
+template<> struct Action<syn::IdentifierExpr> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, ActionBuilder& b) {
+		b.reduce(b.identifierExpr(ast::Symbol(in.string_view())));
+	}
+};
+
+// The operator nodes are pushed between the operands and get their
+// operands when the whole sequence is known.
+template<> struct Action<syn::BinaryOp> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, ActionBuilder& b) {
+		b.pushNode(b.binaryOp(in.string_view()));
+	}
+};
+
+template<> struct Action<syn::BinaryExpr> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto first = b.mark().nodes;
+		if(b.nodeCount() - first < 2) {
+			// no operator present, just keep the single operand
+			return;
+		}
+
+		b.reduce(b.binaryExpr(b.nodes(first)));
+	}
+};
+
+// Pushes a null node as marker for the primary expression
+template<> struct Action<syn::Negate> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		b.pushNode(nullptr);
+	}
+};
+
+template<> struct Action<syn::PrimaryExpr> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto first = b.mark().nodes;
+		if(b.nodeCount() - first == 2) {
+			assert(!b.get<ast::Node>(first));
+			b.reduce(b.negate(b.get<ast::Expression>(first + 1)));
+		}
+	}
+};
+
+// The member function chain links transform the expression built
+// before them, i.e. the node right below their mark.
+template<> struct Action<syn::MemberAccess> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, ActionBuilder& b) {
+		auto i = b.mark().nodes - 1;
+		ast::Identifier ident {ast::Symbol(in.string_view())};
+		auto accessed = b.get<ast::Expression>(i);
+		b.set(i, b.memberAccess(accessed, ident));
+	}
+};
+
+template<> struct Action<syn::MemberFunctionChainCall> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto i = b.mark().nodes - 1;
+		std::vector<ast::Expression*> args;
+		for(auto a = i + 1; a < b.nodeCount(); ++a) {
+			args.emplace_back(b.get<ast::Expression>(a));
+		}
+
+		b.drop();
+		auto called = b.get<ast::Expression>(i);
+		b.set(i, b.functionCall(called, std::move(args)));
+	}
+};
+
+// Pushes a null node when there is no return expression so that
+// the code block always finds it as the last node.
+template<> struct Action<syn::OptCodeBlockReturn> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		if(b.nodeCount() == b.mark().nodes) {
+			b.pushNode({});
+		}
+	}
+};
+
+template<> struct Action<syn::CodeBlock> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto first = b.mark().nodes;
+		auto last = b.nodeCount() - 1;
+		assert(last >= first);
+
+		auto ret = b.create<ast::CodeBlock>();
+		for(auto i = first; i < last; ++i) {
+			ret->statements.emplace_back(b.get<ast::Statement>(i));
+		}
+
+		ret->ret = b.get<ast::Expression>(last);
+		b.reduce(ret);
+		b.leaveScope();
+	}
+};
+
+template<> struct Action<syn::ElseCodeBlock> : Action<syn::CodeBlock> {};
+
+// Each branch pushes a condition and a code block, the else branch
+// just a code block.
+template<> struct Action<syn::IfExpr> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto first = b.mark().nodes;
+		auto count = b.nodeCount() - first;
+		assert(count >= 2);
+
+		auto branch = [&](std::size_t i) {
+			ast::IfExpression::Branch ret;
+			ret.condition = b.get<ast::Expression>(i);
+			ret.code = b.get<ast::CodeBlock>(i + 1);
+			return ret;
+		};
+
+		auto ret = b.create<ast::IfExpression>();
+		ret->ifBranch = branch(first);
+		auto end = first + count - (count % 2);
+		for(auto i = first + 2; i < end; i += 2) {
+			ret->elsifBranches.push_back(branch(i));
+		}
+
+		if(count % 2 == 1) {
+			ret->elseBranch = b.get<ast::CodeBlock>(b.nodeCount() - 1);
+		}
+
+		b.reduce(ret);
+	}
+};
+
+// statements
+// Either just the expression or the assigned expression and the value.
+template<> struct Action<syn::ExprStatement> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto first = b.mark().nodes;
+		if(b.nodeCount() - first == 1) {
+			auto ret = b.create<ast::ExpressionStatement>();
+			ret->expr = b.get<ast::Expression>(first);
+			b.reduce(ret);
+			return;
+		}
+
+		assert(b.nodeCount() - first == 2);
+		auto ret = b.create<ast::AssignStatement>();
+		ret->operands = {b.get<ast::Expression>(first), b.get<ast::Expression>(first + 1)};
+		b.reduce(ret);
+	}
+};
+
+template<> struct Action<syn::IfStatement> : Action<syn::ExprStatement> {};
+
+// Identifiers: type, name
+// Nodes: initializer
+// The variable is visible from the next statement on.
+template<> struct Action<syn::VariableDecl> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto& mark = b.mark();
+		assert(b.identCount() - mark.idents == 2);
+		assert(b.nodeCount() - mark.nodes == 1);
+
+		auto& type = b.findType(b.symbol(mark.idents));
+		auto init = b.get<ast::Expression>(mark.nodes);
+		auto ret = b.create<ast::DeclarationStatement>();
+		ret->decl = b.declareVariable(b.symbol(mark.idents + 1), type, init);
+		b.reduce(ret);
+	}
+};
+
+// declarations
+// Imports are resolved by the driver before the module is parsed,
+// see driver::Compiler.
+template<> struct Action<syn::ImportDecl> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		b.drop();
+	}
+};
+
+// Declared before the body is parsed so it can use them.
+// They are removed again when the function is finished.
+template<> struct Action<syn::FunctionParameter> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto& mark = b.mark();
+		assert(b.identCount() - mark.idents == 2);
+		auto& type = b.findType(b.symbol(mark.idents));
+		b.declareVariable(b.symbol(mark.idents + 1), type, nullptr);
+	}
+};
+
+// Declares the function before the body is parsed, so it can call
+// itself. The return type and name were pushed right before the list.
+// Identifiers: type and name per parameter
+template<> struct Action<syn::FunctionParameterList> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto& mark = b.mark();
+		assert(mark.idents >= 2);
+		assert((b.identCount() - mark.idents) % 2 == 0);
+
+		auto func = b.create<ast::Function>();
+		func->retType = &b.findType(b.symbol(mark.idents - 2));
+		func->ident.name = b.symbol(mark.idents - 1);
+
+		// declared by the FunctionParameter actions
+		assert(b.varCount() - mark.vars == (b.identCount() - mark.idents) / 2);
+		for(auto i = mark.vars; i < b.varCount(); ++i) {
+			func->addParam(*b.var(i));
+		}
+
+		b.declareFunction(func);
+	}
+};
+
+// Identifiers: return type, name, then type and name per parameter
+// Nodes: code block
+template<> struct Action<syn::FunctionDecl> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto& mark = b.mark();
+		assert(b.nodeCount() - mark.nodes == 1);
+
+		auto func = b.function();
+		assert(func && func->ident.name == b.symbol(mark.idents + 1));
+		func->code = b.get<ast::CodeBlock>(mark.nodes);
+
+		b.drop();
+		b.leaveScope();
+		b.addFunction(func);
+	}
+};
+
+// Pushes a null node when there is no initializer, the struct finds
+// exactly one node per member.
+template<> struct Action<syn::StructMember> : Action<syn::OptCodeBlockReturn> {};
+
+// Identifiers: name, then type and name per member
+// Nodes: initializer (or null) per member
+template<> struct Action<syn::StructDecl> {
+	template<typename ActionInput>
+	static void apply(const ActionInput&, ActionBuilder& b) {
+		auto& mark = b.mark();
+		auto count = b.nodeCount() - mark.nodes;
+		assert(b.identCount() - mark.idents == 1 + 2 * count);
+
+		auto res = b.create<ast::StructType>();
+		res->category = ast::Type::Category::eStruct;
+		res->name = b.symbol(mark.idents);
+
+		for(auto i = 0u; i < count; ++i) {
+			auto& member = res->members.emplace_back();
+			member.type = &b.findType(b.symbol(mark.idents + 1 + 2 * i));
+			member.name.name = b.symbol(mark.idents + 2 + 2 * i);
+			member.init = b.get<ast::Expression>(mark.nodes + i);
+		}
+
+		b.drop();
+		b.addStruct(res);
+	}
+};
+
+} // namespace builder
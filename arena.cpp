@@ -0,0 +1,38 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <new>
+
+namespace ast {
+
+void Arena::release() {
+	for(auto* dtor = dtors_; dtor; dtor = dtor->next) {
+		dtor->destroy(dtor->object);
+	}
+
+	auto* block = blocks_;
+	while(block) {
+		auto* next = block->next;
+		::operator delete(block);
+		block = next;
+	}
+
+	blocks_ = {};
+	dtors_ = {};
+	cur_ = end_ = {};
+	capacity_ = 0u;
+}
+
+void Arena::addBlock(std::size_t minSize) {
+	auto size = sizeof(Block) + std::max(minSize, blockSize_);
+	// not malloc so that replacements of operator new see the blocks
+	auto* block = static_cast<Block*>(::operator new(size));
+	block->next = blocks_;
+	block->size = size;
+	blocks_ = block;
+
+	cur_ = reinterpret_cast<char*>(block + 1);
+	end_ = reinterpret_cast<char*>(block) + size;
+	capacity_ += size;
+}
+
+} // namespace ast
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ast {
+
+// Bump allocator that owns all objects created through it.
+// Everything is released at once when the arena is destroyed (or
+// release is called), objects with non-trivial destructors are
+// destroyed in reverse order of creation.
+// Individual objects can't be freed.
+class Arena {
+public:
+	static constexpr std::size_t defaultBlockSize = 64 * 1024;
+
+	explicit Arena(std::size_t blockSize = defaultBlockSize) : blockSize_(blockSize) {}
+	~Arena() { release(); }
+
+	Arena(Arena&& rhs) noexcept { swap(rhs); }
+	Arena& operator=(Arena&& rhs) noexcept {
+		release();
+		swap(rhs);
+		return *this;
+	}
+
+	void* allocate(std::size_t size, std::size_t align) {
+		auto addr = reinterpret_cast<std::uintptr_t>(cur_);
+		auto aligned = (addr + align - 1) & ~std::uintptr_t(align - 1);
+		if(!cur_ || aligned + size > reinterpret_cast<std::uintptr_t>(end_)) {
+			addBlock(size + align);
+			addr = reinterpret_cast<std::uintptr_t>(cur_);
+			aligned = (addr + align - 1) & ~std::uintptr_t(align - 1);
+		}
+
+		cur_ = reinterpret_cast<char*>(aligned + size);
+		return reinterpret_cast<void*>(aligned);
+	}
+
+	template<typename T, typename... Args>
+	T* create(Args&&... args) {
+		auto* ptr = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr(!std::is_trivially_destructible_v<T>) {
+			auto* dtor = new(allocate(sizeof(Destructor), alignof(Destructor))) Destructor;
+			dtor->object = ptr;
+			dtor->destroy = [](void* obj) { static_cast<T*>(obj)->~T(); };
+			dtor->next = dtors_;
+			dtors_ = dtor;
+		}
+
+		return ptr;
+	}
+
+	// Destroys all objects and frees all memory.
+	void release();
+
+	// Total number of bytes allocated from the system.
+	std::size_t capacity() const { return capacity_; }
+
+private:
+	struct Block {
+		Block* next;
+		std::size_t size;
+	};
+
+	struct Destructor {
+		void (*destroy)(void*);
+		void* object;
+		Destructor* next;
+	};
+
+	void addBlock(std::size_t minSize);
+	void swap(Arena& rhs) noexcept {
+		std::swap(blockSize_, rhs.blockSize_);
+		std::swap(blocks_, rhs.blocks_);
+		std::swap(dtors_, rhs.dtors_);
+		std::swap(cur_, rhs.cur_);
+		std::swap(end_, rhs.end_);
+		std::swap(capacity_, rhs.capacity_);
+	}
+
+	std::size_t blockSize_ {defaultBlockSize};
+	Block* blocks_ {};
+	Destructor* dtors_ {};
+	char* cur_ {};
+	char* end_ {};
+	std::size_t capacity_ {};
+};
+
+} // namespace ast
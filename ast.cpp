@@ -1,4 +1,5 @@
 #include "ast.hpp"
+#include <algorithm>
 #include <array>
 #include <cassert>
 
@@ -10,19 +11,24 @@ using std::array;
 
 struct BuiltinTypeTable {
 	BuiltinType _void;
-	array<array<array<BuiltinType, unsigned(BuiltinType::Type::count) - 1>, 3>, 3> types;
+	array<array<array<BuiltinType, unsigned(BuiltinType::Type::count) - 1>, 4>, 4> types;
 };
 
 BuiltinTypeTable initBuiltinTypes() {
 	BuiltinTypeTable ret;
 	ret._void.type = BuiltinType::Type::eVoid;
+	ret._void.id = 1u;
 
+	auto id = 2u;
 	for(auto t = 1u; t < unsigned(BuiltinType::Type::count); ++t) {
-		for(auto r = 1u; r < 4; ++r) {
-			for(auto c = 1u; c < 4; ++c) {
-				ret.types[r - 1][c - 1][t - 1].rows = r;
-				ret.types[r - 1][c - 1][t - 1].cols = c;
-				ret.types[r - 1][c - 1][t - 1].type = BuiltinType::Type(t);
+		for(auto r = 1u; r <= 4; ++r) {
+			for(auto c = 1u; c <= 4; ++c) {
+				auto& type = ret.types[r - 1][c - 1][t - 1];
+				type.category = Type::Category::primitive;
+				type.rows = r;
+				type.cols = c;
+				type.type = BuiltinType::Type(t);
+				type.id = id++;
 			}
 		}
 	}
@@ -68,4 +74,115 @@ const ast::BuiltinType& BuiltinType::matType(Type type, unsigned rows, unsigned
 	return builtinTypeTable().types[rows - 1][cols - 1][unsigned(type) - 1];
 }
 
+Layout layout(const Type& type) {
+	if(type.category == Type::Category::eStruct) {
+		auto& stype = static_cast<const StructType&>(type);
+		assert(stype.alignment && "Struct was not finished");
+		return {stype.size, stype.alignment};
+	}
+
+	assert(type.category == Type::Category::primitive);
+	auto& btype = static_cast<const BuiltinType&>(type);
+	assert(btype.type != BuiltinType::Type::eVoid);
+	auto scalar = (btype.type == BuiltinType::Type::f64) ? 8u : 4u;
+
+	// vec3 is aligned like vec4, matrices are arrays of column vectors
+	auto colAlign = scalar * (btype.rows == 1 ? 1u : btype.rows == 2 ? 2u : 4u);
+	if(btype.cols == 1) {
+		return {scalar * btype.rows, colAlign};
+	}
+
+	return {colAlign * btype.cols, colAlign};
+}
+
+void StructType::finish() {
+	size = 0u;
+	alignment = 1u;
+	for(auto& member : members) {
+		auto [msize, malign] = layout(*member.type);
+		size = (size + malign - 1) / malign * malign;
+		member.offset = size;
+		size += msize;
+		alignment = std::max(alignment, malign);
+	}
+
+	size = (size + alignment - 1) / alignment * alignment;
+
+	auto tableSize = 4u;
+	memberBits = 2u;
+	while(tableSize < 2 * members.size()) {
+		tableSize *= 2;
+		++memberBits;
+	}
+
+	memberTable.assign(tableSize, 0u);
+	for(auto i = 0u; i < members.size(); ++i) {
+		auto pos = hashSlot(members[i].name.name.id(), memberBits);
+		while(memberTable[pos]) {
+			assert(members[memberTable[pos] - 1].name.name != members[i].name.name &&
+				"Duplicate struct member");
+			pos = (pos + 1) & (tableSize - 1);
+		}
+
+		memberTable[pos] = i + 1;
+	}
+}
+
+const StructMember* StructType::findMember(Symbol name) const {
+	assert(!memberTable.empty() && "Struct was not finished");
+	auto mask = memberTable.size() - 1;
+	for(auto pos = hashSlot(name.id(), memberBits); memberTable[pos]; pos = (pos + 1) & mask) {
+		auto& member = members[memberTable[pos] - 1];
+		if(member.name.name == name) {
+			return &member;
+		}
+	}
+
+	return nullptr;
+}
+
+bool markAssigning(const Expression& expr,
+		std::unordered_set<const Expression*>& assigning) {
+	auto assigns = false;
+	auto sub = [&](const Expression* child) {
+		if(child) {
+			assigns = markAssigning(*child, assigning) || assigns;
+		}
+	};
+
+	if(auto* op = dynamic_cast<const OpExpression*>(&expr)) {
+		for(auto* child : op->children) {
+			sub(child);
+		}
+	} else if(auto* fcall = dynamic_cast<const FunctionCall*>(&expr)) {
+		for(auto* arg : fcall->arguments) {
+			sub(arg);
+		}
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&expr)) {
+		sub(access->accessed);
+	} else if(auto* codeBlock = dynamic_cast<const CodeBlock*>(&expr)) {
+		for(auto* stmt : codeBlock->statements) {
+			assigns = assigns || dynamic_cast<const AssignStatement*>(stmt);
+			for(auto* child : stmt->expressions()) {
+				sub(child);
+			}
+		}
+		sub(codeBlock->ret);
+	} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&expr)) {
+		sub(ifExpr->ifBranch.condition);
+		sub(ifExpr->ifBranch.code);
+		for(auto& branch : ifExpr->elsifBranches) {
+			sub(branch.condition);
+			sub(branch.code);
+		}
+		sub(ifExpr->elseBranch);
+	}
+
+	if(assigns) {
+		assigning.insert(&expr);
+	}
+
+	return assigns;
+}
+
 } // namespace ast
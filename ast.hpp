@@ -5,7 +5,15 @@
 #include <memory>
 #include <string>
 #include <optional>
+#include <unordered_set>
 #include <cstdint>
+#include <array>
+#include "arena.hpp"
+#include "symbol.hpp"
+#include "operators.hpp"
+#include "source.hpp"
+#include "printer.hpp"
+#include "span.hpp"
 
 namespace ast {
 
@@ -20,12 +28,12 @@ struct Expression;
 struct OpExpression;
 struct FunctionCall;
 struct CodeBlock;
-struct NumberLiteral;
+struct Literal;
 struct IdentifierExpression;
 class Visitor;
 
 struct Identifier {
-	std::string name;
+	Symbol name;
 };
 
 struct Type {
@@ -33,10 +41,13 @@ struct Type {
 		primitive,
 		eStruct,
 		eEnum,
-		// function,
+		function,
 	};
 
 	Category category;
+	// Unique per type, assigned by the TypeContext (see types.hpp).
+	// Types are canonical, equal types are the same object.
+	std::uint32_t id {};
 };
 
 struct BuiltinType : Type {
@@ -56,6 +67,10 @@ struct BuiltinType : Type {
 	unsigned rows {1};
 	unsigned cols {1};
 
+	// void and every scalar, vector and matrix type, they have
+	// the ids 1..builtinCount.
+	static constexpr auto builtinCount = 1u + (unsigned(Type::count) - 1u) * 16u;
+
 	// Builtin types
 	static const ast::BuiltinType& voidType();
 	static const ast::BuiltinType& f32Type();
@@ -67,12 +82,11 @@ struct BuiltinType : Type {
 	static const ast::BuiltinType& matType(Type type, unsigned rows, unsigned cols);
 };
 
-/*
+// Only created by the TypeContext
 struct FunctionType : Type {
 	const Type* returnType;
-	std::vector<const Type*> argumentTypes;
+	std::vector<const Type*> parameterTypes;
 };
-*/
 
 struct EnumValue {
 	Identifier name;
@@ -86,14 +100,43 @@ struct EnumType : Type {
 struct StructMember {
 	const Type* type;
 	Identifier name;
-	std::unique_ptr<Expression> init;
+	Expression* init {};
+	unsigned offset {}; // in bytes, set by StructType::finish
 };
 
 struct StructType : Type {
 	std::vector<StructMember> members;
-	std::string name;
+	Symbol name;
+
+	// std430 layout, set by finish
+	unsigned size {};
+	unsigned alignment {};
+
+	// Open addressing table by symbol id with the member slot + 1
+	// per entry, 0 for empty ones. Power of two size, at most half full.
+	std::vector<std::uint32_t> memberTable;
+	unsigned memberBits {}; // log2 of the table size
+
+	// Computes the layout and member table. Must be called once all
+	// members were added, the members must not change afterwards.
+	void finish();
+
+	// Returns null if there is no member with the given name.
+	const StructMember* findMember(Symbol name) const;
+	unsigned slot(const StructMember& member) const {
+		return unsigned(&member - members.data());
+	}
+};
+
+// Size and alignment of a type in the std430 layout.
+// Only valid for builtin and finished struct types.
+struct Layout {
+	unsigned size;
+	unsigned alignment;
 };
 
+Layout layout(const Type& type);
+
 struct Parameter {
 	Type* type;
 	Identifier name;
@@ -101,8 +144,14 @@ struct Parameter {
 
 struct Node {
 	virtual void visit(Visitor&) = 0;
-	virtual std::string print() const = 0;
+	virtual void write(Printer&) const = 0;
 	virtual ~Node() = default;
+
+	std::string print(std::size_t limit = Printer::noLimit) const {
+		Printer printer(limit);
+		write(printer);
+		return printer.take();
+	}
 };
 
 struct Expression : Node {
@@ -114,17 +163,18 @@ struct DeriveVisitor : public Base {
 	void visit(Visitor& v) override;
 };
 
+// Local variable or function parameter
 struct VariableDeclaration {
 	Identifier name;
-	Type* type;
-	std::unique_ptr<Expression> init;
+	const Type* type;
+	Expression* init {}; // null for parameters
 };
 
 struct IdentifierExpression : DeriveVisitor<Expression, IdentifierExpression> {
 	const VariableDeclaration* decl;
 
 	const Type& type() const override { return *decl->type; }
-	std::string print() const override { return decl->name.name; }
+	void write(Printer& p) const override { p << decl->name.name.str(); }
 };
 
 template<typename T>
@@ -144,39 +194,41 @@ constexpr const BuiltinType& builtinType() {
 	// constexpr error landing here
 }
 
-struct Literal : DeriveVisitor<Expression, NumberLiteral> {};
+struct Literal : DeriveVisitor<Expression, Literal> {};
 
 template<typename T>
-struct LiteralImpl : DeriveVisitor<Literal, NumberLiteral> {
+struct LiteralImpl : Literal {
 	T value;
 
 	const Type& type() const override { return builtinType<T>(); }
-	std::string print() const override { return std::to_string(value); }
+	void write(Printer& p) const override { p << value; }
 };
 
 struct Statement : Node {
-	virtual std::vector<Expression*> expressions() const = 0;
+	// View into the statement, valid as long as it isn't changed.
+	virtual nytl::span<Expression* const> expressions() const = 0;
 };
 
 struct AssignStatement : DeriveVisitor<Statement, AssignStatement> {
-	std::unique_ptr<Expression> left;
-	std::unique_ptr<Expression> right;
+	std::array<Expression*, 2> operands {}; // left, right
+
+	Expression* left() const { return operands[0]; }
+	Expression* right() const { return operands[1]; }
 
-	std::vector<Expression*> expressions() const override {
-		return {left.get(), right.get()};
+	nytl::span<Expression* const> expressions() const override {
+		return operands;
 	}
-	std::string print() const override {
-		auto ret = left->print();
-		ret += " = ";
-		ret += right->print();
-		return ret;
+	void write(Printer& p) const override {
+		left()->write(p);
+		p << " = ";
+		right()->write(p);
 	}
 };
 
 struct CodeBlock : DeriveVisitor<Expression, CodeBlock> {
 	CodeBlock* parent {}; // might be null
-	std::vector<std::unique_ptr<Statement>> statements;
-	std::unique_ptr<Expression> ret; // optional
+	std::vector<Statement*> statements;
+	Expression* ret {}; // optional
 
 	const Type& type() const override {
 		if(ret) {
@@ -186,26 +238,43 @@ struct CodeBlock : DeriveVisitor<Expression, CodeBlock> {
 		return BuiltinType::voidType();
 	}
 
-	std::string print() const override {
-		std::string sret = "{\n";
+	void write(Printer& p) const override {
+		p << "{";
+		p.indent();
 		for(const auto& s : statements) {
-			sret += s->print();
-			sret += ";\n";
+			if(p.full()) {
+				break;
+			}
+
+			p.newline();
+			s->write(p);
+			p << ";";
 		}
 
 		if(ret) {
-			sret += ret->print();
-			sret += "\n";
+			p.newline();
+			ret->write(p);
 		}
 
-		sret += "}\n";
-		return sret;
+		p.unindent();
+		p.newline();
+		p << "}";
 	}
 };
 
+// Owns all nodes and types in its arena, the node pointers
+// are only valid while the module is alive.
 struct Module {
-	std::vector<std::unique_ptr<Function>> functions;
-	std::vector<std::unique_ptr<Type>> types;
+	// The text the module was parsed from. Views created while
+	// parsing point into it, it must live as long as the module.
+	SourceFile source;
+	Arena arena;
+	Symbol name;
+	// Modules this one imports, they are built before and must
+	// outlive this module.
+	std::vector<const Module*> imports;
+	std::vector<Function*> functions;
+	std::vector<Type*> types;
 };
 
 // Function or builtin function
@@ -215,7 +284,7 @@ struct Callable {
 	// TODO: probably a better interface
 	// virtual const Type* typeCheck(nytl::span<const Type*> params) const = 0;
 
-	virtual std::vector<const Type*> parameters() const = 0;
+	virtual nytl::span<const Type* const> parameters() const = 0;
 	virtual const Type& returnType() const = 0;
 	virtual std::string_view name() const = 0;
 	virtual ~Callable() = default;
@@ -229,149 +298,161 @@ struct BuiltinFunction : Callable {
 */
 
 struct Function : Callable {
-	struct Parameter {
-		const Type* type {};
-		Identifier ident;
-	};
-
 	Identifier ident;
-	std::vector<Parameter> params;
-	// TODO: use that instead to bind them
-	// std::vector<VariableDeclaration> params;
+	// The declarations identifiers in the body bind to and their types,
+	// always of the same size. The types are stored separately so
+	// parameters() is a view.
+	std::vector<const VariableDeclaration*> params;
+	std::vector<const Type*> paramTypes;
 	const Type* retType;
-	std::unique_ptr<CodeBlock> code;
+	CodeBlock* code {};
+	const FunctionType* signature {}; // set when the function is added
 
-	std::vector<const Type*> parameters() const override {
-		std::vector<const Type*> ret;
-		for(auto& param : params) {
-			ret.push_back(param.type);
-		}
-		return ret;
+	void addParam(const VariableDeclaration& param) {
+		params.push_back(&param);
+		paramTypes.push_back(param.type);
+	}
+
+	nytl::span<const Type* const> parameters() const override {
+		return paramTypes;
 	}
 	const Type& returnType() const override {
 		return *retType;
 	}
 	std::string_view name() const override {
-		return ident.name;
+		return ident.name.str();
 	}
 };
 
 struct ExpressionStatement : DeriveVisitor<Statement, ExpressionStatement> {
-	std::unique_ptr<Expression> expr;
+	Expression* expr {};
 
-	std::vector<Expression*> expressions() const override {
-		return {expr.get()};
+	nytl::span<Expression* const> expressions() const override {
+		return {&expr, 1u};
 	}
-	std::string print() const override {
-		return expr->print();
+	void write(Printer& p) const override {
+		expr->write(p);
+	}
+};
+
+// Name of a builtin, struct or enum type, see TypeContext.
+std::string_view typeName(const Type& type);
+
+struct DeclarationStatement : DeriveVisitor<Statement, DeclarationStatement> {
+	VariableDeclaration* decl {};
+
+	nytl::span<Expression* const> expressions() const override {
+		return {&decl->init, 1u};
+	}
+	void write(Printer& p) const override {
+		p << typeName(*decl->type) << " " << decl->name.name.str() << " = ";
+		decl->init->write(p);
 	}
 };
 
 struct IfExpression : DeriveVisitor<Expression, IfExpression> {
 	struct Branch {
-		std::unique_ptr<Expression> condition;
-		std::unique_ptr<CodeBlock> code;
+		Expression* condition {};
+		CodeBlock* code {};
 	};
 
 	Branch ifBranch;
 	std::vector<Branch> elsifBranches; // may be empty
-	std::unique_ptr<CodeBlock> elseBranch; // optional
+	CodeBlock* elseBranch {}; // optional
 	Type* ptype;
 
 	const Type& type() const override { return *ptype; }
-	std::string print() const override {
-		std::string ret = "if ";
-		ret += ifBranch.condition->print();
-		ret += " ";
-		ret += ifBranch.code->print();
+	void write(Printer& p) const override {
+		p << "if ";
+		ifBranch.condition->write(p);
+		p << " ";
+		ifBranch.code->write(p);
 
 		for(const auto& b : elsifBranches) {
-			ret += " else if ";
-			ret += b.condition->print();
-			ret += " ";
-			ret += b.code->print();
+			p << " else if ";
+			b.condition->write(p);
+			p << " ";
+			b.code->write(p);
 		}
 
 		if(elseBranch) {
-			ret += " else ";
-			ret += elseBranch->print();
+			p << " else ";
+			elseBranch->write(p);
 		}
-
-		ret += "\n";
-		return ret;
 	}
 };
 
 struct MemberAccess : DeriveVisitor<Expression, MemberAccess> {
-	std::unique_ptr<Expression> accessed;
+	Expression* accessed {};
 	const StructMember* accessor;
 
 	const Type& type() const override {
 		return *accessor->type;
 	}
+	void write(Printer& p) const override {
+		accessed->write(p);
+		p << "." << accessor->name.name.str();
+	}
 };
 
 struct FunctionCall : DeriveVisitor<Expression, FunctionCall> {
 	const Callable* called;
-	std::vector<std::unique_ptr<Expression>> arguments;
+	std::vector<Expression*> arguments;
 
 	const Type& type() const override { return called->returnType(); }
-	std::string print() const override {
-		std::string ret;
-		ret += called->name();
-		ret += "(";
+	void write(Printer& p) const override {
+		p << called->name() << "(";
+		auto first = true;
 		for(const auto& arg : arguments) {
-			ret += arg->print();
-		}
-		ret += ")";
+			if(!first) {
+				p << ", ";
+			}
 
-		return ret;
+			arg->write(p);
+			first = false;
+		}
+		p << ")";
 	}
 };
 
 struct OpExpression : DeriveVisitor<Expression, OpExpression> {
-	enum class OpType {
-		add,
-		mult,
-		sub,
-		div
-	};
+	using OpType = ast::OpType;
 
-	static const char* name(OpType op) {
-		switch(op) {
-			case OpType::add: return "+";
-			case OpType::mult: return "*";
-			case OpType::sub: return "-";
-			case OpType::div: return "/";
-			default: return "";
+	static std::string_view name(OpType op) {
+		if(op == OpType::neg) {
+			return "-";
 		}
+
+		auto* bop = findBinaryOperator(op);
+		return bop ? bop->token : "";
 	}
 
-	std::vector<std::unique_ptr<Expression>> children;
+	std::vector<Expression*> children;
 	OpType opType;
 	Type* ptype;
 
 	const Type& type() const override { return *ptype; }
-	std::string print() const override {
-		std::string ret;
-		ret += "(";
+	void write(Printer& p) const override {
+		p << "(";
 		auto first = true;
-		const auto* sop = name(opType);
+		auto sop = name(opType);
+		if(children.size() == 1) {
+			p << sop;
+		}
+
 		for(const auto& c : children) {
 			if(!first) {
-				ret += " ";
-				ret += sop;
-				ret += " ";
+				p << " " << sop << " ";
 			}
 
-			ret += c->print();
+			c->write(p);
 			first = false;
 		}
-		ret += ")";
-		return ret;
+		p << ")";
 	}
 };
 
+// The default implementations visit all children.
 class Visitor {
 public:
 	virtual ~Visitor() = default;
@@ -379,6 +460,9 @@ public:
 	virtual void visit(Node&) {}
 	virtual void visit(Statement& s) {
 		visit(static_cast<Node&>(s));
+		for(auto* expr : s.expressions()) {
+			expr->visit(*this);
+		}
 	}
 	virtual void visit(AssignStatement& s) {
 		visit(static_cast<Statement&>(s));
@@ -386,25 +470,31 @@ public:
 	virtual void visit(ExpressionStatement& s) {
 		visit(static_cast<Statement&>(s));
 	}
+	virtual void visit(DeclarationStatement& s) {
+		visit(static_cast<Statement&>(s));
+	}
 	virtual void visit(Expression& e) {
 		visit(static_cast<Node&>(e));
 	}
 	virtual void visit(OpExpression& e) {
 		visit(static_cast<Expression&>(e));
+		for(auto& child : e.children) {
+			child->visit(*this);
+		}
 	}
 	virtual void visit(FunctionCall& e) {
 		visit(static_cast<Expression&>(e));
 		for(auto& arg : e.arguments) {
-			visit(*arg);
+			arg->visit(*this);
 		}
 	}
 	virtual void visit(CodeBlock& e) {
 		visit(static_cast<Expression&>(e));
 		for(auto& stmt : e.statements) {
-			visit(*stmt);
+			stmt->visit(*this);
 		}
 		if(e.ret) {
-			visit(*e.ret);
+			e.ret->visit(*this);
 		}
 	}
 	virtual void visit(Literal& e) {
@@ -413,6 +503,22 @@ public:
 	virtual void visit(IdentifierExpression& e) {
 		visit(static_cast<Expression&>(e));
 	}
+	virtual void visit(IfExpression& e) {
+		visit(static_cast<Expression&>(e));
+		e.ifBranch.condition->visit(*this);
+		e.ifBranch.code->visit(*this);
+		for(auto& b : e.elsifBranches) {
+			b.condition->visit(*this);
+			b.code->visit(*this);
+		}
+		if(e.elseBranch) {
+			e.elseBranch->visit(*this);
+		}
+	}
+	virtual void visit(MemberAccess& e) {
+		visit(static_cast<Expression&>(e));
+		e.accessed->visit(*this);
+	}
 };
 
 template<typename Base, typename Derived>
@@ -420,4 +526,10 @@ void ast::DeriveVisitor<Base, Derived>::visit(Visitor& v) {
 	v.visit(static_cast<Derived&>(*this));
 }
 
+// Adds all expressions in the tree of expr that contain an assignment
+// to 'assigning', variables might change while they are evaluated.
+// Returns whether expr contains one.
+bool markAssigning(const Expression& expr,
+	std::unordered_set<const Expression*>& assigning);
+
 } // namespace ast
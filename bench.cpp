@@ -0,0 +1,476 @@
+// Throughput benchmark on generated modules.
+// Generates synthetic modules of different kinds and sizes from a fixed
+// seed and measures how fast they are parsed, built and printed.
+//
+// bench [--seed n] [--runs n] [--sizes 65536,1048576] [--kinds nested,decls]
+// bench --write <kind> <bytes> <file>: only write a generated module
+// bench --spmd <count> [--seed n] [--runs n]: runs small kernels count
+// times on the vm and on the spmd machine, with every supported
+// instruction set. The speedup should approach the lane count.
+
+#include "syntax.hpp"
+#include "errors.hpp"
+#include "lexer.hpp"
+#include "ast.hpp"
+#include "actions.hpp"
+#include "vm.hpp"
+#include "spmd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+enum class Kind {
+	nested, // deep expression nests, if expressions and code blocks
+	chains, // long member access chains with calls of declared functions
+	decls, // many small structs and functions
+	comments, // like nested but most of the file are comments
+};
+
+struct KindName {
+	Kind kind;
+	const char* name;
+};
+
+constexpr KindName kindNames[] = {
+	{Kind::nested, "nested"},
+	{Kind::chains, "chains"},
+	{Kind::decls, "decls"},
+	{Kind::comments, "comments"},
+};
+
+// Only uses the raw engine output so that the same seed gives the
+// same module with every standard library.
+class Generator {
+public:
+	explicit Generator(unsigned seed) : rng_(seed) {}
+
+	std::string module(Kind kind, std::size_t size) {
+		std::string out;
+		out.reserve(size + 4096);
+		auto id = 0u;
+		if(kind == Kind::chains) {
+			chainDecls(out);
+		}
+
+		while(out.size() < size) {
+			switch(kind) {
+				case Kind::nested: function(out, id++, false); break;
+				case Kind::chains: chainFunction(out, id++); break;
+				case Kind::decls: declPair(out, id++); break;
+				case Kind::comments: function(out, id++, true); break;
+			}
+		}
+
+		return out;
+	}
+
+private:
+	unsigned rand(unsigned n) { return rng_() % n; }
+
+	void literal(std::string& out) {
+		static const char* literals[] = {"1", "2.5", "3i", "7u32", "0.25f64", "42", "true", "false"};
+		out += literals[rand(std::size(literals))];
+	}
+
+	void op(std::string& out) {
+		auto& bop = ast::binaryOperators[rand(std::size(ast::binaryOperators))];
+		out += ' ';
+		out += bop.token;
+		out += ' ';
+	}
+
+	void comment(std::string& out) {
+		if(!comments_) {
+			return;
+		}
+
+		if(rand(2)) {
+			out += "/* generated block comment, with some words in it */ ";
+		} else {
+			out += "// generated line comment that goes on for a while\n";
+		}
+	}
+
+	void expr(std::string& out, unsigned depth) {
+		if(depth == 0 || rand(5) == 0) {
+			literal(out);
+			return;
+		}
+
+		switch(rand(6)) {
+			case 0:
+			case 1: {
+				auto count = 2 + rand(3);
+				for(auto i = 0u; i < count; ++i) {
+					if(i) {
+						op(out);
+						comment(out);
+					}
+					expr(out, depth - 1);
+				}
+				break;
+			} case 2:
+				out += '(';
+				expr(out, depth - 1);
+				out += ')';
+				break;
+			case 3:
+				// '--' is not valid, the operand might start with '-'
+				out += "-(";
+				expr(out, depth - 1);
+				out += ')';
+				break;
+			case 4:
+				out += "(if ";
+				expr(out, depth - 1);
+				out += " { ";
+				expr(out, depth - 1);
+				out += " } else { ";
+				expr(out, depth - 1);
+				out += " })";
+				break;
+			case 5:
+				codeBlock(out, depth - 1);
+				break;
+		}
+	}
+
+	void codeBlock(std::string& out, unsigned depth) {
+		out += "{\n";
+		auto count = rand(4);
+		for(auto i = 0u; i < count; ++i) {
+			comment(out);
+			expr(out, depth);
+			out += ";\n";
+		}
+
+		expr(out, depth);
+		out += "\n}";
+	}
+
+	void function(std::string& out, unsigned id, bool comments) {
+		comments_ = comments;
+		comment(out);
+		out += "f32 f" + std::to_string(id) + "() ";
+		codeBlock(out, 4 + rand(4));
+		out += "\n\n";
+	}
+
+	// The roots of the chains: struct C<k> has members of type C<k + 1>,
+	// so every access goes one level deeper, and g<k> returns its C<k>
+	// argument so that calls can be chained.
+	static constexpr auto chainDepth = 20u;
+	static constexpr auto chainMembers = 2u; // more would overflow the struct sizes
+
+	void chainDecls(std::string& out) {
+		for(auto k = chainDepth; k-- > 0u;) {
+			auto name = "C" + std::to_string(k);
+			out += "struct " + name + " {\n";
+			for(auto m = 0u; k + 1 < chainDepth && m < chainMembers; ++m) {
+				out += "\tC" + std::to_string(k + 1) + " m" + std::to_string(m) + ";\n";
+			}
+			out += "\tf32 x;\n}\n\n";
+			out += name + " g" + std::to_string(k) + "(" + name + " c, f32 w) { c }\n\n";
+		}
+	}
+
+	// Starts at the parameter of type C0, ends at level 'length'
+	std::string chain(unsigned length) {
+		auto ret = std::string("v");
+		for(auto i = 0u; i < length; ++i) {
+			ret += ".m" + std::to_string(rand(chainMembers));
+			if(rand(2)) {
+				ret = "g" + std::to_string(i + 1) + "(" + ret + ", 2.5)";
+			}
+		}
+
+		return ret;
+	}
+
+	void chainFunction(std::string& out, unsigned id) {
+		out += "f32 f" + std::to_string(id) + "(C0 v) {\n";
+		auto count = 1 + rand(8);
+		for(auto i = 0u; i < count; ++i) {
+			out += chain(4 + rand(chainDepth - 4));
+			out += ";\n";
+		}
+
+		out += chain(4 + rand(chainDepth - 4)) + ".x";
+		out += "\n}\n\n";
+	}
+
+	void declPair(std::string& out, unsigned id) {
+		static const char* types[] = {"f32", "f64", "i32", "u32", "bool"};
+		auto name = "S" + std::to_string(id);
+		out += "struct " + name + " {\n";
+		auto members = 1 + rand(6);
+		for(auto i = 0u; i < members; ++i) {
+			out += '\t';
+			out += types[rand(std::size(types))];
+			out += " m" + std::to_string(i);
+			if(rand(2)) {
+				out += " {";
+				literal(out);
+				out += '}';
+			}
+			out += ";\n";
+		}
+
+		if(id) {
+			out += "\tS" + std::to_string(id - 1) + " prev;\n";
+		}
+
+		out += "}\n\n";
+		out += "f32 f" + std::to_string(id) + "(f32 x, " + name + " s) { ";
+		expr(out, 2);
+		out += " }\n\n";
+	}
+
+	std::mt19937 rng_;
+	bool comments_ {};
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Best time of the given number of runs
+template<typename F>
+double measure(unsigned runs, F&& func) {
+	auto best = 1e300;
+	for(auto i = 0u; i < runs; ++i) {
+		auto start = Clock::now();
+		func();
+		auto secs = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::min(best, secs);
+	}
+
+	return best;
+}
+
+struct Result {
+	double parse {}; // seconds
+	double build {};
+	double print {};
+	std::size_t nodes {};
+	std::size_t printed {}; // bytes
+};
+
+Result run(std::string_view src, unsigned runs) {
+	Result res;
+	res.parse = measure(runs, [&]{
+		lex::TokenInput in(src, "bench");
+		pegtl::parse<syn::Grammar, pegtl::nothing, syn::Control>(in);
+	});
+
+	res.build = measure(runs, [&]{
+		lex::TokenInput in(src, "bench");
+		builder::ActionBuilder builder;
+		pegtl::parse<syn::Grammar, builder::Action,
+			builder::ActionControl<syn::Control>::type>(in, builder);
+		res.nodes = builder.createdNodes();
+	});
+
+	lex::TokenInput in(src, "bench");
+	builder::ActionBuilder builder;
+	pegtl::parse<syn::Grammar, builder::Action,
+		builder::ActionControl<syn::Control>::type>(in, builder);
+	res.print = measure(runs, [&]{
+		ast::Printer printer;
+		for(auto* func : builder.module().functions) {
+			func->code->write(printer);
+		}
+		res.printed = printer.written();
+	});
+
+	return res;
+}
+
+std::vector<std::size_t> parseSizes(std::string_view str) {
+	std::vector<std::size_t> ret;
+	while(!str.empty()) {
+		auto comma = str.find(',');
+		ret.push_back(std::stoull(std::string(str.substr(0, comma))));
+		str = (comma == str.npos) ? std::string_view{} : str.substr(comma + 1);
+	}
+
+	return ret;
+}
+
+const KindName* findKind(std::string_view name) {
+	for(auto& kn : kindNames) {
+		if(name == kn.name) {
+			return &kn;
+		}
+	}
+
+	return nullptr;
+}
+
+// Kernels of the spmd benchmark, shade diverges for about half of
+// the lanes.
+constexpr auto spmdSource = R"(
+f32 shade(f32 x, f32 y) {
+	f32 d = x * x + y * y;
+	f32 s = (if d < 16.0 {
+		d * 0.5 + x
+	} else {
+		y - d * 0.25
+	});
+	s * s - x * y + d / (1.0 + d)
+}
+
+i32 hash(i32 x, i32 y) {
+	i32 h = x * 73856093i ^ y * 19349663i;
+	h = h ^ (h >> 13i);
+	h * 83492791i + (h << 3i)
+}
+)";
+
+// Invocations per second of the vm and the spmd machine. Also checks
+// that they compute the same results.
+bool runSpmd(std::size_t count, unsigned runs, unsigned seed) {
+	lex::TokenInput in(spmdSource, "spmd");
+	builder::ActionBuilder builder;
+	pegtl::parse<syn::Grammar, builder::Action,
+		builder::ActionControl<syn::Control>::type>(in, builder);
+
+	std::vector<ast::vm::Simd> simds;
+	for(auto simd : {ast::vm::Simd::none, ast::vm::Simd::avx2}) {
+		if(ast::vm::supported(simd)) {
+			simds.push_back(simd);
+		}
+	}
+
+	std::printf("%-10s %12s %12s %12s %10s\n", "kernel", "simd",
+		"vm Minv/s", "spmd Minv/s", "speedup");
+
+	std::mt19937 rng(seed);
+	auto success = true;
+	for(auto* func : builder.module().functions) {
+		ast::vm::Program program;
+		auto index = program.add(*func);
+		auto isFloat = func->name() == "shade";
+
+		std::vector<ast::vm::Value> args(2u * count);
+		for(auto& arg : args) {
+			if(isFloat) {
+				arg.f = float(rng() % 1024u) / 64.f - 8.f;
+			} else {
+				arg.u = rng();
+			}
+		}
+
+		std::vector<ast::vm::Value> expected(count);
+		ast::vm::Machine machine(program);
+		auto vm = measure(runs, [&]{
+			for(auto i = std::size_t(0u); i < count; ++i) {
+				expected[i] = machine.run(index, {args.data() + 2 * i, 2u})[0];
+			}
+		});
+
+		for(auto simd : simds) {
+			std::vector<ast::vm::Value> results(count);
+			ast::vm::SpmdMachine spmd(program, simd);
+			auto secs = measure(runs, [&]{
+				spmd.run(index, count, args, results);
+			});
+
+			auto name = simd == ast::vm::Simd::avx2 ? "avx2" : "none";
+			// both results are 32-bit, compare the bits
+			auto same = std::equal(results.begin(), results.end(), expected.begin(),
+				[](auto& a, auto& b) { return a.u == b.u; });
+			if(!same) {
+				std::printf("%s with %s differs from the vm\n",
+					std::string(func->name()).c_str(), name);
+				success = false;
+			}
+
+			auto minv = count / 1e6;
+			std::printf("%-10s %12s %12.2f %12.2f %10.2f\n",
+				std::string(func->name()).c_str(), name, minv / vm, minv / secs,
+				vm / secs);
+		}
+	}
+
+	return success;
+}
+
+} // anon namespace
+
+int main(int argc, char** argv) {
+	auto seed = 1u;
+	auto runs = 5u;
+	auto spmdCount = std::size_t(0u);
+	std::vector<std::size_t> sizes = {64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+	std::vector<const KindName*> kinds;
+	for(auto& kn : kindNames) {
+		kinds.push_back(&kn);
+	}
+
+	for(auto i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+		auto hasValue = i + 1 < argc;
+		if(arg == "--seed" && hasValue) {
+			seed = std::stoul(argv[++i]);
+		} else if(arg == "--runs" && hasValue) {
+			runs = std::stoul(argv[++i]);
+		} else if(arg == "--sizes" && hasValue) {
+			sizes = parseSizes(argv[++i]);
+		} else if(arg == "--kinds" && hasValue) {
+			kinds.clear();
+			auto list = std::string_view(argv[++i]);
+			while(!list.empty()) {
+				auto comma = list.find(',');
+				auto kind = findKind(list.substr(0, comma));
+				if(!kind) {
+					std::printf("Unknown kind '%s'\n", std::string(list.substr(0, comma)).c_str());
+					return 1;
+				}
+
+				kinds.push_back(kind);
+				list = (comma == list.npos) ? std::string_view{} : list.substr(comma + 1);
+			}
+		} else if(arg == "--spmd" && hasValue) {
+			spmdCount = std::stoull(argv[++i]);
+		} else if(arg == "--write" && i + 3 < argc) {
+			auto kind = findKind(argv[i + 1]);
+			if(!kind) {
+				std::printf("Unknown kind '%s'\n", argv[i + 1]);
+				return 1;
+			}
+
+			auto src = Generator(seed).module(kind->kind, std::stoull(argv[i + 2]));
+			std::ofstream(argv[i + 3], std::ios::binary) << src;
+			return 0;
+		} else {
+			std::printf("Invalid argument '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if(spmdCount) {
+		return runSpmd(spmdCount, runs, seed) ? 0 : 1;
+	}
+
+	std::printf("%-10s %10s %12s %12s %14s %12s %14s\n", "kind", "KiB",
+		"parse MB/s", "build MB/s", "build Mnode/s", "print MB/s", "print Mnode/s");
+	for(auto* kind : kinds) {
+		for(auto size : sizes) {
+			auto src = Generator(seed).module(kind->kind, size);
+			auto res = run(src, runs);
+
+			auto mb = src.size() / 1e6;
+			auto mnodes = res.nodes / 1e6;
+			std::printf("%-10s %10zu %12.2f %12.2f %14.2f %12.2f %14.2f\n", kind->name,
+				src.size() / 1024, mb / res.parse, mb / res.build, mnodes / res.build,
+				(res.printed / 1e6) / res.print, mnodes / res.print);
+		}
+	}
+}
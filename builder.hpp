@@ -3,53 +3,375 @@
 #include "syntax.hpp"
 #include "span.hpp"
 #include "ast.hpp"
+#include "types.hpp"
+#include "scope.hpp"
 #include "tao/pegtl/contrib/parse_tree.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <unordered_map>
+#include <vector>
+
 namespace builder {
 
-class TreeBuilder {
-	using ParseTreeNode = tao::pegtl::parse_tree::node;
-	using VariableMap = std::unordered_map<std::string_view, ast::VariableDeclaration*>;
-	using TypeMap = std::unordered_map<std::string_view, std::unique_ptr<ast::Type>>;
+// Name of the functions an expression calls. Only exists while the
+// call is built, functionCall replaces it with the resolved function.
+struct FunctionName : ast::Expression {
+	ast::Symbol name;
+
+	const ast::Type& type() const override { return ast::BuiltinType::voidType(); }
+	void write(ast::Printer& p) const override { p << name.str(); }
+	void visit(ast::Visitor&) override { assert(!"Function name wasn't called"); }
+};
+
+// Semantic state and node creation shared by the build modes,
+// i.e. the TreeBuilder below and the ActionBuilder in actions.hpp.
+class BuilderBase {
+public:
+	ast::Module& module() { return module_; }
+
+	// Number of ast nodes created so far
+	std::size_t createdNodes() const { return createdNodes_; }
+
+	// Makes the declarations of the given module visible.
+	// The module must already be completely built.
+	void importModule(const ast::Module& mod) {
+		module_.imports.push_back(&mod);
+		for(auto* type : mod.types) {
+			auto& stype = static_cast<ast::StructType&>(*type);
+			decls_.types.declare(stype.name, type);
+		}
+
+		// types of this module may shadow imported ones
+		decls_.moduleTypes = decls_.types.mark();
+		// callable like the functions of this module, see findCallable
+		for(auto* func : mod.functions) {
+			decls_.functions[func->ident.name].push_back(func);
+		}
+	}
+
+protected:
+	// All overloads per name, the imported ones first
+	using FunctionMap = std::unordered_map<ast::Symbol, std::vector<ast::Function*>>;
 
 	struct {
 		ast::CodeBlock* codeBlock {};
 		ast::Function* function {};
 	} current_;
 
+	// Variables are scoped by functions and code blocks, leave a
+	// scope by restoring the mark taken when entering it.
 	struct {
-		std::vector<VariableMap> vars;
-		std::vector<TypeMap> types;
+		ScopedTable<ast::VariableDeclaration*> vars;
+		ScopedTable<ast::Type*> types;
+		ScopedTable<ast::Type*>::Mark moduleTypes {};
+		FunctionMap functions;
 	} decls_;
 
 	ast::Module module_;
+	std::size_t createdNodes_ {};
+
+	// All nodes are owned by the arena of the module
+	template<typename T>
+	T* create() {
+		++createdNodes_;
+		return module_.arena.create<T>();
+	}
+
+	template<typename T>
+	ast::Expression* literal(T value) {
+		auto ret = create<ast::LiteralImpl<T>>();
+		ret->value = value;
+		return ret;
+	}
+
+	// value are the digits (and '.'), suffix the type suffix, see
+	// syn::OptNumberLiteralSuffix.
+	ast::Expression* numberLiteral(std::string_view value,
+			std::string_view suffix) {
+		auto fnumber = value.find('.') != value.npos;
+		if(suffix.empty() || suffix == "f" || suffix == "f32") {
+			return literal(parseNumber<ast::f32>(value));
+		} else if(suffix == "f64") {
+			return literal(parseNumber<ast::f64>(value));
+		} else if(suffix == "i" || suffix == "i32") {
+			assert(!fnumber);
+			return literal(parseNumber<ast::i32>(value));
+		} else if(suffix == "u" || suffix == "u32") {
+			assert(!fnumber);
+			return literal(parseNumber<ast::u32>(value));
+		}
+
+		assert(!"Invalid suffix");
+		return {};
+	}
+
+	// Parses directly from the source, the text isn't null-terminated.
+	template<typename T>
+	static T parseNumber(std::string_view str) {
+		T ret {};
+		auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), ret);
+		assert(ec == std::errc() && end == str.data() + str.size() && "Invalid number");
+		(void) end;
+		(void) ec;
+		return ret;
+	}
+
+	// Variables shadow functions with the same name
+	ast::Expression* identifierExpr(ast::Symbol name) {
+		// TODO: update for Colon syntax
+		if(auto* decl = decls_.vars.find(name)) {
+			auto ret = create<ast::IdentifierExpression>();
+			ret->decl = *decl;
+			return ret;
+		}
+
+		assert(decls_.functions.count(name) && "Invalid identifier");
+		auto ret = create<FunctionName>();
+		ret->name = name;
+		return ret;
+	}
 
-	std::unique_ptr<ast::Statement> parseStatement(const ParseTreeNode& node) {
-		if(node.is_type<syn::ExprStatement>()) {
-			assert(node.children.size() == 1);
-			auto ret = std::make_unique<ast::ExpressionStatement>();
+	// Declares the variable in the current scope, it shadows
+	// variables with the same name from outer scopes.
+	ast::VariableDeclaration* declareVariable(ast::Symbol name,
+			const ast::Type& type, ast::Expression* init) {
+		auto decl = module_.arena.create<ast::VariableDeclaration>();
+		decl->name.name = name;
+		decl->type = &type;
+		decl->init = init;
+		decls_.vars.declare(name, decl);
+		return decl;
+	}
+
+	ast::Expression* memberAccess(
+			ast::Expression* accessed, const ast::Identifier& ident) {
+		auto res = create<ast::MemberAccess>();
+		res->accessed = accessed;
+
+		// TODO: modify for member functions
+		auto& type = res->accessed->type();
+		assert(type.category == ast::Type::Category::eStruct);
+		auto& sType = static_cast<const ast::StructType&>(type);
+		res->accessor = sType.findMember(ident.name);
+		assert(res->accessor && "Struct {} does not have member {}");
+		return res;
+	}
+
+	ast::Expression* negate(ast::Expression* expr) {
+		auto ret = create<ast::OpExpression>();
+		ret->opType = ast::OpExpression::OpType::neg;
+		ret->children.push_back(expr);
+		return ret;
+	}
+
+	// Operator node without operands, they are added by binaryExpr.
+	ast::OpExpression* binaryOp(std::string_view token) {
+		auto* bop = ast::matchBinaryOperator(token);
+		assert(bop && bop->token.size() == token.size());
+		auto ret = create<ast::OpExpression>();
+		ret->opType = bop->op;
+		return ret;
+	}
+
+	// Builds the expression for a flat sequence of operands and
+	// operators (from binaryOp), i.e. operand, op, operand, op, ...
+	// using precedence climbing. Chains of the same left-associative
+	// operator end up in one node, e.g. 'a + b + c' has three children.
+	ast::Expression* binaryExpr(nytl::span<ast::Node* const> seq) {
+		assert(seq.size() % 2 == 1);
+		auto pos = std::size_t(0u);
+		return climbBinary(seq, pos, 0u);
+	}
+
+	// pos is the index of the current operand, on return the index of
+	// the last operand consumed.
+	ast::Expression* climbBinary(nytl::span<ast::Node* const> seq,
+			std::size_t& pos, unsigned minPrecedence) {
+		auto* lhs = static_cast<ast::Expression*>(seq[pos]);
+		ast::OpExpression* chain {};
+		while(pos + 1 < seq.size()) {
+			auto* op = static_cast<ast::OpExpression*>(seq[pos + 1]);
+			auto& info = *ast::findBinaryOperator(op->opType);
+			if(info.precedence < minPrecedence) {
+				break;
+			}
+
+			pos += 2;
+			auto next = info.precedence + (info.rightAssoc ? 0u : 1u);
+			auto* rhs = climbBinary(seq, pos, next);
+			if(chain && chain->opType == op->opType && !info.rightAssoc) {
+				chain->children.push_back(rhs);
+				continue;
+			}
+
+			op->children = {lhs, rhs};
+			lhs = chain = op;
+		}
+
+		return lhs;
+	}
+
+	ast::Expression* functionCall(ast::Expression* called,
+			std::vector<ast::Expression*> args) {
+		auto call = create<ast::FunctionCall>();
+		call->arguments = std::move(args);
+		call->called = findCallable(*called, call->arguments);
+		return call;
+	}
+
+	// The overload whose parameter types are exactly those of the
+	// arguments, there are no implicit conversions. Functions of this
+	// module were declared last, they shadow imported ones.
+	const ast::Callable* findCallable(const ast::Expression& called,
+			nytl::span<ast::Expression* const> args) {
+		auto* fname = dynamic_cast<const FunctionName*>(&called);
+		assert(fname && "Expression can't be called");
+
+		auto& overloads = decls_.functions.at(fname->name);
+		for(auto it = overloads.rbegin(); it != overloads.rend(); ++it) {
+			auto params = (*it)->parameters();
+			auto matches = params.size() == args.size() && std::equal(
+				params.begin(), params.end(), args.begin(),
+				[](auto* param, auto* arg) { return param == &ast::typeOf(*arg); });
+			if(matches) {
+				return *it;
+			}
+		}
+
+		assert(!"No function {} for the argument types");
+		return nullptr;
+	}
+
+	const ast::Type& findType(ast::Symbol name) {
+		if(auto* type = decls_.types.find(name)) {
+			return **type;
+		}
+
+		if(auto* builtin = ast::TypeContext::get().findBuiltin(name)) {
+			return *builtin;
+		}
+
+		assert(!"Unknown type");
+		return ast::BuiltinType::voidType();
+	}
+
+	void addStruct(ast::StructType* type) {
+		type->finish();
+		ast::TypeContext::get().add(*type);
+		module_.types.push_back(type);
+		assert(!decls_.types.find(type->name, decls_.moduleTypes) &&
+			"Type with name {} already known");
+		decls_.types.declare(type->name, type);
+	}
+
+	// Called once return type and parameters are known, before the
+	// body is built, so it can call the function itself.
+	void declareFunction(ast::Function* func) {
+		func->signature = &ast::TypeContext::get().function(*func->retType,
+			func->parameters());
+
+		// overloads of this module must have different parameters
+		auto& overloads = decls_.functions[func->ident.name];
+		auto params = func->parameters();
+		assert(std::none_of(module_.functions.begin(), module_.functions.end(), [&](auto* other) {
+			auto oparams = other->parameters();
+			return other->ident.name == func->ident.name &&
+				std::equal(params.begin(), params.end(), oparams.begin(), oparams.end());
+		}) && "Function {} with the same parameters already known");
+		(void) params;
+
+		overloads.push_back(func);
+		current_.function = func;
+	}
+
+	// Called with the finished function
+	void addFunction(ast::Function* func) {
+		assert(func == current_.function);
+		module_.functions.push_back(func);
+		current_.function = {};
+	}
+};
+
+// Parse tree node that is allocated from a per-thread pool instead of
+// doing one heap allocation per node. Freed nodes (the selectors
+// discard a lot of them) are reused. Must be freed on the thread that
+// created it.
+struct TreeNode : tao::pegtl::parse_tree::basic_node<TreeNode> {
+	struct Pool {
+		ast::Arena arena;
+		void* free {};
+	};
+
+	static Pool& pool() {
+		thread_local Pool pool;
+		return pool;
+	}
+
+	static void* operator new(std::size_t size) {
+		assert(size == sizeof(TreeNode));
+		auto& p = pool();
+		if(p.free) {
+			auto* ret = p.free;
+			p.free = *static_cast<void**>(ret);
+			return ret;
+		}
+
+		return p.arena.allocate(size, alignof(TreeNode));
+	}
+
+	static void operator delete(void* ptr) {
+		auto& p = pool();
+		*static_cast<void**>(ptr) = p.free;
+		p.free = ptr;
+	}
+};
+
+// Builds the ast from a parse tree.
+// Mainly useful for debugging the grammar together with print_dot, the
+// ActionBuilder creates the same ast without the intermediate tree.
+class TreeBuilder : public BuilderBase {
+public:
+	using ParseTreeNode = TreeNode;
+
+	ast::Statement* parseStatement(const ParseTreeNode& node) {
+		if(node.is_type<syn::ExprStatement>() && node.children.size() == 1) {
+			auto ret = create<ast::ExpressionStatement>();
 			ret->expr = parseExpr(*node.children[0]);
 			return ret;
-		} else if(node.is_type<syn::Assign>()) {
+		} else if(node.is_type<syn::ExprStatement>()) {
 			assert(node.children.size() == 2);
-			auto ret = std::make_unique<ast::AssignStatement>();
-			ret->left = parseExpr(*node.children[0]);
-			ret->right = parseExpr(*node.children[1]);
+			auto ret = create<ast::AssignStatement>();
+			ret->operands = {parseExpr(*node.children[0]), parseExpr(*node.children[1])};
 			return ret;
 		} else if(node.is_type<syn::IfExpr>()) {
-			auto ret = std::make_unique<ast::ExpressionStatement>();
-			ret->expr = std::make_unique<ast::IfExpression>(parseIfExpr(node));
+			auto ret = create<ast::ExpressionStatement>();
+			ret->expr = parseIfExpr(node);
+			return ret;
+		} else if(node.is_type<syn::VariableDecl>()) {
+			assert(node.children.size() == 3);
+			assert(node.children[0]->is_type<syn::Identifier>());
+			assert(node.children[1]->is_type<syn::Identifier>());
+
+			// the initializer doesn't see the declared variable yet
+			auto& type = findType(ast::Symbol(node.children[0]->string_view()));
+			auto init = parseExpr(*node.children[2]);
+			auto ret = create<ast::DeclarationStatement>();
+			ret->decl = declareVariable(parseIdentifier(*node.children[1]).name, type, init);
 			return ret;
 		}
 
 		assert(!"Invalid statement type");
+		return {};
 	}
 
-	std::unique_ptr<ast::CodeBlock> parseCodeBlock(const ParseTreeNode& node) {
-		assert(node.children.size() >= 1 & node.children.size() <= 2);
-		assert(node.is_type<syn::CodeBlock>());
+	ast::CodeBlock* parseCodeBlock(const ParseTreeNode& node) {
+		assert(node.children.size() >= 1 && node.children.size() <= 2);
+		assert(node.is_type<syn::CodeBlock>() || node.is_type<syn::ElseCodeBlock>());
 
-		auto ret = std::make_unique<ast::CodeBlock>();
+		auto ret = create<ast::CodeBlock>();
+		auto scope = decls_.vars.mark();
 		auto& statements = *node.children[0];
 		assert(statements.is_type<syn::CodeBlockStatements>());
 		for(auto& statement : statements.children) {
@@ -61,121 +383,73 @@ class TreeBuilder {
 			ret->ret = parseExpr(*retexpr);
 		}
 
+		decls_.vars.restore(scope);
 		return ret;
 	}
 
-	std::unique_ptr<ast::Expression> parseOpExpr(const ParseTreeNode& node,
-			ast::OpExpression::OpType op) {
-		assert(node.children.size() >= 2);
-		auto ret = std::make_unique<ast::OpExpression>();
-		ret->opType = op;
+	ast::Expression* parseBinaryExpr(const ParseTreeNode& node) {
+		assert(node.children.size() >= 3);
+		std::vector<ast::Node*> seq;
+		seq.reserve(node.children.size());
 		for(auto& child : node.children) {
-			ret->children.emplace_back(parseExpr(*child));
+			if(child->is_type<syn::BinaryOp>()) {
+				seq.push_back(binaryOp(child->string_view()));
+			} else {
+				seq.push_back(parseExpr(*child));
+			}
 		}
-		return ret;
+
+		return binaryExpr(seq);
 	}
 
 	ast::Identifier parseIdentifier(const ParseTreeNode& node) {
 		assert(node.children.empty());
-		assert(node.is_type<syn::Identifier>());
-		auto name = node.string_view();
-		return {std::string(name)};
+		assert(node.is_type<syn::Identifier>() || node.is_type<syn::MemberAccess>());
+		return {ast::Symbol(node.string_view())};
 	}
 
-	std::unique_ptr<ast::Expression> parseExpr(const ParseTreeNode& node) {
+	ast::Expression* parseExpr(const ParseTreeNode& node) {
 		if(node.is_type<syn::IfExpr>()) {
-			return std::make_unique<ast::IfExpression>(parseIfExpr(node));
-		} else if(node.is_type<syn::AddExpr>()) {
-			return parseOpExpr(node, ast::OpExpression::OpType::add);
-		} else if(node.is_type<syn::MultExpr>()) {
-			return parseOpExpr(node, ast::OpExpression::OpType::mult);
-		} else if(node.is_type<syn::SubExpr>()) {
-			return parseOpExpr(node, ast::OpExpression::OpType::sub);
-		} else if(node.is_type<syn::DivExpr>()) {
-			return parseOpExpr(node, ast::OpExpression::OpType::div);
+			return parseIfExpr(node);
+		} else if(node.is_type<syn::BinaryExpr>()) {
+			return parseBinaryExpr(node);
+		} else if(node.is_type<syn::PrimaryExpr>()) {
+			// only kept when negated
+			assert(node.children.size() == 2);
+			assert(node.children[0]->is_type<syn::Negate>());
+			return negate(parseExpr(*node.children[1]));
 		} else if(node.is_type<syn::TrueLiteral>()) {
-			auto ret = std::make_unique<ast::LiteralImpl<bool>>();
-			ret->value = true;
-			return ret;
+			return literal(true);
 		} else if(node.is_type<syn::FalseLiteral>()) {
-			auto ret = std::make_unique<ast::LiteralImpl<bool>>();
-			ret->value = false;
-			return ret;
+			return literal(false);
 		} else if(node.is_type<syn::SuffixedNumberLiteral>()) {
 			assert(node.children.size() == 2);
 			auto& value = node.children[0];
 			auto& suffix = node.children[1];
-
-			if(suffix->is_type<syn::SuffixF32OrEmpty>()) {
-				auto ret = std::make_unique<ast::LiteralImpl<ast::f32>>();
-				ret->value = std::stof(value->string());
-				return ret;
-			} else if(suffix->is_type<syn::SuffixF64>()) {
-				auto ret = std::make_unique<ast::LiteralImpl<ast::f64>>();
-				ret->value = std::stod(value->string());
-				return ret;
-			} else if(suffix->is_type<syn::SuffixI32>()) {
-				assert(!value->is_type<syn::FNumber>());
-				auto ret = std::make_unique<ast::LiteralImpl<ast::i32>>();
-				ret->value = std::stol(value->string());
-				return ret;
-			} else if(suffix->is_type<syn::SuffixU32>()) {
-				assert(!value->is_type<syn::FNumber>());
-				auto ret = std::make_unique<ast::LiteralImpl<ast::u32>>();
-				ret->value = std::stol(value->string());
-				return ret;
-			} else {
-				assert(!"Invalid suffix");
-			}
+			return numberLiteral(value->string_view(), suffix->string_view());
 		} else if(node.is_type<syn::IdentifierExpr>()) {
-			// TODO: update for Colon syntax
-			auto name = node.string_view();
-			auto& vars = decls_.vars.back();
-			auto it = vars.find(name);
-			if(it == vars.end()) {
-				assert(!"Invalid identifier");
-			}
-
-			auto ret = std::make_unique<ast::IdentifierExpression>();
-			ret->decl = it->second;
-			return ret;
+			return identifierExpr(ast::Symbol(node.string_view()));
 		} else if(node.is_type<syn::CodeBlock>()) {
 			return parseCodeBlock(node);
 		} else if(node.is_type<syn::MemberFunctionChain>()) {
 			assert(node.children.size() >= 1);
 			auto accessed = parseExpr(*node.children[0]);
-			auto children = std::span(node.children).subspan(1);
+			auto children = nytl::span(node.children).subspan(1);
 
 			for(auto& link : children) {
 				if(link->is_type<syn::MemberFunctionChainAccess>()) {
 					assert(link->children.size() == 1);
-					auto res = std::make_unique<ast::MemberAccess>();
-					res->accessed = std::move(accessed);
-
 					auto ident = parseIdentifier(*link->children[0]);
-
-					// TODO: modify for member functions
-					auto& type = res->accessed->type();
-					assert(type.category == ast::Type::Category::eStruct);
-					auto& sType = static_cast<const ast::StructType&>(type);
-					auto it = std::find_if(sType.members.begin(), sType.members.end(),
-						[&](auto& member) { return member.name == ident.name; });
-					if(it == sType.members.end()) {
-						assert(!"Struct {} does not have member {}");
-					}
-
-					res->accessor = &*it;
-					accessed = std::move(res);
+					accessed = memberAccess(accessed, ident);
 				} else if(link->is_type<syn::MemberFunctionChainCall>()) {
 					assert(link->children.size() == 1);
-					assert(link->children[0]->is_type<syn::FunctionArgsListP>());
-					auto call = std::make_unique<ast::FunctionCall>();
+					assert(link->children[0]->is_type<syn::FunctionArgsList>());
+					std::vector<ast::Expression*> args;
 					for(auto& arg : link->children[0]->children) {
-						call->arguments.emplace_back(parseExpr(*arg));
+						args.emplace_back(parseExpr(*arg));
 					}
 
-					call->called = findCallable(*accessed, call->arguments);
-					accessed = std::move(call);
+					accessed = functionCall(accessed, std::move(args));
 				}
 			}
 
@@ -184,13 +458,7 @@ class TreeBuilder {
 
 		// unkown expression type!
 		assert(!"Invalid expression type");
-	}
-
-	const ast::Callable* findCallable(const ast::Expression& expr,
-			std::span<const std::unique_ptr<ast::Expression>> params) {
-		// TODO
-		assert(!"TODO");
-		return nullptr;
+		return {};
 	}
 
 	ast::IfExpression::Branch parseBranch(const ParseTreeNode& node) {
@@ -202,27 +470,23 @@ class TreeBuilder {
 		return ret;
 	}
 
-	ast::IfExpression parseIfExpr(const ParseTreeNode& node) {
-		ast::IfExpression ret;
+	ast::IfExpression* parseIfExpr(const ParseTreeNode& node) {
+		auto ret = create<ast::IfExpression>();
 		assert(node.children.size() >= 2 && node.children.size() <= 3);
 		assert(node.is_type<syn::IfExpr>());
 
-		ret.ifBranch = parseBranch(*node.children[0]);
+		ret->ifBranch = parseBranch(*node.children[0]);
 		for(auto& elseif : node.children[1]->children) {
-			ret.elsifBranches.push_back(parseBranch(*elseif));
+			ret->elsifBranches.push_back(parseBranch(*elseif));
 		}
 
 		if(node.children.size() == 3) {
-			ret.elseBranch = parseCodeBlock(*node.children[2]);
+			ret->elseBranch = parseCodeBlock(*node.children[2]);
 		}
 
 		return ret;
 	}
 
-	const ast::Type& findType(const ParseTreeNode& node) {
-		// TODO
-	}
-
 	void addFunction(const ParseTreeNode& node) {
 		assert(node.children.size() == 4);
 		assert(node.children[0]->is_type<syn::Identifier>());
@@ -230,39 +494,44 @@ class TreeBuilder {
 		assert(node.children[2]->is_type<syn::FunctionParameterList>());
 		assert(node.children[3]->is_type<syn::CodeBlock>());
 
-		auto func = std::make_unique<ast::Function>();
+		auto func = create<ast::Function>();
 
-		func->retType = &findType(*node.children[0]);
-		func->ident.name = node.children[1]->string();
-		func->code = parseCodeBlock(*node.children[3]);
+		func->retType = &findType(ast::Symbol(node.children[0]->string_view()));
+		func->ident = parseIdentifier(*node.children[1]);
 
+		// the parameters are visible in the body
+		auto scope = decls_.vars.mark();
 		for(auto& child : node.children[2]->children) {
 			assert(child->children.size() == 2);
 			assert(child->children[0]->is_type<syn::Identifier>());
 			assert(child->children[1]->is_type<syn::Identifier>());
 
-			auto& param = func->params.emplace_back();
-			param.type = &findType(*child->children[0]);
-			param.ident.name = child->children[1]->string();
+			auto& type = findType(ast::Symbol(child->children[0]->string_view()));
+			auto name = parseIdentifier(*child->children[1]).name;
+			func->addParam(*declareVariable(name, type, nullptr));
 		}
 
-		module_.functions.emplace_back(std::move(func));
+		declareFunction(func);
+		func->code = parseCodeBlock(*node.children[3]);
+		decls_.vars.restore(scope);
+
+		BuilderBase::addFunction(func);
 	}
 
 	void addStruct(const ParseTreeNode& node) {
-		auto res = std::make_unique<ast::StructType>();
+		auto res = create<ast::StructType>();
 		res->category = ast::Type::Category::eStruct;
 
 		assert(!node.children.empty());
 		res->name = parseIdentifier(*node.children[0]).name;
-		auto children = std::span(node.children).subspan(1);
+		auto children = nytl::span(node.children).subspan(1);
 
 		for(auto& cmember : children) {
 			assert(cmember->is_type<syn::StructMember>());
 			assert(cmember->children.size() == 2 || cmember->children.size() == 3);
 
 			auto& member = res->members.emplace_back();
-			member.type = &findType(*cmember->children[0]);
+			member.type = &findType(ast::Symbol(cmember->children[0]->string_view()));
 			member.name = parseIdentifier(*cmember->children[1]);
 
 			if(cmember->children.size() == 3) {
@@ -270,12 +539,10 @@ class TreeBuilder {
 			}
 		}
 
-		auto nv = std::string_view(res->name);
-		auto [_, success] = decls_.types.back().emplace(nv, std::move(res));
-		assert(success && "Type with name {} already known");
+		BuilderBase::addStruct(res);
 	}
 
-	void addEnum(const ParseTreeNode& node) {
+	void addEnum(const ParseTreeNode&) {
 	}
 
 	void parseModule(const ParseTreeNode& module) {
@@ -291,4 +558,4 @@ class TreeBuilder {
 	}
 };
 
-} // namespace ast
+} // namespace builder
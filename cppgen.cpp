@@ -0,0 +1,666 @@
+#include "cppgen.hpp"
+#include "fold.hpp"
+#include "types.hpp"
+
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ast::cpp {
+
+namespace {
+
+using BT = BuiltinType::Type;
+
+// C++ keywords and names the generated code uses itself
+constexpr std::string_view reserved[] = {
+	"alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+	"bitor", "bool", "break", "case", "catch", "char", "char16_t",
+	"char32_t", "class", "compl", "const", "constexpr", "const_cast",
+	"continue", "decltype", "default", "delete", "do", "double",
+	"dynamic_cast", "else", "enum", "explicit", "export", "extern",
+	"false", "float", "for", "friend", "goto", "if", "inline", "int",
+	"long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+	"nullptr", "operator", "or", "or_eq", "private", "protected",
+	"public", "register", "reinterpret_cast", "return", "short",
+	"signed", "sizeof", "static", "static_assert", "static_cast",
+	"struct", "switch", "template", "this", "thread_local", "throw",
+	"true", "try", "typedef", "typeid", "typename", "union", "unsigned",
+	"using", "virtual", "void", "volatile", "wchar_t", "while", "xor",
+	"xor_eq", "isl", "std",
+};
+
+// Name in the generated code, reserved names get a trailing underscore
+std::string identifier(std::string_view name) {
+	std::string ret(name);
+	for(auto word : reserved) {
+		if(word == name) {
+			ret += '_';
+			break;
+		}
+	}
+
+	return ret;
+}
+
+// Module names come from file names, they aren't always identifiers
+std::string namespaceName(const Module& mod) {
+	auto ret = std::string(mod.name.str());
+	for(auto& c : ret) {
+		if(!std::isalnum(static_cast<unsigned char>(c))) {
+			c = '_';
+		}
+	}
+
+	if(ret.empty() || std::isdigit(static_cast<unsigned char>(ret[0]))) {
+		ret = "module_" + ret;
+	}
+
+	return identifier(ret);
+}
+
+bool isVoid(const Type& type) {
+	return &type == &BuiltinType::voidType();
+}
+
+// Whether the value of the expression can be undefined, i.e. it ends
+// in an if without else. C++ needs a return in that case.
+bool mayFallThrough(const Expression* e) {
+	if(auto* block = dynamic_cast<const CodeBlock*>(e)) {
+		return mayFallThrough(block->ret);
+	}
+
+	auto* ifExpr = dynamic_cast<const IfExpression*>(e);
+	if(!ifExpr) {
+		return !e;
+	}
+
+	if(!ifExpr->elseBranch || mayFallThrough(ifExpr->elseBranch) ||
+			mayFallThrough(ifExpr->ifBranch.code)) {
+		return true;
+	}
+
+	for(auto& b : ifExpr->elsifBranches) {
+		if(mayFallThrough(b.code)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::string typeString(const Type& type) {
+	switch(type.category) {
+		case Type::Category::primitive: {
+			auto& bt = static_cast<const BuiltinType&>(type);
+			if(bt.type == BT::eVoid) {
+				return "void";
+			} else if(bt.type == BT::eBool && bt.rows == 1 && bt.cols == 1) {
+				return "bool";
+			}
+			return "isl::" + std::string(typeName(type));
+		}
+		case Type::Category::eStruct:
+			return identifier(typeName(type));
+		case Type::Category::eEnum:
+			assert(!"Enums can't be emitted yet");
+			return {};
+		default:
+			assert(!"Function types have no values");
+			return {};
+	}
+}
+
+std::string_view opFunction(OpType op) {
+	switch(op) {
+		case OpType::add: return "isl::add";
+		case OpType::mult: return "isl::mul";
+		case OpType::sub: return "isl::sub";
+		case OpType::div: return "isl::div";
+		case OpType::mod: return "isl::mod";
+		case OpType::eq: return "isl::eq";
+		case OpType::neq: return "isl::neq";
+		case OpType::less: return "isl::less";
+		case OpType::lessEq: return "isl::lessEq";
+		case OpType::greater: return "isl::greater";
+		case OpType::greaterEq: return "isl::greaterEq";
+		case OpType::bitAnd: return "isl::bitAnd";
+		case OpType::bitOr: return "isl::bitOr";
+		case OpType::bitXor: return "isl::bitXor";
+		case OpType::shiftLeft: return "isl::shiftLeft";
+		case OpType::shiftRight: return "isl::shiftRight";
+		case OpType::neg: return "isl::neg";
+		default:
+			assert(!"Logical operators have no function");
+			return {};
+	}
+}
+
+// Shortest representation that reads back as the same value
+template<typename T>
+void writeFloat(Printer& p, T value, std::string_view type, std::string_view suffix) {
+	if(std::isnan(value)) {
+		p << "std::numeric_limits<" << type << ">::quiet_NaN()";
+		return;
+	} else if(std::isinf(value)) {
+		p << (value < 0 ? "-" : "") << "std::numeric_limits<" << type << ">::infinity()";
+		return;
+	}
+
+	char buf[64];
+	auto res = std::to_chars(buf, buf + sizeof(buf), value);
+	assert(res.ec == std::errc{});
+	auto str = std::string_view(buf, std::size_t(res.ptr - buf));
+	if(value < 0) {
+		p << "(";
+	}
+
+	p << str;
+	if(str.find_first_of(".e") == str.npos) {
+		p << ".0";
+	}
+
+	p << suffix;
+	if(value < 0) {
+		p << ")";
+	}
+}
+
+void writeLiteral(Printer& p, const Constant& value) {
+	auto& v = value.values[0];
+	switch(value.type->type) {
+		case BT::f32: writeFloat(p, v.f, "isl::f32", "f"); break;
+		case BT::f64: writeFloat(p, v.d, "isl::f64", ""); break;
+		case BT::u32: p << v.u << "u"; break;
+		case BT::eBool: p << (v.b ? "true" : "false"); break;
+		case BT::i32:
+			if(v.i == std::numeric_limits<i32>::min()) {
+				// the literal 2147483648 would be out of range
+				p << "(-2147483647 - 1)";
+			} else if(v.i < 0) {
+				p << "(" << v.i << ")";
+			} else {
+				p << v.i;
+			}
+			break;
+		default:
+			assert(!"Invalid literal type");
+	}
+}
+
+class Generator {
+public:
+	Generator(const Module& mod, Printer& p) : mod_(mod), p_(p) {}
+	void module();
+
+private:
+	// Where the value of a tail expression goes
+	struct Sink {
+		enum class Kind {
+			discard,
+			ret,
+			assign,
+		};
+
+		Kind kind;
+		const Type* type {}; // the value is converted to it
+		std::string_view var {}; // for assign
+	};
+
+	void structType(const StructType& type);
+	void signature(const Function& func, bool names);
+	void function(const Function& func);
+
+	// Statements start on a new line
+	void statement(const Statement& stmt);
+	void body(const CodeBlock& block, const Sink& sink);
+	void tail(const Expression& expr, const Sink& sink);
+
+	void expr(const Expression& expr);
+	void value(const Expression& expr, const Type& type);
+	void op(const OpExpression& expr);
+	void lambda(const Expression& expr);
+
+	// Writes the expression with write(), converted to the given type
+	template<typename F>
+	void convert(const Expression& expr, const Type& type, F&& write);
+
+	// Calls write with a function that writes operand i. C++ doesn't
+	// specify the order in which function arguments are evaluated, so
+	// all operands up to the last one that assigns variables are read
+	// into temporaries first, in order, like the vm does.
+	template<typename F>
+	void sequenced(const Expression& expr,
+		const std::vector<Expression*>& operands, F&& write);
+
+	// Unique in the current function
+	const std::string& name(const VariableDeclaration& decl);
+	std::string temp();
+
+	const Module& mod_;
+	Printer& p_;
+	std::unordered_set<std::string> globals_; // functions and types
+	std::unordered_set<std::string> locals_; // of the current function
+	std::unordered_map<const VariableDeclaration*, std::string> names_;
+	std::unordered_set<const Expression*> assigning_;
+	// namespace of the module each imported function comes from
+	std::unordered_map<const Callable*, std::string> imported_;
+};
+
+void Generator::module() {
+	for(auto* type : mod_.types) {
+		globals_.insert(typeString(*type));
+	}
+
+	for(auto* func : mod_.functions) {
+		globals_.insert(identifier(func->name()));
+	}
+
+	auto ns = namespaceName(mod_);
+	p_ << "// Generated from the isl module '" << mod_.name.str() << "'";
+	p_.newline();
+	p_ << "#pragma once";
+	p_.newline();
+	p_.newline();
+	p_ << "#include \"islmath.hpp\"";
+
+	for(auto* imp : mod_.imports) {
+		p_.newline();
+		p_ << "#include \"" << imp->name.str() << ".hpp\"";
+		for(auto* func : imp->functions) {
+			imported_[func] = namespaceName(*imp);
+		}
+	}
+
+	p_.newline();
+	p_.newline();
+	p_ << "namespace " << ns << " {";
+	p_.newline();
+
+	// for the types, calls of imported functions are qualified since
+	// local functions with the same name would hide them
+	for(auto* imp : mod_.imports) {
+		p_.newline();
+		p_ << "using namespace " << namespaceName(*imp) << ";";
+	}
+
+	for(auto* type : mod_.types) {
+		// the builder doesn't create enums yet
+		assert(type->category == Type::Category::eStruct && "Enums can't be emitted yet");
+		p_.newline();
+		structType(static_cast<const StructType&>(*type));
+		p_.newline();
+	}
+
+	// declared first, they may call each other in any order
+	if(!mod_.functions.empty()) {
+		p_.newline();
+		for(auto* func : mod_.functions) {
+			signature(*func, false);
+			p_ << ";";
+			p_.newline();
+		}
+	}
+
+	for(auto* func : mod_.functions) {
+		p_.newline();
+		function(*func);
+		p_.newline();
+	}
+
+	p_.newline();
+	p_ << "} // namespace " << ns;
+	p_.newline();
+}
+
+void Generator::structType(const StructType& type) {
+	p_ << "struct " << typeString(type) << " {";
+	p_.indent();
+	for(auto& member : type.members) {
+		p_.newline();
+		p_ << typeString(*member.type) << " " << identifier(member.name.name.str());
+		if(member.init) {
+			p_ << " = ";
+			value(*member.init, *member.type);
+		} else {
+			p_ << " {}";
+		}
+		p_ << ";";
+	}
+	p_.unindent();
+	p_.newline();
+	p_ << "};";
+}
+
+void Generator::signature(const Function& func, bool names) {
+	p_ << "inline " << typeString(func.returnType()) << " " <<
+		identifier(func.name()) << "(";
+	for(auto i = 0u; i < func.params.size(); ++i) {
+		p_ << (i ? ", " : "") << typeString(*func.paramTypes[i]);
+		if(names) {
+			p_ << " " << name(*func.params[i]);
+		}
+	}
+	p_ << ")";
+}
+
+void Generator::function(const Function& func) {
+	locals_.clear();
+	names_.clear();
+	assigning_.clear();
+	if(func.code) {
+		markAssigning(*func.code, assigning_);
+	}
+
+	signature(func, true);
+	p_ << " {";
+	p_.indent();
+	if(func.code) {
+		body(*func.code, {Sink::Kind::ret, &func.returnType()});
+		if(!isVoid(func.returnType()) && mayFallThrough(func.code)) {
+			p_.newline();
+			p_ << "return {};";
+		}
+	}
+	p_.unindent();
+	p_.newline();
+	p_ << "}";
+}
+
+void Generator::statement(const Statement& stmt) {
+	if(auto* decl = dynamic_cast<const DeclarationStatement*>(&stmt)) {
+		auto& var = *decl->decl;
+		auto& varName = name(var);
+		p_.newline();
+		p_ << typeString(*var.type) << " " << varName;
+
+		// block and if values are assigned in their branches
+		auto& init = *var.init;
+		if(dynamic_cast<const CodeBlock*>(&init) ||
+				dynamic_cast<const IfExpression*>(&init)) {
+			p_ << " {};";
+			tail(init, {Sink::Kind::assign, var.type, varName});
+		} else {
+			p_ << " = ";
+			value(init, *var.type);
+			p_ << ";";
+		}
+	} else if(auto* assign = dynamic_cast<const AssignStatement*>(&stmt)) {
+		p_.newline();
+		expr(*assign->left());
+		p_ << " = ";
+		value(*assign->right(), typeOf(*assign->left()));
+		p_ << ";";
+	} else if(auto* exprStmt = dynamic_cast<const ExpressionStatement*>(&stmt)) {
+		tail(*exprStmt->expr, {Sink::Kind::discard});
+	} else {
+		assert(!"Invalid statement");
+	}
+}
+
+void Generator::body(const CodeBlock& block, const Sink& sink) {
+	for(auto* stmt : block.statements) {
+		statement(*stmt);
+	}
+
+	if(block.ret) {
+		tail(*block.ret, sink);
+	}
+}
+
+void Generator::tail(const Expression& e, const Sink& sink) {
+	if(auto* block = dynamic_cast<const CodeBlock*>(&e)) {
+		p_.newline();
+		p_ << "{";
+		p_.indent();
+		body(*block, sink);
+		p_.unindent();
+		p_.newline();
+		p_ << "}";
+		return;
+	}
+
+	if(auto* ifExpr = dynamic_cast<const IfExpression*>(&e)) {
+		auto branch = [&](const IfExpression::Branch& b) {
+			p_ << "if(";
+			expr(*b.condition);
+			p_ << ") {";
+			p_.indent();
+			body(*b.code, sink);
+			p_.unindent();
+			p_.newline();
+			p_ << "}";
+		};
+
+		p_.newline();
+		branch(ifExpr->ifBranch);
+		for(auto& b : ifExpr->elsifBranches) {
+			p_ << " else ";
+			branch(b);
+		}
+
+		if(ifExpr->elseBranch) {
+			p_ << " else {";
+			p_.indent();
+			body(*ifExpr->elseBranch, sink);
+			p_.unindent();
+			p_.newline();
+			p_ << "}";
+		}
+		return;
+	}
+
+	p_.newline();
+	if(sink.kind == Sink::Kind::discard || isVoid(typeOf(e))) {
+		if(!dynamic_cast<const FunctionCall*>(&e)) {
+			p_ << "(void) ";
+		}
+		expr(e);
+	} else if(sink.kind == Sink::Kind::ret) {
+		p_ << "return ";
+		value(e, *sink.type);
+	} else {
+		p_ << sink.var << " = ";
+		value(e, *sink.type);
+	}
+	p_ << ";";
+}
+
+void Generator::expr(const Expression& e) {
+	if(auto* lit = dynamic_cast<const Literal*>(&e)) {
+		writeLiteral(p_, constant(*lit));
+	} else if(auto* id = dynamic_cast<const IdentifierExpression*>(&e)) {
+		p_ << name(*id->decl);
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+		expr(*access->accessed);
+		p_ << "." << identifier(access->accessor->name.name.str());
+	} else if(auto* call = dynamic_cast<const FunctionCall*>(&e)) {
+		auto params = call->called->parameters();
+		assert(params.size() == call->arguments.size());
+		sequenced(e, call->arguments, [&](auto&& operand) {
+			auto imp = imported_.find(call->called);
+			if(imp != imported_.end()) {
+				p_ << "::" << imp->second << "::";
+			}
+
+			p_ << identifier(call->called->name()) << "(";
+			for(auto i = 0u; i < call->arguments.size(); ++i) {
+				p_ << (i ? ", " : "");
+				convert(*call->arguments[i], *params[i], [&]{ operand(i); });
+			}
+			p_ << ")";
+		});
+	} else if(auto* opExpr = dynamic_cast<const OpExpression*>(&e)) {
+		op(*opExpr);
+	} else if(dynamic_cast<const CodeBlock*>(&e) ||
+			dynamic_cast<const IfExpression*>(&e)) {
+		lambda(e);
+	} else {
+		assert(!"Invalid expression");
+	}
+}
+
+void Generator::value(const Expression& e, const Type& type) {
+	convert(e, type, [&]{ expr(e); });
+}
+
+template<typename F>
+void Generator::convert(const Expression& e, const Type& type, F&& write) {
+	// scalars are broadcast to vectors and matrices
+	if(&typeOf(e) != &type && !isVoid(type)) {
+		p_ << typeString(type) << "(";
+		write();
+		p_ << ")";
+		return;
+	}
+
+	write();
+}
+
+template<typename F>
+void Generator::sequenced(const Expression& e,
+		const std::vector<Expression*>& operands, F&& write) {
+	auto count = 0u; // operands read into temporaries
+	for(auto i = 0u; i < operands.size(); ++i) {
+		if(assigning_.count(operands[i])) {
+			count = i + 1;
+		}
+	}
+
+	std::vector<std::string> temps;
+	if(count) {
+		p_ << "[&]() -> " << typeString(typeOf(e)) << " {";
+		p_.indent();
+		for(auto i = 0u; i < count; ++i) {
+			temps.push_back(temp());
+			p_.newline();
+			p_ << "const auto " << temps.back() << " = ";
+			expr(*operands[i]);
+			p_ << ";";
+		}
+		p_.newline();
+		p_ << "return ";
+	}
+
+	write([&](unsigned i) {
+		if(i < temps.size()) {
+			p_ << temps[i];
+		} else {
+			expr(*operands[i]);
+		}
+	});
+
+	if(count) {
+		p_ << ";";
+		p_.unindent();
+		p_.newline();
+		p_ << "}()";
+	}
+}
+
+void Generator::op(const OpExpression& e) {
+	auto& children = e.children;
+	if(e.opType == OpType::logicalAnd || e.opType == OpType::logicalOr) {
+		auto sop = (e.opType == OpType::logicalAnd) ? " && " : " || ";
+		p_ << "(";
+		for(auto i = 0u; i < children.size(); ++i) {
+			p_ << (i ? sop : "");
+			expr(*children[i]);
+		}
+		p_ << ")";
+		return;
+	}
+
+	if(e.opType == OpType::neg) {
+		assert(children.size() == 1u);
+		p_ << opFunction(e.opType) << "(";
+		expr(*children[0]);
+		p_ << ")";
+		return;
+	}
+
+	// left associative: f(f(a, b), c)
+	assert(children.size() >= 2u);
+	sequenced(e, children, [&](auto&& operand) {
+		for(auto i = 1u; i < children.size(); ++i) {
+			p_ << opFunction(e.opType) << "(";
+		}
+
+		operand(0u);
+		for(auto i = 1u; i < children.size(); ++i) {
+			p_ << ", ";
+			operand(i);
+			p_ << ")";
+		}
+	});
+}
+
+void Generator::lambda(const Expression& e) {
+	auto& type = typeOf(e);
+	p_ << "[&]()";
+	if(!isVoid(type)) {
+		p_ << " -> " << typeString(type);
+	}
+
+	p_ << " {";
+	p_.indent();
+	Sink sink {Sink::Kind::ret, &type};
+	if(auto* block = dynamic_cast<const CodeBlock*>(&e)) {
+		body(*block, sink);
+	} else {
+		tail(e, sink);
+	}
+
+	// if without else, the value is undefined when no branch is taken
+	if(!isVoid(type) && mayFallThrough(&e)) {
+		p_.newline();
+		p_ << "return {};";
+	}
+	p_.unindent();
+	p_.newline();
+	p_ << "}()";
+}
+
+const std::string& Generator::name(const VariableDeclaration& decl) {
+	auto it = names_.find(&decl);
+	if(it != names_.end()) {
+		return it->second;
+	}
+
+	auto base = identifier(decl.name.name.str());
+	auto unique = base;
+	for(auto i = 1u; globals_.count(unique) || locals_.count(unique); ++i) {
+		unique = base + "_" + std::to_string(i);
+	}
+
+	locals_.insert(unique);
+	return names_.emplace(&decl, std::move(unique)).first->second;
+}
+
+std::string Generator::temp() {
+	std::string ret;
+	for(auto i = locals_.size(); ret.empty() || locals_.count(ret); ++i) {
+		ret = "tmp_" + std::to_string(i);
+	}
+
+	locals_.insert(ret);
+	return ret;
+}
+
+} // anon namespace
+
+void write(const Module& mod, Printer& p) {
+	Generator(mod, p).module();
+}
+
+std::string generate(const Module& mod) {
+	Printer printer;
+	write(mod, printer);
+	return printer.take();
+}
+
+} // namespace ast::cpp
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <string>
+
+// Emits C++17 source for a module, so that isl code can be compiled
+// into host programs with the host compiler.
+// The output is a self-contained header: all structs and
+// functions of the module in a namespace named after it. Builtin
+// vectors and matrices map to the types of islmath.hpp and operators
+// to its functions, which have the semantics of the vm. Imported
+// modules are expected in '<name>.hpp' next to it.
+// Block and if expressions used as values become immediately invoked
+// lambdas, everywhere else they are emitted as statements.
+// Enums can't be emitted yet, the builder doesn't create them.
+namespace ast::cpp {
+
+void write(const Module& mod, Printer& p);
+std::string generate(const Module& mod);
+
+} // namespace ast::cpp
@@ -0,0 +1,205 @@
+#include "driver.hpp"
+#include "actions.hpp"
+#include "errors.hpp"
+#include "lexer.hpp"
+
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace driver {
+
+namespace {
+
+template<typename Rule> struct ScanAction : pegtl::nothing<Rule> {};
+template<> struct ScanAction<syn::ImportName> {
+	template<typename ActionInput>
+	static void apply(const ActionInput& in, std::vector<ast::Symbol>& names) {
+		names.emplace_back(in.string_view());
+	}
+};
+
+// Module name for the given path, e.g. "shaders/light.isl" -> "light"
+std::string_view moduleName(std::string_view path) {
+	auto slash = path.find_last_of('/');
+	if(slash != path.npos) {
+		path = path.substr(slash + 1);
+	}
+
+	return path.substr(0, path.find_last_of('.'));
+}
+
+std::string errorString(const pegtl::parse_error& error) {
+	auto& pos = error.positions()[0];
+	return pos.source + ":" + std::to_string(pos.line) + ":" +
+		std::to_string(pos.column) + ": " + error.message();
+}
+
+// Whether the unit imports itself through units that weren't built
+bool onCycle(const Compiler::Unit& unit) {
+	std::vector<const Compiler::Unit*> stack {&unit};
+	std::unordered_set<const Compiler::Unit*> seen;
+	while(!stack.empty()) {
+		auto* current = stack.back();
+		stack.pop_back();
+		for(auto* imp : current->imports) {
+			if(imp == &unit) {
+				return true;
+			}
+
+			if(!imp->done && seen.insert(imp).second) {
+				stack.push_back(imp);
+			}
+		}
+	}
+
+	return false;
+}
+
+std::string importFailed(const Compiler::Unit& unit, const Compiler::Unit& imp) {
+	return unit.path + ": Imports " + imp.path + ", which failed";
+}
+
+} // anon namespace
+
+Compiler::Compiler(unsigned threadCount) : pool_(threadCount) {
+}
+
+bool Compiler::compile(const std::vector<std::string>& paths) {
+	units_.clear();
+	for(auto& path : paths) {
+		auto& unit = *units_.emplace_back(std::make_unique<Unit>());
+		unit.path = path;
+		unit.name = ast::Symbol(moduleName(path));
+		pool_.add([this, &unit]{ scan(unit); });
+	}
+
+	pool_.wait();
+	resolve();
+
+	// Collect the roots first, building them already schedules dependents
+	std::vector<Unit*> roots;
+	for(auto& unit : units_) {
+		if(!unit->done && unit->pendingImports == 0u) {
+			roots.push_back(unit.get());
+		}
+	}
+
+	for(auto* unit : roots) {
+		pool_.add([this, unit]{ build(*unit); });
+	}
+
+	pool_.wait();
+
+	// Units that weren't built are on an import cycle or import
+	// one of them
+	for(auto& unit : units_) {
+		if(unit->done) {
+			continue;
+		}
+
+		if(onCycle(*unit)) {
+			unit->error = unit->path + ": Import cycle";
+			continue;
+		}
+
+		for(auto* imp : unit->imports) {
+			if(!imp->done) {
+				unit->error = importFailed(*unit, *imp);
+				break;
+			}
+		}
+	}
+
+	auto success = true;
+	for(auto& unit : units_) {
+		success &= unit->error.empty();
+	}
+
+	return success;
+}
+
+// Only parses the imports at the start of the file.
+void Compiler::scan(Unit& unit) {
+	try {
+		unit.source = ast::SourceFile(unit.path);
+		auto text = unit.source.text();
+		pegtl::memory_input<> in(text.data(), text.data() + text.size(), unit.path);
+		pegtl::parse<syn::ImportScan, ScanAction>(in, unit.importNames);
+	} catch(const std::system_error& err) {
+		unit.error = err.what();
+		unit.done = true;
+	}
+}
+
+// Builds the dependency graph. Units that can't be built are
+// marked done, their dependents still wait for them.
+void Compiler::resolve() {
+	std::unordered_map<ast::Symbol, Unit*> byName;
+	for(auto& unit : units_) {
+		auto [it, success] = byName.emplace(unit->name, unit.get());
+		if(!success && unit->error.empty()) {
+			unit->error = unit->path + ": Module name already used by " + it->second->path;
+			unit->done = true;
+		}
+	}
+
+	for(auto& unit : units_) {
+		for(auto name : unit->importNames) {
+			auto it = byName.find(name);
+			if(it == byName.end()) {
+				if(unit->error.empty()) {
+					unit->error = unit->path + ": Unknown module '" + std::string(name.str()) + "'";
+				}
+
+				continue;
+			}
+
+			unit->imports.push_back(it->second);
+			if(!it->second->done) {
+				it->second->dependents.push_back(unit.get());
+				++unit->pendingImports;
+			}
+		}
+	}
+}
+
+void Compiler::build(Unit& unit) {
+	for(auto* imp : unit.imports) {
+		if(!imp->module && unit.error.empty()) {
+			unit.error = importFailed(unit, *imp);
+		}
+	}
+
+	if(unit.error.empty()) {
+		builder::ActionBuilder builder;
+		auto& mod = builder.module();
+		mod.source = std::move(unit.source);
+		mod.name = unit.name;
+		for(auto* imp : unit.imports) {
+			builder.importModule(*imp->module);
+		}
+
+		try {
+			lex::TokenInput in(mod.source.text(), unit.path);
+			pegtl::parse<syn::Grammar, builder::Action,
+				builder::ActionControl<syn::Control>::type>(in, builder);
+			unit.module = std::make_unique<ast::Module>(std::move(mod));
+		} catch(const pegtl::parse_error& error) {
+			unit.error = errorString(error);
+		}
+	}
+
+	unit.done = true;
+
+	// The last import to finish schedules the dependent, the atomic
+	// decrement makes sure this unit is visible to it.
+	for(auto* dep : unit.dependents) {
+		if(dep->pendingImports.fetch_sub(1u, std::memory_order_acq_rel) == 1u) {
+			pool_.add([this, dep]{ build(*dep); });
+		}
+	}
+}
+
+} // namespace driver
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ast.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace driver {
+
+// Compiles a set of module files in parallel.
+// The imports of all files are scanned first, an import refers to the
+// module file with that name (without directory and extension) among
+// the given files. Modules are then built on a thread pool, each one
+// as soon as all modules it imports are built.
+class Compiler {
+public:
+	struct Unit {
+		std::string path;
+		ast::Symbol name;
+		ast::SourceFile source; // moved into the module when building
+
+		std::vector<ast::Symbol> importNames;
+		std::vector<Unit*> imports;
+		std::vector<Unit*> dependents;
+		std::atomic<unsigned> pendingImports {};
+
+		std::unique_ptr<ast::Module> module; // set when built successfully
+		std::string error; // set when something failed
+		bool done {};
+	};
+
+	explicit Compiler(unsigned threadCount = std::thread::hardware_concurrency());
+
+	// Returns whether all modules were built successfully, otherwise
+	// the failed units have an error set.
+	bool compile(const std::vector<std::string>& paths);
+
+	const std::vector<std::unique_ptr<Unit>>& units() const { return units_; }
+
+private:
+	void scan(Unit& unit);
+	void resolve();
+	void build(Unit& unit);
+
+	ThreadPool pool_;
+	std::vector<std::unique_ptr<Unit>> units_;
+};
+
+} // namespace driver
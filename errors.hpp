@@ -0,0 +1,39 @@
+#pragma once
+
+#include "syntax.hpp"
+
+// Messages for the errors raised by the must/if_must rules of the
+// grammar. Parse with Control (or a control based on it) to get them.
+namespace syn {
+
+template<typename> inline constexpr const char* error_message = nullptr;
+template<> inline constexpr const char* error_message<BinaryOperand> = "Expected expression after binary operator";
+template<> inline constexpr const char* error_message<ParanthExprClose> = "Closing ')' after expression is missing";
+template<> inline constexpr const char* error_message<CodeBlockClose> = "Closing '}' after code block is missing";
+template<> inline constexpr const char* error_message<Eof> = "Expected end of file";
+template<> inline constexpr const char* error_message<Module> = "Expected module"; // can't fail I guess?
+template<> inline constexpr const char* error_message<Branch> = "Expected branch (condition and codeblock)";
+template<> inline constexpr const char* error_message<ElseCodeBlock> = "Expected codeblock after 'else'";
+template<> inline constexpr const char* error_message<Expr> = "Expected expression";
+template<> inline constexpr const char* error_message<AssignValue> = "Expected expression after '='";
+template<> inline constexpr const char* error_message<VariableInit> = "Expected variable initializer after '='";
+template<> inline constexpr const char* error_message<VariableDeclEnd> = "Expected ';' after variable declaration";
+template<> inline constexpr const char* error_message<MemberAccess> = "Expected member-access expression after '.'";
+template<> inline constexpr const char* error_message<Identifier> = "Expected identifier";
+template<> inline constexpr const char* error_message<FunctionArgsListClose> = "Expected ')' to close function arguments list";
+
+template<> inline constexpr const char* error_message<FunctionArgsList> = "Expected expression as function parameter"; // can't fail i guess?
+template<> inline constexpr const char* error_message<CodeBlockStatements> = "Expected statement"; // can't fail I guess?
+template<> inline constexpr const char* error_message<OptCodeBlockReturn> = "Expected (optional) code block return"; // can't fail I guess?
+template<> inline constexpr const char* error_message<Seps> = "Unexpected parser error: Expected separator"; // can't fail I guess?
+
+struct error {
+	template<typename Rule> static constexpr auto message = error_message<Rule>;
+
+	// template<typename Rule> static constexpr auto message =
+	// 	error_message<Rule> ? error_message<Rule> : tao::demangle<Rule>().data();
+};
+
+template<typename Rule> using Control = pegtl::must_if<error>::control<Rule>;
+
+} // namespace syn
@@ -0,0 +1,366 @@
+#include "flat.hpp"
+#include <cassert>
+
+namespace ast::flat {
+
+namespace {
+
+// Appends the visited node to the tree, children first.
+class Flattener : public Visitor {
+public:
+	explicit Flattener(Tree& tree) : tree_(tree) {}
+
+	NodeId flatten(Node& node) {
+		result_ = invalidNode;
+		node.visit(*this);
+		assert(result_ != invalidNode && "Unknown node type");
+		return result_;
+	}
+
+	void visit(Node&) override {}
+
+	void visit(Literal& e) override {
+		auto& type = static_cast<const BuiltinType&>(e.type());
+		LiteralValue lit {type.type, 0.0};
+		switch(type.type) {
+			case BuiltinType::Type::f32:
+				lit.value = static_cast<LiteralImpl<f32>&>(e).value; break;
+			case BuiltinType::Type::f64:
+				lit.value = static_cast<LiteralImpl<f64>&>(e).value; break;
+			case BuiltinType::Type::i32:
+				lit.value = static_cast<LiteralImpl<i32>&>(e).value; break;
+			case BuiltinType::Type::u32:
+				lit.value = static_cast<LiteralImpl<u32>&>(e).value; break;
+			case BuiltinType::Type::eBool:
+				lit.value = static_cast<LiteralImpl<bool>&>(e).value; break;
+			default:
+				assert(!"Invalid literal type");
+		}
+
+		auto index = std::uint32_t(tree_.literals.size());
+		tree_.literals.push_back(lit);
+		result_ = tree_.add(Kind::literal, index, {}, &type);
+	}
+
+	void visit(IdentifierExpression& e) override {
+		auto index = std::uint32_t(tree_.variables.size());
+		tree_.variables.push_back(e.decl);
+		result_ = tree_.add(Kind::identifier, index, {}, e.decl->type);
+	}
+
+	void visit(MemberAccess& e) override {
+		NodeId accessed = flatten(*e.accessed);
+		auto index = std::uint32_t(tree_.members.size());
+		tree_.members.push_back(e.accessor);
+		result_ = tree_.add(Kind::memberAccess, index, {&accessed, 1u},
+			e.accessor->type);
+	}
+
+	void visit(FunctionCall& e) override {
+		auto args = flattenAll(e.arguments);
+		auto index = std::uint32_t(tree_.callables.size());
+		tree_.callables.push_back(e.called);
+		result_ = tree_.add(Kind::functionCall, index, args, &e.called->returnType());
+	}
+
+	void visit(OpExpression& e) override {
+		auto ops = flattenAll(e.children);
+		result_ = tree_.add(Kind::op, std::uint32_t(e.opType), ops, e.ptype);
+	}
+
+	void visit(IfExpression& e) override {
+		std::vector<NodeId> ids;
+		ids.push_back(flatten(*e.ifBranch.condition));
+		ids.push_back(flatten(*e.ifBranch.code));
+		for(auto& b : e.elsifBranches) {
+			ids.push_back(flatten(*b.condition));
+			ids.push_back(flatten(*b.code));
+		}
+
+		if(e.elseBranch) {
+			ids.push_back(flatten(*e.elseBranch));
+		}
+
+		result_ = tree_.add(Kind::ifExpr, e.elseBranch ? 1u : 0u, ids, e.ptype);
+	}
+
+	void visit(CodeBlock& e) override {
+		auto ids = flattenAll(e.statements);
+		if(e.ret) {
+			ids.push_back(flatten(*e.ret));
+		}
+
+		auto type = e.ret ? tree_.types[ids.back()] : &BuiltinType::voidType();
+		result_ = tree_.add(Kind::codeBlock, e.ret ? 1u : 0u, ids, type);
+	}
+
+	void visit(ExpressionStatement& s) override {
+		NodeId expr = flatten(*s.expr);
+		result_ = tree_.add(Kind::exprStatement, 0u, {&expr, 1u});
+	}
+
+	void visit(DeclarationStatement& s) override {
+		NodeId init = flatten(*s.decl->init);
+		auto index = std::uint32_t(tree_.variables.size());
+		tree_.variables.push_back(s.decl);
+		result_ = tree_.add(Kind::declStatement, index, {&init, 1u});
+	}
+
+	void visit(AssignStatement& s) override {
+		NodeId ids[] = {flatten(*s.left()), flatten(*s.right())};
+		result_ = tree_.add(Kind::assignStatement, 0u, ids);
+	}
+
+private:
+	template<typename T>
+	std::vector<NodeId> flattenAll(const std::vector<T*>& nodes) {
+		std::vector<NodeId> ids;
+		ids.reserve(nodes.size());
+		for(auto* node : nodes) {
+			ids.push_back(flatten(*node));
+		}
+		return ids;
+	}
+
+	Tree& tree_;
+	NodeId result_ {invalidNode};
+};
+
+} // anon namespace
+
+NodeId flatten(Tree& tree, Expression& expr) {
+	return Flattener(tree).flatten(expr);
+}
+
+Tree flatten(const Module& mod) {
+	Tree tree;
+	Flattener flattener(tree);
+	for(auto* func : mod.functions) {
+		auto body = func->code ? flattener.flatten(*func->code) : invalidNode;
+		tree.functions.push_back({func, body});
+	}
+
+	return tree;
+}
+
+void write(const Tree& tree, NodeId id, Printer& p) {
+	auto children = tree.childrenOf(id);
+	auto data = tree.data[id];
+	switch(tree.kinds[id]) {
+		case Kind::literal: {
+			auto& lit = tree.literals[data];
+			switch(lit.type) {
+				case BuiltinType::Type::f32: p << f32(lit.value); break;
+				case BuiltinType::Type::f64: p << lit.value; break;
+				case BuiltinType::Type::i32: p << i32(lit.value); break;
+				case BuiltinType::Type::u32: p << u32(lit.value); break;
+				case BuiltinType::Type::eBool: p << (lit.value != 0.0); break;
+				default: assert(!"Invalid literal type");
+			}
+			break;
+		} case Kind::identifier:
+			p << tree.variables[data]->name.name.str();
+			break;
+		case Kind::memberAccess:
+			write(tree, children[0], p);
+			p << "." << tree.members[data]->name.name.str();
+			break;
+		case Kind::functionCall:
+			p << tree.callables[data]->name() << "(";
+			for(auto i = 0u; i < children.size(); ++i) {
+				if(i) {
+					p << ", ";
+				}
+				write(tree, children[i], p);
+			}
+			p << ")";
+			break;
+		case Kind::op: {
+			auto sop = OpExpression::name(OpType(data));
+			p << "(";
+			if(children.size() == 1) {
+				p << sop;
+			}
+
+			for(auto i = 0u; i < children.size(); ++i) {
+				if(i) {
+					p << " " << sop << " ";
+				}
+				write(tree, children[i], p);
+			}
+			p << ")";
+			break;
+		} case Kind::ifExpr: {
+			auto branches = (children.size() - data) / 2;
+			for(auto i = 0u; i < branches; ++i) {
+				p << (i ? " else if " : "if ");
+				write(tree, children[2 * i], p);
+				p << " ";
+				write(tree, children[2 * i + 1], p);
+			}
+
+			if(data) {
+				p << " else ";
+				write(tree, children.back(), p);
+			}
+			break;
+		} case Kind::codeBlock: {
+			p << "{";
+			p.indent();
+			auto stmts = children.size() - data;
+			for(auto i = 0u; i < stmts && !p.full(); ++i) {
+				p.newline();
+				write(tree, children[i], p);
+				p << ";";
+			}
+
+			if(data) {
+				p.newline();
+				write(tree, children.back(), p);
+			}
+
+			p.unindent();
+			p.newline();
+			p << "}";
+			break;
+		} case Kind::exprStatement:
+			write(tree, children[0], p);
+			break;
+		case Kind::assignStatement:
+			write(tree, children[0], p);
+			p << " = ";
+			write(tree, children[1], p);
+			break;
+		case Kind::declStatement: {
+			auto& decl = *tree.variables[data];
+			p << typeName(*decl.type) << " " << decl.name.name.str() << " = ";
+			write(tree, children[0], p);
+			break;
+		}
+	}
+}
+
+std::string print(const Tree& tree, NodeId id, std::size_t limit) {
+	Printer printer(limit);
+	write(tree, id, printer);
+	return printer.take();
+}
+
+Node& VisitorAdapter::node(NodeId id) {
+	assert(id < nodes_.size());
+	if(!nodes_[id]) {
+		nodes_[id] = create(id);
+	}
+
+	return *nodes_[id];
+}
+
+Node* VisitorAdapter::create(NodeId id) {
+	auto children = tree_.childrenOf(id);
+	auto data = tree_.data[id];
+	// ast nodes hold non-const type pointers, they are never modified
+	auto* type = const_cast<Type*>(tree_.types[id]);
+
+	switch(tree_.kinds[id]) {
+		case Kind::literal: {
+			auto& lit = tree_.literals[data];
+			auto make = [&](auto value) -> Node* {
+				using T = decltype(value);
+				auto* node = arena_.create<LiteralImpl<T>>();
+				node->value = value;
+				return node;
+			};
+
+			switch(lit.type) {
+				case BuiltinType::Type::f32: return make(f32(lit.value));
+				case BuiltinType::Type::f64: return make(lit.value);
+				case BuiltinType::Type::i32: return make(i32(lit.value));
+				case BuiltinType::Type::u32: return make(u32(lit.value));
+				case BuiltinType::Type::eBool: return make(lit.value != 0.0);
+				default: assert(!"Invalid literal type"); return nullptr;
+			}
+		} case Kind::identifier: {
+			auto* node = arena_.create<IdentifierExpression>();
+			node->decl = tree_.variables[data];
+			return node;
+		} case Kind::memberAccess: {
+			auto* node = arena_.create<MemberAccess>();
+			node->accessed = &expr(children[0]);
+			node->accessor = tree_.members[data];
+			return node;
+		} case Kind::functionCall: {
+			auto* node = arena_.create<FunctionCall>();
+			node->called = tree_.callables[data];
+			for(auto c : children) {
+				node->arguments.push_back(&expr(c));
+			}
+			return node;
+		} case Kind::op: {
+			auto* node = arena_.create<OpExpression>();
+			node->opType = OpType(data);
+			node->ptype = type;
+			for(auto c : children) {
+				node->children.push_back(&expr(c));
+			}
+			return node;
+		} case Kind::ifExpr: {
+			auto* node = arena_.create<IfExpression>();
+			node->ptype = type;
+			node->ifBranch = {&expr(children[0]), &block(children[1])};
+			auto branches = (children.size() - data) / 2;
+			for(auto i = 1u; i < branches; ++i) {
+				node->elsifBranches.push_back({&expr(children[2 * i]),
+					&block(children[2 * i + 1])});
+			}
+
+			if(data) {
+				node->elseBranch = &block(children.back());
+			}
+			return node;
+		} case Kind::codeBlock: {
+			auto* node = arena_.create<CodeBlock>();
+			auto stmts = children.size() - data;
+			for(auto i = 0u; i < stmts; ++i) {
+				auto& stmt = static_cast<Statement&>(this->node(children[i]));
+				node->statements.push_back(&stmt);
+			}
+
+			if(data) {
+				node->ret = &expr(children.back());
+			}
+
+			setParent(id, *node);
+			return node;
+		} case Kind::exprStatement: {
+			auto* node = arena_.create<ExpressionStatement>();
+			node->expr = &expr(children[0]);
+			return node;
+		} case Kind::assignStatement: {
+			auto* node = arena_.create<AssignStatement>();
+			node->operands = {&expr(children[0]), &expr(children[1])};
+			return node;
+		} case Kind::declStatement: {
+			// identifiers still reference the original declaration
+			auto& orig = *tree_.variables[data];
+			auto* decl = arena_.create<VariableDeclaration>(orig);
+			decl->init = &expr(children[0]);
+			auto* node = arena_.create<DeclarationStatement>();
+			node->decl = decl;
+			return node;
+		}
+	}
+
+	return nullptr;
+}
+
+void VisitorAdapter::setParent(NodeId id, CodeBlock& parent) {
+	for(auto c : tree_.childrenOf(id)) {
+		if(tree_.kinds[c] == Kind::codeBlock) {
+			block(c).parent = &parent;
+		} else {
+			setParent(c, parent);
+		}
+	}
+}
+
+} // namespace ast::flat
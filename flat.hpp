@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ast.hpp"
+#include "span.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Flat, index-based representation of the ast.
+// All nodes of a module live in parallel arrays (structure of arrays),
+// children are referenced by 32-bit index and passes dispatch on the
+// kind tag instead of virtual functions. Children are always added
+// before their parent, so iterating over the ids in order visits
+// every node after its children.
+// Created from the pointer ast with flatten, the VisitorAdapter allows
+// to use an ast::Visitor on it.
+namespace ast::flat {
+
+using NodeId = std::uint32_t;
+constexpr auto invalidNode = NodeId(0xFFFFFFFFu);
+
+enum class Kind : std::uint8_t {
+	literal, // data: index into literals
+	identifier, // data: index into variables
+	memberAccess, // data: index into members; children: accessed
+	functionCall, // data: index into callables; children: arguments
+	op, // data: OpType; children: operands
+	ifExpr, // data: 1 if there is an else block; children: (condition, block)*, else block
+	codeBlock, // data: 1 if there is a return value; children: statements, return value
+	exprStatement, // children: expression
+	assignStatement, // children: left, right
+	declStatement, // data: index into variables; children: initializer
+};
+
+// All literal types are exactly representable as double
+struct LiteralValue {
+	BuiltinType::Type type;
+	double value;
+};
+
+struct FunctionEntry {
+	const Function* decl;
+	NodeId body;
+};
+
+struct Tree {
+	// per node
+	std::vector<Kind> kinds;
+	std::vector<std::uint32_t> data; // meaning depends on kind
+	std::vector<std::uint32_t> firstChild; // index into children
+	std::vector<std::uint32_t> childCount;
+	std::vector<const Type*> types; // null if not known (yet)
+
+	std::vector<NodeId> children;
+
+	// kind specific data
+	std::vector<LiteralValue> literals;
+	std::vector<const VariableDeclaration*> variables;
+	std::vector<const StructMember*> members;
+	std::vector<const Callable*> callables;
+
+	std::vector<FunctionEntry> functions;
+
+	std::size_t size() const { return kinds.size(); }
+
+	nytl::span<const NodeId> childrenOf(NodeId id) const {
+		return {children.data() + firstChild[id], childCount[id]};
+	}
+
+	NodeId add(Kind kind, std::uint32_t nodeData,
+			nytl::span<const NodeId> nodeChildren, const Type* type = {}) {
+		auto id = NodeId(kinds.size());
+		kinds.push_back(kind);
+		data.push_back(nodeData);
+		firstChild.push_back(std::uint32_t(children.size()));
+		childCount.push_back(std::uint32_t(nodeChildren.size()));
+		types.push_back(type);
+		children.insert(children.end(), nodeChildren.begin(), nodeChildren.end());
+		return id;
+	}
+};
+
+// Appends the given expression (and all its children) to the tree.
+NodeId flatten(Tree& tree, Expression& expr);
+
+// Flattens all functions of the module.
+Tree flatten(const Module& mod);
+
+// Same output as Node::write and Node::print.
+void write(const Tree& tree, NodeId id, Printer& printer);
+std::string print(const Tree& tree, NodeId id, std::size_t limit = Printer::noLimit);
+
+// Creates pointer ast nodes for flat nodes on demand so that code
+// written against ast::Visitor keeps working while it is migrated.
+// The created nodes are cached and owned by the adapter.
+class VisitorAdapter {
+public:
+	explicit VisitorAdapter(const Tree& tree) :
+		tree_(tree), nodes_(tree.size(), nullptr) {}
+
+	Node& node(NodeId id);
+	void visit(NodeId id, Visitor& visitor) { node(id).visit(visitor); }
+
+private:
+	Expression& expr(NodeId id) { return static_cast<Expression&>(node(id)); }
+	CodeBlock& block(NodeId id) { return static_cast<CodeBlock&>(node(id)); }
+	Node* create(NodeId id);
+	// Sets the parent of the nearest code blocks below id
+	void setParent(NodeId id, CodeBlock& parent);
+
+	const Tree& tree_;
+	Arena arena_;
+	std::vector<Node*> nodes_;
+};
+
+} // namespace ast::flat
@@ -0,0 +1,545 @@
+#include "fold.hpp"
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace ast {
+
+namespace {
+
+using BT = BuiltinType::Type;
+using Component = Constant::Component;
+
+template<typename T>
+std::optional<bool> compare(OpType op, T a, T b) {
+	switch(op) {
+		case OpType::eq: return a == b;
+		case OpType::neq: return a != b;
+		case OpType::less: return a < b;
+		case OpType::lessEq: return a <= b;
+		case OpType::greater: return a > b;
+		case OpType::greaterEq: return a >= b;
+		default: return std::nullopt;
+	}
+}
+
+// Unsigned integer arithmetic, wraps around.
+std::optional<u32> evalU32(OpType op, u32 a, u32 b) {
+	switch(op) {
+		case OpType::add: return a + b;
+		case OpType::sub: return a - b;
+		case OpType::mult: return a * b;
+		case OpType::div: return b ? std::optional<u32>(a / b) : std::nullopt;
+		case OpType::mod: return b ? std::optional<u32>(a % b) : std::nullopt;
+		case OpType::bitAnd: return a & b;
+		case OpType::bitOr: return a | b;
+		case OpType::bitXor: return a ^ b;
+		case OpType::shiftLeft: return b < 32 ? std::optional<u32>(a << b) : std::nullopt;
+		case OpType::shiftRight: return b < 32 ? std::optional<u32>(a >> b) : std::nullopt;
+		case OpType::neg: return 0u - a;
+		default: return std::nullopt;
+	}
+}
+
+// Two's complement, computed on the unsigned representation where
+// signed overflow would be undefined.
+std::optional<i32> evalI32(OpType op, i32 a, i32 b) {
+	constexpr auto min = std::numeric_limits<i32>::min();
+	switch(op) {
+		case OpType::div:
+			if(b == 0) {
+				return std::nullopt;
+			}
+			return (a == min && b == -1) ? min : a / b;
+		case OpType::mod:
+			if(b == 0) {
+				return std::nullopt;
+			}
+			return (a == min && b == -1) ? 0 : a % b;
+		case OpType::shiftRight:
+			// arithmetic shift
+			if(b < 0 || b >= 32) {
+				return std::nullopt;
+			}
+			return a < 0 ? ~i32(~u32(a) >> b) : i32(u32(a) >> b);
+		case OpType::shiftLeft:
+			if(b < 0 || b >= 32) {
+				return std::nullopt;
+			}
+			return i32(u32(a) << b);
+		default: {
+			auto res = evalU32(op, u32(a), u32(b));
+			return res ? std::optional<i32>(i32(*res)) : std::nullopt;
+		}
+	}
+}
+
+// Evaluated in T, i.e. f32 operations are rounded to single precision.
+template<typename T>
+std::optional<T> evalFloat(OpType op, T a, T b) {
+	switch(op) {
+		case OpType::add: return a + b;
+		case OpType::sub: return a - b;
+		case OpType::mult: return a * b;
+		case OpType::div: return a / b;
+		case OpType::mod: return std::fmod(a, b);
+		case OpType::neg: return -a;
+		default: return std::nullopt;
+	}
+}
+
+std::optional<bool> evalBool(OpType op, bool a, bool b) {
+	switch(op) {
+		case OpType::eq: return a == b;
+		case OpType::neq: return a != b;
+		case OpType::logicalAnd:
+		case OpType::bitAnd: return a && b;
+		case OpType::logicalOr:
+		case OpType::bitOr: return a || b;
+		case OpType::bitXor: return a != b;
+		default: return std::nullopt;
+	}
+}
+
+// Evaluates one component, the result type is either type or bool
+// for comparisons.
+bool evalComponent(OpType op, BT type, Component a, Component b, Component& out) {
+	if(isComparison(op) && type != BT::eBool) {
+		std::optional<bool> res;
+		switch(type) {
+			case BT::i32: res = compare(op, a.i, b.i); break;
+			case BT::u32: res = compare(op, a.u, b.u); break;
+			case BT::f32: res = compare(op, a.f, b.f); break;
+			case BT::f64: res = compare(op, a.d, b.d); break;
+			default: break;
+		}
+
+		if(res) {
+			out.b = *res;
+		}
+		return res.has_value();
+	}
+
+	switch(type) {
+		case BT::i32: if(auto r = evalI32(op, a.i, b.i)) { out.i = *r; return true; } break;
+		case BT::u32: if(auto r = evalU32(op, a.u, b.u)) { out.u = *r; return true; } break;
+		case BT::f32: if(auto r = evalFloat(op, a.f, b.f)) { out.f = *r; return true; } break;
+		case BT::f64: if(auto r = evalFloat(op, a.d, b.d)) { out.d = *r; return true; } break;
+		case BT::eBool: if(auto r = evalBool(op, a.b, b.b)) { out.b = *r; return true; } break;
+		default: break;
+	}
+
+	return false;
+}
+
+// Linear algebra product of matrices and vectors, vectors on the
+// left side are row vectors.
+std::optional<Constant> matrixProduct(const Constant& a, const Constant& b) {
+	auto type = a.type->type;
+	if(type != BT::f32 && type != BT::f64) {
+		return std::nullopt;
+	}
+
+	// a: n x k, b: k x m
+	auto aRows = a.type->rows, aCols = a.type->cols;
+	if(aCols == 1) {
+		std::swap(aRows, aCols);
+	}
+
+	auto bRows = b.type->rows, bCols = b.type->cols;
+	if(aCols != bRows) {
+		return std::nullopt;
+	}
+
+	Constant ret;
+	ret.type = (aRows == 1) ?
+		&BuiltinType::vecType(type, bCols) :
+		&BuiltinType::matType(type, aRows, bCols);
+	for(auto c = 0u; c < bCols; ++c) {
+		for(auto r = 0u; r < aRows; ++r) {
+			f64 sum = 0.0;
+			f32 fsum = 0.f;
+			for(auto k = 0u; k < aCols; ++k) {
+				auto ai = k * aRows + r;
+				auto bi = c * bRows + k;
+				if(type == BT::f32) {
+					fsum += a.values[ai].f * b.values[bi].f;
+				} else {
+					sum += a.values[ai].d * b.values[bi].d;
+				}
+			}
+
+			auto& out = ret.values[c * aRows + r];
+			if(type == BT::f32) {
+				out.f = fsum;
+			} else {
+				out.d = sum;
+			}
+		}
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+Constant constant(const Literal& literal) {
+	Constant ret;
+	ret.type = &static_cast<const BuiltinType&>(literal.type());
+	auto& v = ret.values[0];
+	switch(ret.type->type) {
+		case BT::f32: v.f = static_cast<const LiteralImpl<f32>&>(literal).value; break;
+		case BT::f64: v.d = static_cast<const LiteralImpl<f64>&>(literal).value; break;
+		case BT::i32: v.i = static_cast<const LiteralImpl<i32>&>(literal).value; break;
+		case BT::u32: v.u = static_cast<const LiteralImpl<u32>&>(literal).value; break;
+		case BT::eBool: v.b = static_cast<const LiteralImpl<bool>&>(literal).value; break;
+		default: assert(!"Invalid literal type");
+	}
+
+	return ret;
+}
+
+std::optional<Constant> evaluate(OpType op, const Constant& a, const Constant* b) {
+	auto type = a.type->type;
+	if(op == OpType::neg) {
+		assert(!b);
+		Constant ret = a;
+		for(auto i = 0u; i < a.size(); ++i) {
+			if(!evalComponent(op, type, a.values[i], {}, ret.values[i])) {
+				return std::nullopt;
+			}
+		}
+		return ret;
+	}
+
+	assert(b);
+	if(b->type->type != type) {
+		return std::nullopt;
+	}
+
+	auto matrix = a.type->cols > 1 || b->type->cols > 1;
+	if(op == OpType::mult && matrix && !a.isScalar() && !b->isScalar()) {
+		return matrixProduct(a, *b);
+	}
+
+	// componentwise, scalars are broadcast
+	auto& shape = a.isScalar() ? *b->type : *a.type;
+	if(!a.isScalar() && !b->isScalar() &&
+			(a.type->rows != b->type->rows || a.type->cols != b->type->cols)) {
+		return std::nullopt;
+	}
+
+	auto count = shape.rows * shape.cols;
+	auto comparison = isComparison(op);
+	if(comparison && count > 1 && op != OpType::eq && op != OpType::neq) {
+		return std::nullopt;
+	}
+
+	Constant ret;
+	ret.type = comparison ? &BuiltinType::boolType() : &shape;
+	std::array<Component, 16> results {};
+	for(auto i = 0u; i < count; ++i) {
+		auto ca = a.values[a.isScalar() ? 0 : i];
+		auto cb = b->values[b->isScalar() ? 0 : i];
+		if(!evalComponent(op, type, ca, cb, results[i])) {
+			return std::nullopt;
+		}
+	}
+
+	if(comparison && count > 1) {
+		// vectors compare as a whole
+		auto all = true;
+		for(auto i = 0u; i < count; ++i) {
+			all = all && (op == OpType::eq ? results[i].b : !results[i].b);
+		}
+		ret.values[0].b = (op == OpType::eq) ? all : !all;
+	} else {
+		ret.values = results;
+	}
+
+	return ret;
+}
+
+// Replaces the visited expression and remembers its value if it is
+// constant.
+class ConstantFolder::Folder : public Visitor {
+public:
+	explicit Folder(ConstantFolder& folder) : folder_(folder) {}
+
+	Expression* fold(Expression& expr, std::optional<Constant>* value = nullptr) {
+		result_ = &expr;
+		value_.reset();
+		expr.visit(*this);
+		if(value) {
+			*value = value_;
+		}
+		return result_;
+	}
+
+	void visit(Literal& e) override {
+		value_ = constant(e);
+	}
+
+	void visit(IdentifierExpression& e) override {
+		auto it = folder_.values_.find(e.decl);
+		if(it == folder_.values_.end()) {
+			return;
+		}
+
+		value_ = it->second;
+		if(auto* lit = folder_.literal(it->second)) {
+			++folder_.stats_.propagated;
+			result_ = lit;
+		}
+	}
+
+	void visit(OpExpression& e) override {
+		std::vector<std::optional<Constant>> values(e.children.size());
+		for(auto i = 0u; i < e.children.size(); ++i) {
+			e.children[i] = fold(*e.children[i], &values[i]);
+		}
+
+		result_ = &e;
+		value_.reset();
+
+		if(e.opType == OpType::neg) {
+			if(values[0]) {
+				value_ = evaluate(e.opType, *values[0], nullptr);
+			}
+			replace(e);
+			return;
+		}
+
+		// evaluate the leading constant operands, the chain is
+		// left-associative
+		auto acc = values[0];
+		auto count = 1u;
+		while(acc && count < values.size() && values[count]) {
+			auto next = evaluate(e.opType, *acc, &*values[count]);
+			if(!next) {
+				break;
+			}
+
+			acc = next;
+			++count;
+		}
+
+		if(count < 2) {
+			return;
+		}
+
+		if(count == e.children.size()) {
+			value_ = acc;
+			replace(e);
+			return;
+		}
+
+		if(auto* lit = folder_.literal(*acc)) {
+			++folder_.stats_.folded;
+			e.children.erase(e.children.begin() + 1, e.children.begin() + count);
+			e.children[0] = lit;
+		}
+	}
+
+	void visit(IfExpression& e) override {
+		std::vector<IfExpression::Branch> branches;
+		branches.push_back(e.ifBranch);
+		branches.insert(branches.end(), e.elsifBranches.begin(), e.elsifBranches.end());
+		if(e.elseBranch) {
+			foldBlock(*e.elseBranch);
+		}
+
+		std::vector<IfExpression::Branch> kept;
+		auto* elseBranch = e.elseBranch;
+		for(auto& branch : branches) {
+			std::optional<Constant> cond;
+			branch.condition = fold(*branch.condition, &cond);
+			foldBlock(*branch.code);
+			if(!cond || cond->type != &BuiltinType::boolType()) {
+				kept.push_back(branch);
+				continue;
+			}
+
+			++folder_.stats_.branches;
+			if(cond->values[0].b) {
+				// always taken, the following branches are dead
+				elseBranch = branch.code;
+				break;
+			}
+		}
+
+		value_.reset();
+		if(kept.empty()) {
+			// no condition left, the expression is the taken block
+			result_ = elseBranch ? elseBranch : folder_.arena_.create<CodeBlock>();
+			return;
+		}
+
+		result_ = &e;
+		e.ifBranch = kept.front();
+		e.elsifBranches.assign(kept.begin() + 1, kept.end());
+		e.elseBranch = elseBranch;
+	}
+
+	void visit(CodeBlock& e) override {
+		for(auto* stmt : e.statements) {
+			stmt->visit(*this);
+		}
+
+		result_ = &e;
+		value_.reset();
+		if(e.ret) {
+			std::optional<Constant> value;
+			e.ret = fold(*e.ret, &value);
+			result_ = &e;
+			value_.reset();
+
+			// a block that only returns a constant is the constant
+			if(value && e.statements.empty()) {
+				value_ = value;
+				result_ = e.ret;
+			}
+		}
+	}
+
+	void visit(FunctionCall& e) override {
+		for(auto& arg : e.arguments) {
+			arg = fold(*arg);
+		}
+
+		result_ = &e;
+		value_.reset();
+	}
+
+	void visit(MemberAccess& e) override {
+		e.accessed = fold(*e.accessed);
+		result_ = &e;
+		value_.reset();
+	}
+
+	void visit(ExpressionStatement& s) override {
+		s.expr = fold(*s.expr);
+	}
+
+	void visit(AssignStatement& s) override {
+		s.operands[1] = fold(*s.operands[1]);
+	}
+
+	void visit(DeclarationStatement& s) override {
+		std::optional<Constant> value;
+		s.decl->init = fold(*s.decl->init, &value);
+		if(value) {
+			broadcast(*value, *s.decl->type);
+		}
+
+		if(value && value->type == s.decl->type && !folder_.assigned_.count(s.decl)) {
+			folder_.values_.emplace(s.decl, *value);
+		}
+	}
+
+private:
+	// Branches stay blocks, only blocks used as expression
+	// are replaced by their value.
+	void foldBlock(CodeBlock& block) {
+		visit(block);
+	}
+
+	// Scalars initialize all components of vector and matrix variables,
+	// like in the vm. It's the only way to create them.
+	static void broadcast(Constant& value, const Type& type) {
+		if(!value.isScalar() || type.category != Type::Category::primitive) {
+			return;
+		}
+
+		auto& btype = static_cast<const BuiltinType&>(type);
+		if(btype.type != value.type->type || (btype.rows == 1 && btype.cols == 1)) {
+			return;
+		}
+
+		value.type = &btype;
+		for(auto i = 1u; i < value.size(); ++i) {
+			value.values[i] = value.values[0];
+		}
+	}
+
+	// Replaces the op expression with its value if it has one
+	void replace(OpExpression& e) {
+		if(!value_) {
+			return;
+		}
+
+		if(auto* lit = folder_.literal(*value_)) {
+			++folder_.stats_.folded;
+			result_ = lit;
+		} else {
+			result_ = &e;
+		}
+	}
+
+	ConstantFolder& folder_;
+	Expression* result_ {};
+	std::optional<Constant> value_;
+};
+
+Expression* ConstantFolder::fold(Expression& expr) {
+	collectAssigned(expr);
+	return Folder(*this).fold(expr);
+}
+
+void ConstantFolder::fold(Function& func) {
+	if(!func.code) {
+		return;
+	}
+
+	collectAssigned(*func.code);
+	Folder folder(*this);
+	folder.visit(*func.code);
+}
+
+void ConstantFolder::fold(Module& mod) {
+	for(auto* func : mod.functions) {
+		fold(*func);
+	}
+}
+
+void ConstantFolder::collectAssigned(Node& node) {
+	struct Collector : Visitor {
+		using Visitor::visit;
+		std::unordered_set<const VariableDeclaration*>& assigned;
+
+		Collector(std::unordered_set<const VariableDeclaration*>& a) : assigned(a) {}
+		void visit(AssignStatement& s) override {
+			if(auto* ident = dynamic_cast<IdentifierExpression*>(s.left())) {
+				assigned.insert(ident->decl);
+			}
+			Visitor::visit(s);
+		}
+	};
+
+	Collector collector(assigned_);
+	node.visit(collector);
+}
+
+Expression* ConstantFolder::literal(const Constant& value) {
+	if(!value.isScalar()) {
+		return nullptr;
+	}
+
+	auto make = [&](auto v) -> Expression* {
+		auto* lit = arena_.create<LiteralImpl<decltype(v)>>();
+		lit->value = v;
+		return lit;
+	};
+
+	auto& c = value.values[0];
+	switch(value.type->type) {
+		case BT::f32: return make(c.f);
+		case BT::f64: return make(c.d);
+		case BT::i32: return make(c.i);
+		case BT::u32: return make(c.u);
+		case BT::eBool: return make(c.b);
+		default: return nullptr;
+	}
+}
+
+} // namespace ast
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ast {
+
+// Compile time value of a builtin scalar, vector or matrix type.
+// Matrices are stored column by column.
+struct Constant {
+	union Component {
+		i32 i;
+		u32 u;
+		f32 f;
+		f64 d;
+		bool b;
+	};
+
+	const BuiltinType* type {};
+	std::array<Component, 16> values {};
+
+	unsigned size() const { return type->rows * type->cols; }
+	bool isScalar() const { return type->rows == 1 && type->cols == 1; }
+};
+
+// Returns the constant value of the given literal.
+Constant constant(const Literal& literal);
+
+// Evaluates the operator on the given operands (one for neg, two otherwise)
+// with the semantics of the target: i32 and u32 wrap around, f32 is
+// evaluated in single precision. Scalars are broadcast, '*' on matrices
+// is the matrix product. Returns nothing for invalid or undefined
+// operations, e.g. mismatching types or a division by zero.
+std::optional<Constant> evaluate(OpType op, const Constant& a, const Constant* b);
+
+// Folds constant subexpressions of the ast, in place.
+// - OpExpressions with constant operands are evaluated, n-ary chains are
+//   folded as far as their leading constant operands go
+// - variables that are never assigned are replaced by the value of
+//   their constant initializer, scalars are broadcast to vector and
+//   matrix variables
+// - if expressions with a constant condition are replaced by the taken
+//   branch, constant false else-if branches are removed
+// Only scalar results can be expressed as literal node, vector and
+// matrix values are folded internally but their nodes stay.
+// New nodes are created in the given arena.
+class ConstantFolder {
+public:
+	struct Stats {
+		unsigned folded {}; // evaluated operator nodes
+		unsigned propagated {}; // replaced identifiers
+		unsigned branches {}; // if expressions or branches removed
+	};
+
+public:
+	explicit ConstantFolder(Arena& arena) : arena_(arena) {}
+
+	// Returns the expression that replaces the given one, might be
+	// the same expression.
+	Expression* fold(Expression& expr);
+	void fold(Function& func);
+	void fold(Module& mod);
+
+	const Stats& stats() const { return stats_; }
+
+private:
+	class Folder;
+
+	// Variables that are assigned somewhere, they can't be propagated
+	void collectAssigned(Node& node);
+	Expression* literal(const Constant& value);
+
+	Arena& arena_;
+	Stats stats_;
+	std::unordered_set<const VariableDeclaration*> assigned_;
+	std::unordered_map<const VariableDeclaration*, Constant> values_;
+};
+
+} // namespace ast
@@ -0,0 +1,182 @@
+#include "ir.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <unordered_map>
+
+namespace ast::ir {
+
+namespace {
+
+using BT = BuiltinType::Type;
+
+// Everything that determines the value of a pure instruction
+struct Key {
+	Opcode opcode;
+	const Type* type;
+	OpType op;
+	unsigned index; // the block for phis, their operands depend on it
+	std::uint64_t bits;
+	const Callable* callee;
+	std::vector<ValueId> operands;
+
+	bool operator==(const Key& other) const {
+		return opcode == other.opcode && type == other.type && op == other.op &&
+			index == other.index && bits == other.bits &&
+			callee == other.callee && operands == other.operands;
+	}
+};
+
+struct KeyHash {
+	std::size_t operator()(const Key& key) const {
+		auto hash = std::size_t(key.opcode);
+		auto combine = [&](std::size_t value) {
+			hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		};
+
+		combine(key.type->id);
+		combine(std::size_t(key.op));
+		combine(key.index);
+		combine(std::size_t(key.bits));
+		combine(std::hash<const Callable*>{}(key.callee));
+		for(auto operand : key.operands) {
+			combine(operand);
+		}
+		return hash;
+	}
+};
+
+// Only the member of the constants type is set
+std::uint64_t bits(const Instruction& inst) {
+	std::uint64_t ret {};
+	auto& value = inst.value;
+	switch(static_cast<const BuiltinType&>(*inst.type).type) {
+		case BT::f32: std::memcpy(&ret, &value.f, sizeof(value.f)); break;
+		case BT::f64: std::memcpy(&ret, &value.d, sizeof(value.d)); break;
+		case BT::i32: std::memcpy(&ret, &value.i, sizeof(value.i)); break;
+		case BT::u32: ret = value.u; break;
+		case BT::eBool: ret = value.b; break;
+		default: break;
+	}
+	return ret;
+}
+
+// Floating point addition and multiplication are commutative as well,
+// only the matrix product isn't.
+bool commutative(const Function& func, const Instruction& inst) {
+	switch(inst.op) {
+		case OpType::add:
+		case OpType::eq:
+		case OpType::neq:
+		case OpType::bitAnd:
+		case OpType::bitOr:
+		case OpType::bitXor:
+		case OpType::logicalAnd:
+		case OpType::logicalOr:
+			return true;
+		case OpType::mult: {
+			auto& a = static_cast<const BuiltinType&>(*func.values[inst.operands[0]].type);
+			auto& b = static_cast<const BuiltinType&>(*func.values[inst.operands[1]].type);
+			return !isMatrixProduct(inst.op, a, b);
+		} default:
+			return false;
+	}
+}
+
+} // anon namespace
+
+unsigned removeRedundant(Function& func) {
+	auto idom = dominators(func);
+	auto& values = func.values;
+
+	// the value every value is replaced with, itself if it is kept
+	std::vector<ValueId> leader(values.size());
+	for(auto i = 0u; i < leader.size(); ++i) {
+		leader[i] = i;
+	}
+
+	std::vector<BlockId> defBlock(values.size());
+	std::unordered_map<Key, std::vector<ValueId>, KeyHash> available;
+	auto removed = 0u;
+	for(auto b = 0u; b < func.blocks.size(); ++b) {
+		auto& block = func.blocks[b];
+		assert(std::all_of(block.preds.begin(), block.preds.end(),
+			[&](auto pred){ return pred < b; }) && "Blocks must be ordered");
+		std::vector<ValueId> code;
+		for(auto id : block.code) {
+			auto& inst = values[id];
+			for(auto& operand : inst.operands) {
+				operand = leader[operand];
+			}
+
+			defBlock[id] = b;
+			// Calls are pure too, functions can't have side effects.
+			// Every use of an undef may see a different value.
+			if(isTerminator(inst.opcode) || inst.opcode == Opcode::param ||
+					inst.opcode == Opcode::undef) {
+				code.push_back(id);
+				continue;
+			}
+
+			// members read after assigning a member: the assigned one is
+			// known, the others are those of the previous value
+			if(inst.opcode == Opcode::extract) {
+				auto* base = &values[inst.operands[0]];
+				while(base->opcode == Opcode::insert && base->index != inst.index) {
+					inst.operands[0] = base->operands[0];
+					base = &values[inst.operands[0]];
+				}
+
+				if(base->opcode == Opcode::insert) {
+					leader[id] = base->operands[1];
+					++removed;
+					continue;
+				}
+			}
+
+			// phis choosing the same value on every path
+			if(inst.opcode == Opcode::phi) {
+				auto& ops = inst.operands;
+				if(std::all_of(ops.begin(), ops.end(), [&](auto op){ return op == ops[0]; })) {
+					leader[id] = ops[0];
+					++removed;
+					continue;
+				}
+			}
+
+			Key key {inst.opcode, inst.type, inst.op, inst.index, 0u, inst.callee, inst.operands};
+			if(inst.opcode == Opcode::constant) {
+				key.bits = bits(inst);
+			} else if(inst.opcode == Opcode::phi) {
+				key.index = b;
+			} else if(inst.opcode == Opcode::op && key.operands.size() == 2u &&
+					commutative(func, inst) && key.operands[0] > key.operands[1]) {
+				std::swap(key.operands[0], key.operands[1]);
+			}
+
+			// earlier computations are only available if they are on
+			// every path to this one
+			auto& candidates = available[std::move(key)];
+			auto it = std::find_if(candidates.begin(), candidates.end(), [&](auto candidate) {
+				return dominates(idom, defBlock[candidate], b);
+			});
+
+			if(it != candidates.end()) {
+				leader[id] = *it;
+				++removed;
+				continue;
+			}
+
+			candidates.push_back(id);
+			code.push_back(id);
+		}
+
+		block.code = std::move(code);
+	}
+
+	return removed;
+}
+
+} // namespace ast::ir
@@ -0,0 +1,315 @@
+#include "inliner.hpp"
+#include "fold.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+namespace ast {
+
+using BT = BuiltinType::Type;
+
+// Deep copy of a function body. Declarations are copied as well, the
+// identifiers of the copy reference the copied ones.
+class Inliner::Cloner {
+public:
+	explicit Cloner(Arena& arena) : arena_(arena) {}
+
+	void bind(const VariableDeclaration& from, const VariableDeclaration& to) {
+		vars_[&from] = &to;
+	}
+
+	Statement* statement(const Statement& stmt, CodeBlock* parent) {
+		if(auto* decl = dynamic_cast<const DeclarationStatement*>(&stmt)) {
+			auto* var = arena_.create<VariableDeclaration>(*decl->decl);
+			var->init = expr(*decl->decl->init, parent);
+			bind(*decl->decl, *var);
+			auto* node = arena_.create<DeclarationStatement>();
+			node->decl = var;
+			return node;
+		} else if(auto* assign = dynamic_cast<const AssignStatement*>(&stmt)) {
+			auto* node = arena_.create<AssignStatement>();
+			node->operands = {expr(*assign->left(), parent), expr(*assign->right(), parent)};
+			return node;
+		} else if(auto* exprStmt = dynamic_cast<const ExpressionStatement*>(&stmt)) {
+			auto* node = arena_.create<ExpressionStatement>();
+			node->expr = expr(*exprStmt->expr, parent);
+			return node;
+		}
+
+		assert(!"Invalid statement");
+		return nullptr;
+	}
+
+	CodeBlock* block(const CodeBlock& block, CodeBlock* parent) {
+		auto* node = arena_.create<CodeBlock>();
+		node->parent = parent;
+		for(auto* stmt : block.statements) {
+			node->statements.push_back(statement(*stmt, node));
+		}
+
+		if(block.ret) {
+			node->ret = expr(*block.ret, node);
+		}
+		return node;
+	}
+
+	Expression* expr(const Expression& e, CodeBlock* parent) {
+		if(auto* lit = dynamic_cast<const Literal*>(&e)) {
+			auto value = constant(*lit);
+			auto make = [&](auto v) -> Expression* {
+				auto* node = arena_.create<LiteralImpl<decltype(v)>>();
+				node->value = v;
+				return node;
+			};
+
+			auto& c = value.values[0];
+			switch(value.type->type) {
+				case BT::f32: return make(c.f);
+				case BT::f64: return make(c.d);
+				case BT::i32: return make(c.i);
+				case BT::u32: return make(c.u);
+				case BT::eBool: return make(c.b);
+				default: assert(!"Invalid literal type"); return nullptr;
+			}
+		} else if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+			auto it = vars_.find(ident->decl);
+			assert(it != vars_.end() && "Variable not declared in the body");
+			auto* node = arena_.create<IdentifierExpression>();
+			node->decl = it->second;
+			return node;
+		} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+			auto* node = arena_.create<MemberAccess>();
+			node->accessed = expr(*access->accessed, parent);
+			node->accessor = access->accessor;
+			return node;
+		} else if(auto* call = dynamic_cast<const FunctionCall*>(&e)) {
+			auto* node = arena_.create<FunctionCall>();
+			node->called = call->called;
+			for(auto* arg : call->arguments) {
+				node->arguments.push_back(expr(*arg, parent));
+			}
+			return node;
+		} else if(auto* op = dynamic_cast<const OpExpression*>(&e)) {
+			auto* node = arena_.create<OpExpression>();
+			node->opType = op->opType;
+			node->ptype = op->ptype;
+			for(auto* child : op->children) {
+				node->children.push_back(expr(*child, parent));
+			}
+			return node;
+		} else if(auto* codeBlock = dynamic_cast<const CodeBlock*>(&e)) {
+			return block(*codeBlock, parent);
+		} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&e)) {
+			auto* node = arena_.create<IfExpression>();
+			node->ptype = ifExpr->ptype;
+			auto branch = [&](const IfExpression::Branch& b) {
+				return IfExpression::Branch {expr(*b.condition, parent), block(*b.code, parent)};
+			};
+
+			node->ifBranch = branch(ifExpr->ifBranch);
+			for(auto& b : ifExpr->elsifBranches) {
+				node->elsifBranches.push_back(branch(b));
+			}
+
+			if(ifExpr->elseBranch) {
+				node->elseBranch = block(*ifExpr->elseBranch, parent);
+			}
+			return node;
+		}
+
+		assert(!"Invalid expression");
+		return nullptr;
+	}
+
+private:
+	Arena& arena_;
+	std::unordered_map<const VariableDeclaration*, const VariableDeclaration*> vars_;
+};
+
+// Replaces the visited calls, like the ConstantFolder.
+class Inliner::Rewriter : public Visitor {
+public:
+	using Visitor::visit;
+
+	Rewriter(Inliner& inliner, CodeBlock* block) : inliner_(inliner), block_(block) {}
+
+	Expression* rewrite(Expression& expr) {
+		result_ = &expr;
+		expr.visit(*this);
+		return result_;
+	}
+
+	void visit(FunctionCall& e) override {
+		for(auto& arg : e.arguments) {
+			arg = rewrite(*arg);
+		}
+
+		auto* block = inliner_.expand(e, block_);
+		result_ = block ? static_cast<Expression*>(block) : &e;
+	}
+
+	void visit(OpExpression& e) override {
+		for(auto& child : e.children) {
+			child = rewrite(*child);
+		}
+		result_ = &e;
+	}
+
+	void visit(MemberAccess& e) override {
+		e.accessed = rewrite(*e.accessed);
+		result_ = &e;
+	}
+
+	void visit(IfExpression& e) override {
+		e.ifBranch.condition = rewrite(*e.ifBranch.condition);
+		visit(*e.ifBranch.code);
+		for(auto& b : e.elsifBranches) {
+			b.condition = rewrite(*b.condition);
+			visit(*b.code);
+		}
+
+		if(e.elseBranch) {
+			visit(*e.elseBranch);
+		}
+		result_ = &e;
+	}
+
+	void visit(CodeBlock& e) override {
+		auto* outer = block_;
+		block_ = &e;
+		for(auto* stmt : e.statements) {
+			stmt->visit(*this);
+		}
+
+		if(e.ret) {
+			e.ret = rewrite(*e.ret);
+		}
+
+		block_ = outer;
+		result_ = &e;
+	}
+
+	void visit(ExpressionStatement& s) override {
+		s.expr = rewrite(*s.expr);
+	}
+
+	void visit(AssignStatement& s) override {
+		s.operands[1] = rewrite(*s.operands[1]);
+	}
+
+	void visit(DeclarationStatement& s) override {
+		s.decl->init = rewrite(*s.decl->init);
+	}
+
+private:
+	Inliner& inliner_;
+	CodeBlock* block_ {}; // the innermost block
+	Expression* result_ {};
+};
+
+void Inliner::run(Function& func) {
+	if(!func.code) {
+		return;
+	}
+
+	budget_ = limits_.budget;
+	stack_ = {&func};
+	Rewriter rewriter(*this, nullptr);
+	rewriter.visit(*func.code);
+	stack_.clear();
+}
+
+void Inliner::run(Module& mod) {
+	for(auto* func : mod.functions) {
+		run(*func);
+	}
+}
+
+unsigned Inliner::size(Node& node) {
+	struct Counter : Visitor {
+		using Visitor::visit;
+		unsigned count {};
+		void visit(Node&) override { ++count; }
+	};
+
+	Counter counter;
+	node.visit(counter);
+	return counter.count;
+}
+
+CodeBlock* Inliner::expand(FunctionCall& call, CodeBlock* parent) {
+	auto* callee = dynamic_cast<const Function*>(call.called);
+	if(!callee || !callee->code ||
+			std::find(stack_.begin(), stack_.end(), callee) != stack_.end()) {
+		return nullptr;
+	}
+
+	// a missing return value can't be expressed
+	auto& body = *callee->code;
+	auto& retType = callee->returnType();
+	auto isVoid = (&retType == &BuiltinType::voidType());
+	if(!isVoid && !body.ret) {
+		return nullptr;
+	}
+
+	// the call node is replaced by the body and one declaration per
+	// parameter, the arguments are moved into them
+	auto bodySize = size(body);
+	auto added = bodySize + unsigned(callee->params.size()) - 1u;
+	if(bodySize > limits_.maxSize || added > budget_ || stack_.size() > limits_.depth) {
+		++stats_.rejected;
+		return nullptr;
+	}
+
+	budget_ -= added;
+	stats_.added += added;
+	++stats_.inlined;
+
+	Cloner cloner(arena_);
+	auto* block = arena_.create<CodeBlock>();
+	block->parent = parent;
+	assert(call.arguments.size() == callee->params.size());
+	for(auto i = 0u; i < callee->params.size(); ++i) {
+		auto& param = *callee->params[i];
+		auto* var = arena_.create<VariableDeclaration>(param);
+		var->init = call.arguments[i];
+		cloner.bind(param, *var);
+		auto* stmt = arena_.create<DeclarationStatement>();
+		stmt->decl = var;
+		block->statements.push_back(stmt);
+	}
+
+	for(auto* stmt : body.statements) {
+		block->statements.push_back(cloner.statement(*stmt, block));
+	}
+
+	if(body.ret) {
+		auto* ret = cloner.expr(*body.ret, block);
+		if(isVoid) {
+			auto* stmt = arena_.create<ExpressionStatement>();
+			stmt->expr = ret;
+			block->statements.push_back(stmt);
+		} else {
+			assert(&typeOf(*ret) == &retType && "Function returns a different type");
+			block->ret = ret;
+		}
+	}
+
+	// calls in the inlined body, the arguments were already visited
+	stack_.push_back(callee);
+	Rewriter rewriter(*this, block);
+	for(auto i = callee->params.size(); i < block->statements.size(); ++i) {
+		block->statements[i]->visit(rewriter);
+	}
+
+	if(block->ret) {
+		block->ret = rewriter.rewrite(*block->ret);
+	}
+	stack_.pop_back();
+
+	return block;
+}
+
+} // namespace ast
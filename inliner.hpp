@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <vector>
+
+namespace ast {
+
+// Replaces calls of small functions with their body, in place.
+// A call 'f(a, b)' becomes the block
+//   { T0 p0 = a; T1 p1 = b; <statements of f> <ret of f> }
+// with copies of all nodes and variable declarations of the body, so
+// the parameters are bound to the arguments and the value of the block
+// is the returned value. Calls in the inlined bodies are inlined as
+// well, recursive calls never.
+// The cost model counts the ast nodes a call adds: callees larger than
+// maxSize are never inlined and the nodes added to a function must stay
+// within its budget, a hard limit on how much it can grow.
+// New nodes are created in the given arena.
+class Inliner {
+public:
+	struct Limits {
+		unsigned maxSize {64}; // nodes in the callee body
+		unsigned budget {512}; // nodes added per function
+		unsigned depth {4}; // of calls in inlined bodies
+	};
+
+	struct Stats {
+		unsigned inlined {}; // replaced calls
+		unsigned rejected {}; // calls the cost model kept
+		unsigned added {}; // nodes
+	};
+
+public:
+	explicit Inliner(Arena& arena) : arena_(arena) {}
+	Inliner(Arena& arena, Limits limits) : arena_(arena), limits_(limits) {}
+
+	void run(Function& func);
+	void run(Module& mod);
+
+	const Stats& stats() const { return stats_; }
+
+	// Number of nodes in the tree
+	static unsigned size(Node& node);
+
+private:
+	class Rewriter;
+	class Cloner;
+
+	// Returns the block replacing the call, null if it is kept.
+	// The parent is the block the call is in.
+	CodeBlock* expand(FunctionCall& call, CodeBlock* parent);
+
+	Arena& arena_;
+	Limits limits_ {};
+	Stats stats_;
+	unsigned budget_ {}; // left for the current function
+	std::vector<const Function*> stack_; // the function and inlined callees
+};
+
+} // namespace ast
@@ -0,0 +1,464 @@
+#include "ir.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ast::ir {
+
+namespace {
+
+using BT = BuiltinType::Type;
+
+constexpr auto none = ~BlockId(0u);
+
+// Targets of the terminator
+nytl::span<const BlockId> successors(const Instruction& term) {
+	switch(term.opcode) {
+		case Opcode::jump: return {term.targets.data(), 1u};
+		case Opcode::branch: return term.targets;
+		default: return {};
+	}
+}
+
+const BuiltinType* builtin(const Type& type) {
+	return (type.category == Type::Category::primitive) ?
+		&static_cast<const BuiltinType&>(type) : nullptr;
+}
+
+std::string typeString(const Type& type) {
+	auto name = typeName(type);
+	if(!name.empty()) {
+		return std::string(name);
+	}
+
+	return (type.category == Type::Category::eEnum) ? "enum" : "function";
+}
+
+std::string valueString(ValueId id) {
+	return "%" + std::to_string(id);
+}
+
+// Type a component or member 'index' of the given type has, null if
+// there is none.
+const Type* elementType(const Type& type, unsigned index) {
+	if(type.category == Type::Category::eStruct) {
+		auto& stype = static_cast<const StructType&>(type);
+		return (index < stype.members.size()) ? stype.members[index].type : nullptr;
+	} else if(type.category != Type::Category::primitive) {
+		return nullptr;
+	}
+
+	auto& btype = static_cast<const BuiltinType&>(type);
+	if(btype.cols > 1) {
+		return (index < btype.cols) ? &BuiltinType::vecType(btype.type, btype.rows) : nullptr;
+	} else if(btype.rows > 1) {
+		return (index < btype.rows) ? &BuiltinType::vecType(btype.type, 1u) : nullptr;
+	}
+
+	return nullptr;
+}
+
+// Checks the operands of an operator, so that resultType won't assert
+bool validOperands(OpType op, const Type& a, const Type& b) {
+	if(a.category != Type::Category::primitive || b.category != Type::Category::primitive) {
+		return false;
+	}
+
+	auto& ba = static_cast<const BuiltinType&>(a);
+	auto& bb = static_cast<const BuiltinType&>(b);
+	if(ba.type != bb.type || ba.type == BT::eVoid) {
+		return false;
+	}
+
+	auto scalarA = (ba.rows == 1 && ba.cols == 1);
+	auto scalarB = (bb.rows == 1 && bb.cols == 1);
+	if(isMatrixProduct(op, ba, bb)) {
+		auto inner = (ba.cols == 1) ? ba.rows : ba.cols;
+		return inner == bb.rows;
+	}
+
+	return scalarA || scalarB || (ba.rows == bb.rows && ba.cols == bb.cols);
+}
+
+// Returns what is wrong with the operand and result types, empty if
+// they are fine.
+std::string checkTypes(const Function& func, const Instruction& inst) {
+	auto& ops = inst.operands;
+	auto type = [&](unsigned i) -> const Type& { return *func.values[ops[i]].type; };
+	auto count = [&](std::size_t n) { return ops.size() == n; };
+	auto& voidType = BuiltinType::voidType();
+	auto& boolType = BuiltinType::boolType();
+
+	if(isTerminator(inst.opcode) && inst.type != &voidType) {
+		return "Terminators have no value";
+	}
+
+	switch(inst.opcode) {
+		case Opcode::constant: {
+			auto* btype = builtin(*inst.type);
+			if(!count(0) || !btype || btype->rows != 1 || btype->cols != 1 ||
+					btype->type == BT::eVoid) {
+				return "Constants must be scalars";
+			}
+			break;
+		} case Opcode::param: {
+			auto params = func.decl->parameters();
+			if(!count(0) || inst.index >= params.size() || params[inst.index] != inst.type) {
+				return "Invalid parameter";
+			}
+			break;
+		} case Opcode::undef:
+			if(!count(0)) {
+				return "Undef has no operands";
+			}
+			break;
+		case Opcode::op:
+			if(inst.op == OpType::neg) {
+				if(!count(1) || &type(0) != inst.type) {
+					return "Negation has one operand of the result type";
+				}
+			} else if(inst.op == OpType::logicalAnd || inst.op == OpType::logicalOr) {
+				if(!count(2) || &type(0) != &boolType || &type(1) != &boolType ||
+						inst.type != &boolType) {
+					return "Logical operators work on bools";
+				}
+			} else if(!count(2) || !validOperands(inst.op, type(0), type(1))) {
+				return "Invalid operands";
+			} else if(&resultType(inst.op, type(0), type(1)) != inst.type) {
+				return "Result type doesn't match the operands";
+			}
+			break;
+		case Opcode::splat: {
+			auto* btype = builtin(*inst.type);
+			if(!count(1) || !btype || &type(0) != &BuiltinType::vecType(btype->type, 1u)) {
+				return "Splat needs a scalar of the result component type";
+			}
+			break;
+		} case Opcode::extract:
+			if(!count(1) || elementType(type(0), inst.index) != inst.type) {
+				return "Invalid extract";
+			}
+			break;
+		case Opcode::insert:
+			if(!count(2) || &type(0) != inst.type ||
+					elementType(type(0), inst.index) != &type(1)) {
+				return "Invalid insert";
+			}
+			break;
+		case Opcode::call: {
+			if(!inst.callee || &inst.callee->returnType() != inst.type) {
+				return "Invalid callee";
+			}
+
+			auto params = inst.callee->parameters();
+			if(params.size() != ops.size()) {
+				return "Wrong number of arguments";
+			}
+
+			for(auto i = 0u; i < ops.size(); ++i) {
+				if(&type(i) != params[i]) {
+					return "Argument type doesn't match the parameter";
+				}
+			}
+			break;
+		} case Opcode::phi:
+			for(auto i = 0u; i < ops.size(); ++i) {
+				if(&type(i) != inst.type) {
+					return "Phi operand has a different type";
+				}
+			}
+			break;
+		case Opcode::jump:
+			if(!count(0)) {
+				return "Jumps have no operands";
+			}
+			break;
+		case Opcode::branch:
+			if(!count(1) || &type(0) != &boolType) {
+				return "Branch condition must be a bool";
+			}
+			break;
+		case Opcode::ret: {
+			auto& ret = func.decl->returnType();
+			if(&ret == &voidType ? !count(0) : (!count(1) || &type(0) != &ret)) {
+				return "Returned value doesn't match the return type";
+			}
+			break;
+		}
+	}
+
+	return {};
+}
+
+} // anon namespace
+
+std::string_view name(Opcode opcode) {
+	switch(opcode) {
+		case Opcode::constant: return "constant";
+		case Opcode::param: return "param";
+		case Opcode::undef: return "undef";
+		case Opcode::op: return "op";
+		case Opcode::splat: return "splat";
+		case Opcode::extract: return "extract";
+		case Opcode::insert: return "insert";
+		case Opcode::call: return "call";
+		case Opcode::phi: return "phi";
+		case Opcode::jump: return "jump";
+		case Opcode::branch: return "branch";
+		case Opcode::ret: return "ret";
+	}
+
+	return "<invalid>";
+}
+
+bool isTerminator(Opcode opcode) {
+	return opcode == Opcode::jump || opcode == Opcode::branch || opcode == Opcode::ret;
+}
+
+// Whether block a dominates block b
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b) {
+	while(b != a && b != 0u) {
+		b = idom[b];
+	}
+
+	return a == b;
+}
+
+// Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm"
+std::vector<BlockId> dominators(const Function& func) {
+	auto count = func.blocks.size();
+
+	// reverse postorder
+	std::vector<BlockId> postorder;
+	std::vector<unsigned> position(count, ~0u);
+	std::vector<bool> visited(count);
+	std::vector<std::pair<BlockId, unsigned>> stack {{0u, 0u}};
+	visited[0] = true;
+	while(!stack.empty()) {
+		auto& [block, next] = stack.back();
+		auto succs = successors(func.terminator(block));
+		if(next < succs.size()) {
+			auto succ = succs[next++];
+			if(!visited[succ]) {
+				visited[succ] = true;
+				stack.push_back({succ, 0u});
+			}
+			continue;
+		}
+
+		position[block] = unsigned(postorder.size());
+		postorder.push_back(block);
+		stack.pop_back();
+	}
+
+	assert(postorder.size() == count && "Unreachable block");
+
+	// postorder positions: dominators have higher ones
+	std::vector<BlockId> idom(count, none);
+	idom[0] = 0u;
+	auto intersect = [&](BlockId a, BlockId b) {
+		while(a != b) {
+			while(position[a] < position[b]) {
+				a = idom[a];
+			}
+			while(position[b] < position[a]) {
+				b = idom[b];
+			}
+		}
+		return a;
+	};
+
+	auto changed = true;
+	while(changed) {
+		changed = false;
+		for(auto it = postorder.rbegin(); it != postorder.rend(); ++it) {
+			auto block = *it;
+			if(block == 0u) {
+				continue;
+			}
+
+			auto dom = none;
+			for(auto pred : func.blocks[block].preds) {
+				if(idom[pred] != none) {
+					dom = (dom == none) ? pred : intersect(pred, dom);
+				}
+			}
+
+			if(idom[block] != dom) {
+				idom[block] = dom;
+				changed = true;
+			}
+		}
+	}
+
+	return idom;
+}
+
+std::string verify(const Function& func) {
+	auto& blocks = func.blocks;
+	auto& values = func.values;
+	if(blocks.empty()) {
+		return "Function has no blocks";
+	}
+
+	// structure
+	std::vector<BlockId> defBlock(values.size(), none);
+	std::vector<unsigned> defPos(values.size());
+	for(auto b = 0u; b < blocks.size(); ++b) {
+		auto& code = blocks[b].code;
+		auto where = "b" + std::to_string(b) + ": ";
+		if(code.empty()) {
+			return where + "Block is empty";
+		}
+
+		for(auto pos = 0u; pos < code.size(); ++pos) {
+			auto id = code[pos];
+			if(id >= values.size()) {
+				return where + "Invalid value " + valueString(id);
+			} else if(defBlock[id] != none) {
+				return where + valueString(id) + " is defined twice";
+			}
+
+			defBlock[id] = b;
+			defPos[id] = pos;
+			auto opcode = values[id].opcode;
+			if(isTerminator(opcode) != (pos + 1 == code.size())) {
+				return where + "Blocks must end with exactly one terminator";
+			} else if(opcode == Opcode::phi && pos > 0 &&
+					values[code[pos - 1]].opcode != Opcode::phi) {
+				return where + "Phis must be at the start of the block";
+			}
+		}
+	}
+
+	// edges
+	std::vector<std::vector<BlockId>> preds(blocks.size());
+	for(auto b = 0u; b < blocks.size(); ++b) {
+		for(auto succ : successors(func.terminator(b))) {
+			if(succ >= blocks.size() || succ == 0u) {
+				return "b" + std::to_string(b) + ": Invalid branch target";
+			}
+			preds[succ].push_back(b);
+		}
+	}
+
+	for(auto b = 0u; b < blocks.size(); ++b) {
+		auto expected = blocks[b].preds;
+		std::sort(expected.begin(), expected.end());
+		if(expected != preds[b]) {
+			return "b" + std::to_string(b) + ": Predecessors don't match the branches";
+		} else if(b > 0u && preds[b].empty()) {
+			return "b" + std::to_string(b) + ": Block is unreachable";
+		}
+	}
+
+	// operands
+	auto idom = dominators(func);
+	for(auto b = 0u; b < blocks.size(); ++b) {
+		auto& code = blocks[b].code;
+		for(auto pos = 0u; pos < code.size(); ++pos) {
+			auto id = code[pos];
+			auto& inst = values[id];
+			auto where = valueString(id) + ": ";
+			if(inst.opcode == Opcode::phi && inst.operands.size() != blocks[b].preds.size()) {
+				return where + "Phi needs one operand per predecessor";
+			}
+
+			for(auto i = 0u; i < inst.operands.size(); ++i) {
+				auto op = inst.operands[i];
+				if(op >= values.size() || defBlock[op] == none) {
+					return where + "Operand " + valueString(op) + " is not defined";
+				}
+
+				// phi operands must be available at the end of their predecessor
+				auto dominated = (inst.opcode == Opcode::phi) ?
+					dominates(idom, defBlock[op], blocks[b].preds[i]) :
+					(defBlock[op] == b) ? defPos[op] < pos : dominates(idom, defBlock[op], b);
+				if(!dominated) {
+					return where + "Operand " + valueString(op) + " doesn't dominate its use";
+				}
+			}
+
+			auto error = checkTypes(func, inst);
+			if(!error.empty()) {
+				return where + error;
+			}
+		}
+	}
+
+	return {};
+}
+
+void write(Printer& p, const Function& func) {
+	p << typeString(func.decl->returnType()) << " " << func.decl->name() << "(";
+	auto params = func.decl->parameters();
+	for(auto i = 0u; i < params.size(); ++i) {
+		p << (i ? ", " : "") << typeString(*params[i]);
+	}
+	p << ") {";
+
+	for(auto b = 0u; b < func.blocks.size(); ++b) {
+		auto& block = func.blocks[b];
+		p.newline();
+		p << "b" << b << ":";
+		if(!block.preds.empty()) {
+			p << " ; preds";
+			for(auto pred : block.preds) {
+				p << " b" << pred;
+			}
+		}
+
+		p.indent();
+		for(auto id : block.code) {
+			auto& inst = func.values[id];
+			p.newline();
+			if(!isTerminator(inst.opcode)) {
+				p << valueString(id) << " = ";
+			}
+
+			p << name(inst.opcode);
+			if(!isTerminator(inst.opcode)) {
+				p << " " << typeString(*inst.type);
+			}
+
+			switch(inst.opcode) {
+				case Opcode::constant:
+					switch(static_cast<const BuiltinType&>(*inst.type).type) {
+						case BT::f32: p << " " << inst.value.f; break;
+						case BT::f64: p << " " << inst.value.d; break;
+						case BT::i32: p << " " << inst.value.i; break;
+						case BT::u32: p << " " << inst.value.u; break;
+						case BT::eBool: p << (inst.value.b ? " true" : " false"); break;
+						default: break;
+					}
+					break;
+				case Opcode::param: p << " " << inst.index; break;
+				case Opcode::op: p << " " << OpExpression::name(inst.op); break;
+				case Opcode::call: p << " " << inst.callee->name(); break;
+				default: break;
+			}
+
+			for(auto i = 0u; i < inst.operands.size(); ++i) {
+				p << (i ? ", " : " ") << valueString(inst.operands[i]);
+				if(inst.opcode == Opcode::phi) {
+					p << " from b" << block.preds[i];
+				}
+			}
+
+			if(inst.opcode == Opcode::extract || inst.opcode == Opcode::insert) {
+				p << ", " << inst.index;
+			}
+
+			for(auto target : successors(inst)) {
+				p << (inst.opcode == Opcode::branch ? ", b" : " b") << target;
+			}
+		}
+		p.unindent();
+	}
+
+	p.newline();
+	p << "}";
+}
+
+} // namespace ast::ir
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ast.hpp"
+#include "fold.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SSA intermediate representation for optimizations and backends.
+// A function is a list of basic blocks, each a list of typed
+// instructions that end with exactly one terminator. Every value is
+// defined by exactly one instruction and never changes, assignments
+// in the ast create new values and where control flow joins, phi
+// instructions select the value of the path that was taken.
+// Values and blocks are referenced by index into the function, result
+// types are the canonical ast types (see types.hpp).
+namespace ast::ir {
+
+using ValueId = std::uint32_t;
+using BlockId = std::uint32_t;
+
+enum class Opcode : std::uint8_t {
+	constant, // scalar 'value'
+	param, // parameter 'index'
+	undef, // any value, e.g. of an if without else
+	op, // operator 'op' on the operands, semantics of ast::evaluate
+	splat, // the scalar operand broadcast to the result type
+	extract, // member or column 'index' of operand 0
+	insert, // operand 0 with member 'index' replaced by operand 1
+	call, // calls 'callee' with the operands as arguments
+	phi, // operand i is the value from predecessor i of the block
+
+	// terminators, the last instruction of every block
+	jump, // to targets[0]
+	branch, // operand 0 ? targets[0] : targets[1]
+	ret, // returns operand 0, no operand for void functions
+};
+
+std::string_view name(Opcode opcode);
+bool isTerminator(Opcode opcode);
+
+struct Instruction {
+	Opcode opcode;
+	const Type* type; // void for terminators
+	std::vector<ValueId> operands {};
+	OpType op {}; // for op
+	unsigned index {}; // for param, extract and insert
+	Constant::Component value {}; // for constant
+	const Callable* callee {}; // for call
+	std::array<BlockId, 2> targets {}; // for jump and branch
+};
+
+struct Block {
+	// Phis first, the terminator last
+	std::vector<ValueId> code;
+	// In the order of the phi operands
+	std::vector<BlockId> preds;
+};
+
+struct Function {
+	const ast::Function* decl {};
+	std::vector<Instruction> values; // by ValueId
+	std::vector<Block> blocks; // by BlockId, the first one is the entry
+
+	// Terminator of the block
+	const Instruction& terminator(BlockId block) const {
+		return values[blocks[block].code.back()];
+	}
+};
+
+// Builds the ir of the function. There are no loops, so blocks are in
+// an order where every block comes after its predecessors.
+Function lower(const ast::Function& func);
+
+// Immediate dominator of every block, the entry is its own dominator.
+// All blocks must be reachable.
+std::vector<BlockId> dominators(const Function& func);
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b);
+
+// Checks that the function is well formed: block structure, that
+// predecessors match the terminators, operand and result types and
+// that every use is dominated by its definition.
+// Returns the first problem found, an empty string if there is none.
+std::string verify(const Function& func);
+
+// Global value numbering: removes instructions that compute a value
+// that is already available, i.e. the same operation on the same
+// operands in a dominating block. Values never change in ssa form, so
+// assignments in the ast are respected without tracking them here.
+// Phis that select the same value on every path are removed as well,
+// members extracted from an inserted value are forwarded.
+// The blocks must come after their predecessors, as lower creates them.
+// Returns the number of removed instructions.
+unsigned removeRedundant(Function& func);
+
+void write(Printer& p, const Function& func);
+
+} // namespace ast::ir
@@ -0,0 +1,317 @@
+#pragma once
+
+// Header-only math library for the C++ code generated from isl modules,
+// see cppgen.hpp. Has a type for every builtin isl type and a function
+// for every operator, with the semantics of the vm: integers wrap
+// around, integer division by zero results in 0 and shift amounts are
+// taken modulo 32. Scalars are broadcast, matrices are column major.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace isl {
+
+using i32 = std::int32_t;
+using u32 = std::uint32_t;
+using f32 = float;
+using f64 = double;
+
+// R rows and C columns, vectors are single columns
+template<typename T, unsigned R, unsigned C = 1>
+struct mat {
+	std::array<T, R * C> v {};
+
+	mat() = default;
+	explicit mat(T scalar) { v.fill(scalar); }
+
+	// All components, column by column
+	template<typename... Ts, typename = std::enable_if_t<
+		(sizeof...(Ts) == R * C) && (sizeof...(Ts) > 1)>>
+	mat(Ts... components) : v{T(components)...} {}
+
+	T& operator[](unsigned i) { return v[i]; }
+	const T& operator[](unsigned i) const { return v[i]; }
+};
+
+template<typename T, unsigned N>
+using vec = mat<T, N, 1>;
+
+using vec2 = vec<f32, 2>;
+using vec3 = vec<f32, 3>;
+using vec4 = vec<f32, 4>;
+using dvec2 = vec<f64, 2>;
+using dvec3 = vec<f64, 3>;
+using dvec4 = vec<f64, 4>;
+using ivec2 = vec<i32, 2>;
+using ivec3 = vec<i32, 3>;
+using ivec4 = vec<i32, 4>;
+using uvec2 = vec<u32, 2>;
+using uvec3 = vec<u32, 3>;
+using uvec4 = vec<u32, 4>;
+using bvec2 = vec<bool, 2>;
+using bvec3 = vec<bool, 3>;
+using bvec4 = vec<bool, 4>;
+
+// matCxR has C columns and R rows
+using mat2 = mat<f32, 2, 2>;
+using mat3 = mat<f32, 3, 3>;
+using mat4 = mat<f32, 4, 4>;
+using mat2x2 = mat<f32, 2, 2>;
+using mat2x3 = mat<f32, 3, 2>;
+using mat2x4 = mat<f32, 4, 2>;
+using mat3x2 = mat<f32, 2, 3>;
+using mat3x3 = mat<f32, 3, 3>;
+using mat3x4 = mat<f32, 4, 3>;
+using mat4x2 = mat<f32, 2, 4>;
+using mat4x3 = mat<f32, 3, 4>;
+using mat4x4 = mat<f32, 4, 4>;
+using dmat2 = mat<f64, 2, 2>;
+using dmat3 = mat<f64, 3, 3>;
+using dmat4 = mat<f64, 4, 4>;
+using dmat2x2 = mat<f64, 2, 2>;
+using dmat2x3 = mat<f64, 3, 2>;
+using dmat2x4 = mat<f64, 4, 2>;
+using dmat3x2 = mat<f64, 2, 3>;
+using dmat3x3 = mat<f64, 3, 3>;
+using dmat3x4 = mat<f64, 4, 3>;
+using dmat4x2 = mat<f64, 2, 4>;
+using dmat4x3 = mat<f64, 3, 4>;
+using dmat4x4 = mat<f64, 4, 4>;
+
+namespace detail {
+
+template<typename T>
+struct Traits {
+	static constexpr bool isMat = false;
+	static constexpr unsigned cols = 1;
+};
+
+template<typename T, unsigned R, unsigned C>
+struct Traits<mat<T, R, C>> {
+	static constexpr bool isMat = true;
+	static constexpr unsigned cols = C;
+};
+
+template<typename A>
+constexpr bool isMat = Traits<A>::isMat;
+
+template<typename A>
+auto component(const A& a, unsigned i) {
+	if constexpr(isMat<A>) {
+		return a.v[i];
+	} else {
+		(void) i;
+		return a;
+	}
+}
+
+// Applies f to all components of the operands, scalars are broadcast.
+template<typename A, typename B, typename F>
+auto zip(const A& a, const B& b, F&& f) {
+	if constexpr(!isMat<A> && !isMat<B>) {
+		return f(a, b);
+	} else {
+		static_assert(!isMat<A> || !isMat<B> || std::is_same_v<A, B>,
+			"Operands have different dimensions");
+		using Shape = std::conditional_t<isMat<A>, A, B>;
+		using Result = decltype(f(component(a, 0u), component(b, 0u)));
+		mat<Result, Shape().v.size() / Traits<Shape>::cols, Traits<Shape>::cols> ret;
+		for(auto i = 0u; i < ret.v.size(); ++i) {
+			ret.v[i] = f(component(a, i), component(b, i));
+		}
+		return ret;
+	}
+}
+
+template<typename T> T add(T a, T b) {
+	if constexpr(std::is_same_v<T, i32>) {
+		return i32(u32(a) + u32(b));
+	} else {
+		return a + b;
+	}
+}
+
+template<typename T> T sub(T a, T b) {
+	if constexpr(std::is_same_v<T, i32>) {
+		return i32(u32(a) - u32(b));
+	} else {
+		return a - b;
+	}
+}
+
+template<typename T> T mul(T a, T b) {
+	if constexpr(std::is_same_v<T, i32>) {
+		return i32(u32(a) * u32(b));
+	} else {
+		return a * b;
+	}
+}
+
+template<typename T> T div(T a, T b) {
+	if constexpr(std::is_same_v<T, i32>) {
+		constexpr auto min = std::numeric_limits<i32>::min();
+		return !b ? 0 : (a == min && b == -1) ? min : a / b;
+	} else if constexpr(std::is_same_v<T, u32>) {
+		return b ? a / b : 0u;
+	} else {
+		return a / b;
+	}
+}
+
+template<typename T> T mod(T a, T b) {
+	if constexpr(std::is_same_v<T, i32>) {
+		constexpr auto min = std::numeric_limits<i32>::min();
+		return (!b || (a == min && b == -1)) ? 0 : a % b;
+	} else if constexpr(std::is_same_v<T, u32>) {
+		return b ? a % b : 0u;
+	} else {
+		return std::fmod(a, b);
+	}
+}
+
+template<typename T> T neg(T a) {
+	if constexpr(std::is_same_v<T, i32>) {
+		return i32(0u - u32(a));
+	} else {
+		return -a;
+	}
+}
+
+template<typename T> T shiftLeft(T a, T b) {
+	return T(u32(a) << (u32(b) & 31u));
+}
+
+template<typename T> T shiftRight(T a, T b) {
+	auto shift = u32(b) & 31u;
+	if constexpr(std::is_same_v<T, i32>) {
+		// arithmetic
+		return a < 0 ? ~i32(~u32(a) >> shift) : i32(u32(a) >> shift);
+	} else {
+		return a >> shift;
+	}
+}
+
+template<typename T, unsigned R, unsigned K, unsigned C>
+mat<T, R, C> product(const mat<T, R, K>& a, const mat<T, K, C>& b) {
+	mat<T, R, C> ret;
+	for(auto c = 0u; c < C; ++c) {
+		for(auto r = 0u; r < R; ++r) {
+			T sum {};
+			for(auto k = 0u; k < K; ++k) {
+				sum += a.v[k * R + r] * b.v[c * K + k];
+			}
+			ret.v[c * R + r] = sum;
+		}
+	}
+	return ret;
+}
+
+// vectors on the left side are rows
+template<typename T, unsigned K, unsigned C>
+vec<T, C> product(const vec<T, K>& a, const mat<T, K, C>& b) {
+	vec<T, C> ret;
+	for(auto c = 0u; c < C; ++c) {
+		T sum {};
+		for(auto k = 0u; k < K; ++k) {
+			sum += a.v[k] * b.v[c * K + k];
+		}
+		ret.v[c] = sum;
+	}
+	return ret;
+}
+
+} // namespace detail
+
+template<typename A, typename B>
+auto add(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::add(x, y); });
+}
+
+template<typename A, typename B>
+auto sub(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::sub(x, y); });
+}
+
+// Matrix product if neither operand is a scalar and one is a matrix
+template<typename A, typename B>
+auto mul(const A& a, const B& b) {
+	using detail::Traits;
+	if constexpr(Traits<A>::isMat && Traits<B>::isMat &&
+			(Traits<A>::cols > 1 || Traits<B>::cols > 1)) {
+		return detail::product(a, b);
+	} else {
+		return detail::zip(a, b, [](auto x, auto y) { return detail::mul(x, y); });
+	}
+}
+
+template<typename A, typename B>
+auto div(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::div(x, y); });
+}
+
+template<typename A, typename B>
+auto mod(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::mod(x, y); });
+}
+
+template<typename A>
+auto neg(const A& a) {
+	return detail::zip(a, a, [](auto x, auto) { return detail::neg(x); });
+}
+
+template<typename A, typename B>
+auto bitAnd(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return decltype(x)(x & y); });
+}
+
+template<typename A, typename B>
+auto bitOr(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return decltype(x)(x | y); });
+}
+
+template<typename A, typename B>
+auto bitXor(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return decltype(x)(x ^ y); });
+}
+
+template<typename A, typename B>
+auto shiftLeft(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::shiftLeft(x, y); });
+}
+
+template<typename A, typename B>
+auto shiftRight(const A& a, const B& b) {
+	return detail::zip(a, b, [](auto x, auto y) { return detail::shiftRight(x, y); });
+}
+
+// Vectors and matrices compare as a whole
+template<typename A, typename B>
+bool eq(const A& a, const B& b) {
+	auto equal = detail::zip(a, b, [](auto x, auto y) { return x == y; });
+	if constexpr(detail::isMat<decltype(equal)>) {
+		for(auto e : equal.v) {
+			if(!e) {
+				return false;
+			}
+		}
+		return true;
+	} else {
+		return equal;
+	}
+}
+
+template<typename A, typename B>
+bool neq(const A& a, const B& b) {
+	return !eq(a, b);
+}
+
+// Scalars only
+template<typename T> bool less(T a, T b) { return a < b; }
+template<typename T> bool lessEq(T a, T b) { return a <= b; }
+template<typename T> bool greater(T a, T b) { return a > b; }
+template<typename T> bool greaterEq(T a, T b) { return a >= b; }
+
+} // namespace isl
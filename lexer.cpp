@@ -0,0 +1,134 @@
+#include "lexer.hpp"
+#include <array>
+
+namespace lex {
+
+namespace {
+
+struct Keyword {
+	std::string_view name;
+	TokenKind kind;
+};
+
+// Sorted by first character
+constexpr std::array<Keyword, 9> keywords = {{
+	{"else", TokenKind::kwElse},
+	{"enum", TokenKind::kwEnum},
+	{"false", TokenKind::kwFalse},
+	{"if", TokenKind::kwIf},
+	{"import", TokenKind::kwImport},
+	{"namespace", TokenKind::kwNamespace},
+	{"struct", TokenKind::kwStruct},
+	{"true", TokenKind::kwTrue},
+	{"using", TokenKind::kwUsing},
+}};
+
+// For each lowercase first character the range of keywords
+// starting with it.
+struct KeywordRange {
+	std::uint8_t begin;
+	std::uint8_t end;
+};
+
+constexpr std::array<KeywordRange, 26> initKeywordTable() {
+	std::array<KeywordRange, 26> ret {};
+	for(auto i = 0u; i < keywords.size(); ++i) {
+		auto& range = ret[keywords[i].name[0] - 'a'];
+		if(range.begin == range.end) {
+			range.begin = i;
+		}
+		range.end = i + 1;
+	}
+	return ret;
+}
+
+constexpr auto keywordTable = initKeywordTable();
+
+bool isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+bool isIdentifierFirst(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool isIdentifierOther(char c) {
+	return isIdentifierFirst(c) || isDigit(c);
+}
+
+} // anon namespace
+
+TokenKind keywordKind(std::string_view word) {
+	if(word.empty() || word[0] < 'a' || word[0] > 'z') {
+		return TokenKind::identifier;
+	}
+
+	auto range = keywordTable[word[0] - 'a'];
+	for(auto i = range.begin; i < range.end; ++i) {
+		if(keywords[i].name == word) {
+			return keywords[i].kind;
+		}
+	}
+
+	return TokenKind::identifier;
+}
+
+std::vector<Token> tokenize(std::string_view src) {
+	std::vector<Token> ret;
+	ret.reserve(src.size() / 4);
+
+	auto add = [&](std::size_t begin, std::size_t end, TokenKind kind) {
+		ret.push_back({std::uint32_t(begin), std::uint32_t(end - begin), kind});
+	};
+
+	auto i = std::size_t(0);
+	while(i < src.size()) {
+		auto c = src[i];
+		auto next = (i + 1 < src.size()) ? src[i + 1] : '\0';
+
+		if(isSpace(c)) {
+			++i;
+		} else if(c == '#' || (c == '/' && next == '/')) {
+			// line comment, see syn::LineComment
+			auto end = src.find('\n', i);
+			i = (end == src.npos) ? src.size() : end + 1;
+		} else if(c == '/' && next == '*') {
+			// inline comment, see syn::InlineComment
+			auto end = src.find("*/", i + 2);
+			if(end == src.npos) {
+				// unterminated, the grammar won't see a comment here either
+				add(i, i + 1, TokenKind::punctuation);
+				++i;
+			} else {
+				i = end + 2;
+			}
+		} else if(isIdentifierFirst(c)) {
+			auto end = i + 1;
+			while(end < src.size() && isIdentifierOther(src[end])) {
+				++end;
+			}
+
+			add(i, end, keywordKind(src.substr(i, end - i)));
+			i = end;
+		} else if(isDigit(c)) {
+			auto end = i + 1;
+			while(end < src.size() && isDigit(src[end])) {
+				++end;
+			}
+
+			add(i, end, TokenKind::number);
+			i = end;
+		} else {
+			add(i, i + 1, TokenKind::punctuation);
+			++i;
+		}
+	}
+
+	return ret;
+}
+
+} // namespace lex
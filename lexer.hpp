@@ -0,0 +1,162 @@
+#pragma once
+
+#include "tao/pegtl.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace lex {
+
+namespace pegtl = tao::pegtl;
+
+enum class TokenKind : std::uint8_t {
+	identifier,
+	number, // just the digits, suffixes and '.' are separate tokens
+	punctuation, // single byte
+
+	// keywords
+	kwTrue,
+	kwFalse,
+	kwIf,
+	kwElse,
+	kwEnum,
+	kwStruct,
+	kwUsing,
+	kwNamespace,
+	kwImport,
+};
+
+inline bool isKeyword(TokenKind kind) {
+	return kind >= TokenKind::kwTrue;
+}
+
+// Whitespace and comments don't produce tokens, they are just the
+// gaps between them.
+struct Token {
+	std::uint32_t offset;
+	std::uint32_t length;
+	TokenKind kind;
+};
+
+// Returns the keyword kind for the given word or TokenKind::identifier
+// if it isn't a keyword.
+TokenKind keywordKind(std::string_view word);
+
+// Splits the given source into tokens. Never fails, characters the
+// grammar doesn't know are simply returned as punctuation tokens.
+std::vector<Token> tokenize(std::string_view source);
+
+// PEGTL input that tokenizes the source once up front.
+// The token-aware rules in syntax.hpp use the token array to skip
+// separators and to match identifiers and keywords without re-scanning
+// characters, all other rules work on the characters as usual.
+// Uses lazy position tracking since skipping separators would otherwise
+// still have to count the lines in them.
+class TokenInput : public pegtl::memory_input<pegtl::tracking_mode::lazy> {
+public:
+	using Base = pegtl::memory_input<pegtl::tracking_mode::lazy>;
+
+	template<typename Source>
+	TokenInput(std::string_view source, Source&& name) :
+			Base(source.data(), source.data() + source.size(), std::forward<Source>(name)),
+			base_(source.data()), size_(source.size()), tokens_(tokenize(source)) {
+	}
+
+	const std::vector<Token>& tokens() const { return tokens_; }
+
+	// Skips all whitespace and comments at the current position.
+	// Returns whether anything was skipped.
+	bool skipSeparators() {
+		auto off = currentOffset();
+		auto i = lowerBound(off);
+		if(i > 0) {
+			// current position is inside a token, nothing to skip
+			auto& prev = tokens_[i - 1];
+			if(prev.offset + prev.length > off) {
+				return false;
+			}
+		}
+
+		auto next = (i < tokens_.size()) ? tokens_[i].offset : size_;
+		if(next == off) {
+			return false;
+		}
+
+		this->bump(next - off);
+		return true;
+	}
+
+	// Consumes the token starting at the current position if it has
+	// the given kind.
+	bool matchToken(TokenKind kind) {
+		auto* tok = tokenHere();
+		if(!tok || tok->kind != kind) {
+			return false;
+		}
+
+		this->bump(tok->length);
+		return true;
+	}
+
+	// Consumes the token starting at the current position if it is an
+	// identifier. Keywords are not identifiers.
+	bool matchWord() {
+		auto* tok = tokenHere();
+		if(!tok || tok->kind != TokenKind::identifier) {
+			return false;
+		}
+
+		this->bump(tok->length);
+		return true;
+	}
+
+private:
+	std::uint32_t currentOffset() const {
+		return std::uint32_t(Base::current() - base_);
+	}
+
+	// Returns the token starting exactly at the current position.
+	const Token* tokenHere() const {
+		auto off = currentOffset();
+		auto i = lowerBound(off);
+		if(i == tokens_.size() || tokens_[i].offset != off) {
+			return nullptr;
+		}
+
+		return &tokens_[i];
+	}
+
+	// Index of the first token with an offset >= off.
+	std::size_t lowerBound(std::uint32_t off) const {
+		// Parsing moves forward token by token almost all the time,
+		// so the last result or its successor are usually right.
+		auto matches = [&](std::size_t i) {
+			return (i == tokens_.size() || tokens_[i].offset >= off) &&
+				(i == 0 || tokens_[i - 1].offset < off);
+		};
+
+		if(matches(cursor_)) {
+			return cursor_;
+		} else if(cursor_ < tokens_.size() && matches(cursor_ + 1)) {
+			return ++cursor_;
+		}
+
+		auto it = std::lower_bound(tokens_.begin(), tokens_.end(), off,
+			[](const Token& tok, std::uint32_t o) { return tok.offset < o; });
+		cursor_ = it - tokens_.begin();
+		return cursor_;
+	}
+
+	const char* base_;
+	std::uint32_t size_;
+	std::vector<Token> tokens_;
+	mutable std::size_t cursor_ {};
+};
+
+template<typename T>
+constexpr bool isTokenInput = std::is_base_of_v<TokenInput, std::decay_t<T>>;
+
+} // namespace lex
@@ -0,0 +1,316 @@
+#include "ir.hpp"
+#include "types.hpp"
+
+#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ast::ir {
+
+namespace {
+
+constexpr auto noValue = ~ValueId(0u);
+
+// Current value of every variable in scope
+using Variables = std::unordered_map<const VariableDeclaration*, ValueId>;
+
+// Builds the ssa form directly while walking the ast: there are no
+// loops, so the value of a variable is always known when it is used
+// and phis are only needed where the branches of an if (or a short
+// circuiting operator) join.
+// Blocks are created when they are entered, after all blocks that
+// branch to them, the targets of a branch are set once the blocks exist.
+class Lowering {
+public:
+	Lowering(const ast::Function& decl);
+	Function finish() { return std::move(func_); }
+
+private:
+	ValueId emit(Opcode opcode, const Type& type, std::vector<ValueId> operands = {});
+	const Type& type(ValueId value) const { return *func_.values[value].type; }
+
+	BlockId block();
+	void link(BlockId from, unsigned slot, BlockId target);
+	void join(const Variables& first, const Variables& second);
+	ValueId phi(const Type& type, ValueId first, ValueId second);
+
+	void declare(const VariableDeclaration& var, ValueId value);
+	void statement(const Statement& stmt);
+	void assign(const Expression& target, ValueId value);
+	ValueId body(const CodeBlock& block, const Type& type);
+	ValueId expr(const Expression& expr);
+	ValueId ifExpr(const IfExpression& expr, unsigned branch, const Type& type);
+	ValueId logical(const OpExpression& expr);
+	ValueId convert(ValueId value, const Type& type);
+
+private:
+	Function func_;
+	BlockId current_ {};
+	Variables vars_;
+	// in declaration order, so phis are created deterministically
+	std::vector<const VariableDeclaration*> declared_;
+	std::unordered_set<const Expression*> assigning_;
+};
+
+Lowering::Lowering(const ast::Function& decl) {
+	assert(decl.code && "Function has no body");
+	func_.decl = &decl;
+	markAssigning(*decl.code, assigning_);
+
+	current_ = block();
+	for(auto i = 0u; i < decl.params.size(); ++i) {
+		auto param = emit(Opcode::param, *decl.paramTypes[i]);
+		func_.values[param].index = i;
+		declare(*decl.params[i], param);
+	}
+
+	auto& retType = decl.returnType();
+	auto value = body(*decl.code, retType);
+	if(value == noValue) {
+		emit(Opcode::ret, BuiltinType::voidType());
+	} else {
+		emit(Opcode::ret, BuiltinType::voidType(), {value});
+	}
+}
+
+ValueId Lowering::emit(Opcode opcode, const Type& type, std::vector<ValueId> operands) {
+	auto id = ValueId(func_.values.size());
+	func_.values.push_back({opcode, &type, std::move(operands)});
+	func_.blocks[current_].code.push_back(id);
+	return id;
+}
+
+BlockId Lowering::block() {
+	func_.blocks.emplace_back();
+	return BlockId(func_.blocks.size() - 1u);
+}
+
+// Sets a target of the terminator of the block
+void Lowering::link(BlockId from, unsigned slot, BlockId target) {
+	func_.values[func_.blocks[from].code.back()].targets[slot] = target;
+	func_.blocks[target].preds.push_back(from);
+}
+
+// Variables that were changed on one of the two paths get a phi.
+// Must be called at the start of a block with two predecessors,
+// first and second are the variables at their ends.
+void Lowering::join(const Variables& first, const Variables& second) {
+	vars_ = second;
+	for(auto* var : declared_) {
+		auto a = first.at(var);
+		auto b = second.at(var);
+		if(a != b) {
+			vars_[var] = phi(*var->type, a, b);
+		}
+	}
+}
+
+ValueId Lowering::phi(const Type& type, ValueId first, ValueId second) {
+	assert(func_.blocks[current_].preds.size() == 2u);
+	return emit(Opcode::phi, type, {first, second});
+}
+
+void Lowering::declare(const VariableDeclaration& var, ValueId value) {
+	vars_[&var] = value;
+	declared_.push_back(&var);
+}
+
+void Lowering::statement(const Statement& stmt) {
+	if(auto* decl = dynamic_cast<const DeclarationStatement*>(&stmt)) {
+		auto& var = *decl->decl;
+		declare(var, convert(expr(*var.init), *var.type));
+	} else if(auto* assignment = dynamic_cast<const AssignStatement*>(&stmt)) {
+		assign(*assignment->left(), expr(*assignment->right()));
+	} else if(auto* exprStmt = dynamic_cast<const ExpressionStatement*>(&stmt)) {
+		expr(*exprStmt->expr);
+	} else {
+		assert(!"Invalid statement");
+	}
+}
+
+// Assigning a member creates a new value of the whole variable
+void Lowering::assign(const Expression& target, ValueId value) {
+	if(auto* ident = dynamic_cast<const IdentifierExpression*>(&target)) {
+		vars_[ident->decl] = convert(value, *ident->decl->type);
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&target)) {
+		auto base = expr(*access->accessed);
+		auto& stype = static_cast<const StructType&>(type(base));
+		auto member = convert(value, *access->accessor->type);
+		auto inserted = emit(Opcode::insert, stype, {base, member});
+		func_.values[inserted].index = stype.slot(*access->accessor);
+		assign(*access->accessed, inserted);
+	} else {
+		assert(!"Can only assign to variables and their members");
+	}
+}
+
+ValueId Lowering::body(const CodeBlock& block, const Type& t) {
+	auto scope = declared_.size();
+	for(auto* stmt : block.statements) {
+		statement(*stmt);
+	}
+
+	auto value = noValue;
+	if(block.ret) {
+		value = expr(*block.ret);
+	}
+
+	declared_.resize(scope);
+	if(&t == &BuiltinType::voidType()) {
+		return noValue;
+	} else if(value == noValue) {
+		return emit(Opcode::undef, t);
+	}
+
+	return convert(value, t);
+}
+
+ValueId Lowering::expr(const Expression& e) {
+	if(auto* lit = dynamic_cast<const Literal*>(&e)) {
+		auto value = ast::constant(*lit);
+		auto id = emit(Opcode::constant, *value.type);
+		func_.values[id].value = value.values[0];
+		return id;
+	} else if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+		auto it = vars_.find(ident->decl);
+		assert(it != vars_.end() && "Variable not known");
+		return it->second;
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+		auto base = expr(*access->accessed);
+		auto& stype = static_cast<const StructType&>(type(base));
+		auto id = emit(Opcode::extract, *access->accessor->type, {base});
+		func_.values[id].index = stype.slot(*access->accessor);
+		return id;
+	} else if(auto* call = dynamic_cast<const FunctionCall*>(&e)) {
+		auto params = call->called->parameters();
+		assert(params.size() == call->arguments.size());
+		std::vector<ValueId> args;
+		for(auto i = 0u; i < params.size(); ++i) {
+			args.push_back(convert(expr(*call->arguments[i]), *params[i]));
+		}
+
+		auto id = emit(Opcode::call, call->called->returnType(), std::move(args));
+		func_.values[id].callee = call->called;
+		return id;
+	} else if(auto* opExpr = dynamic_cast<const OpExpression*>(&e)) {
+		auto opType = opExpr->opType;
+		if(opType == OpType::logicalAnd || opType == OpType::logicalOr) {
+			return logical(*opExpr);
+		}
+
+		auto acc = expr(*opExpr->children[0]);
+		if(opType == OpType::neg) {
+			assert(opExpr->children.size() == 1u);
+			auto id = emit(Opcode::op, type(acc), {acc});
+			func_.values[id].op = opType;
+			return id;
+		}
+
+		for(auto i = 1u; i < opExpr->children.size(); ++i) {
+			auto rhs = expr(*opExpr->children[i]);
+			auto& t = resultType(opType, type(acc), type(rhs));
+			acc = emit(Opcode::op, t, {acc, rhs});
+			func_.values[acc].op = opType;
+		}
+		return acc;
+	} else if(auto* codeBlock = dynamic_cast<const CodeBlock*>(&e)) {
+		return body(*codeBlock, typeOf(e));
+	} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&e)) {
+		return this->ifExpr(*ifExpr, 0u, typeOf(e));
+	}
+
+	assert(!"Invalid expression");
+	return noValue;
+}
+
+// Else-if branches are lowered as nested if in the else block
+ValueId Lowering::ifExpr(const IfExpression& e, unsigned i, const Type& t) {
+	auto& branch = i ? e.elsifBranches[i - 1] : e.ifBranch;
+	auto hasElse = i < e.elsifBranches.size() || e.elseBranch;
+	auto isVoid = (&t == &BuiltinType::voidType());
+
+	auto cond = expr(*branch.condition);
+	auto otherValue = (hasElse || isVoid) ? noValue : emit(Opcode::undef, t);
+	emit(Opcode::branch, BuiltinType::voidType(), {cond});
+	auto header = current_;
+	auto before = vars_;
+
+	current_ = block();
+	link(header, 0u, current_);
+	auto thenValue = body(*branch.code, t);
+	emit(Opcode::jump, BuiltinType::voidType());
+	auto thenEnd = current_;
+	auto thenVars = std::move(vars_);
+
+	vars_ = std::move(before);
+	auto otherEnd = header;
+	if(hasElse) {
+		current_ = block();
+		link(header, 1u, current_);
+		otherValue = (i < e.elsifBranches.size()) ?
+			ifExpr(e, i + 1, t) :
+			body(*e.elseBranch, t);
+		emit(Opcode::jump, BuiltinType::voidType());
+		otherEnd = current_;
+	}
+
+	auto merge = block();
+	link(thenEnd, 0u, merge);
+	link(otherEnd, hasElse ? 0u : 1u, merge);
+	current_ = merge;
+	join(thenVars, vars_);
+	return isVoid ? noValue : phi(t, thenValue, otherValue);
+}
+
+// The operands are only branched over when they assign, otherwise they
+// are evaluated unconditionally, which has the same result.
+ValueId Lowering::logical(const OpExpression& e) {
+	auto isAnd = (e.opType == OpType::logicalAnd);
+	auto& boolType = BuiltinType::boolType();
+	auto acc = expr(*e.children[0]);
+	for(auto i = 1u; i < e.children.size(); ++i) {
+		auto& child = *e.children[i];
+		if(!assigning_.count(&child)) {
+			auto rhs = expr(child);
+			acc = emit(Opcode::op, boolType, {acc, rhs});
+			func_.values[acc].op = e.opType;
+			continue;
+		}
+
+		emit(Opcode::branch, BuiltinType::voidType(), {acc});
+		auto header = current_;
+		auto before = vars_;
+		current_ = block();
+		link(header, isAnd ? 0u : 1u, current_);
+		auto rhs = expr(child);
+		emit(Opcode::jump, BuiltinType::voidType());
+		auto rhsEnd = current_;
+
+		current_ = block();
+		link(header, isAnd ? 1u : 0u, current_);
+		link(rhsEnd, 0u, current_);
+		auto rhsVars = std::move(vars_);
+		join(before, rhsVars);
+		acc = phi(boolType, acc, rhs);
+	}
+
+	return acc;
+}
+
+// Scalars are broadcast to vectors and matrices
+ValueId Lowering::convert(ValueId value, const Type& t) {
+	if(&type(value) == &t) {
+		return value;
+	}
+
+	assert(t.category == Type::Category::primitive && "Value has a different type");
+	return emit(Opcode::splat, t, {value});
+}
+
+} // anon namespace
+
+Function lower(const ast::Function& func) {
+	return Lowering(func).finish();
+}
+
+} // namespace ast::ir
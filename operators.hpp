@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string_view>
+
+namespace ast {
+
+enum class OpType {
+	add,
+	mult,
+	sub,
+	div,
+	mod,
+
+	eq,
+	neq,
+	less,
+	lessEq,
+	greater,
+	greaterEq,
+
+	bitAnd,
+	bitOr,
+	bitXor,
+	shiftLeft,
+	shiftRight,
+
+	logicalAnd,
+	logicalOr,
+
+	neg, // unary, only one child
+};
+
+struct BinaryOperator {
+	std::string_view token;
+	OpType op;
+	unsigned precedence; // higher binds stronger
+	bool rightAssoc {false};
+};
+
+// All binary operators known to the parser. New operators only need
+// an entry here (and an OpType), the grammar doesn't change.
+// Operators sharing a prefix must list the longer one first.
+inline constexpr BinaryOperator binaryOperators[] = {
+	{"||", OpType::logicalOr, 1},
+	{"&&", OpType::logicalAnd, 2},
+	{"|", OpType::bitOr, 3},
+	{"^", OpType::bitXor, 4},
+	{"&", OpType::bitAnd, 5},
+	{"==", OpType::eq, 6},
+	{"!=", OpType::neq, 6},
+	{"<<", OpType::shiftLeft, 8},
+	{">>", OpType::shiftRight, 8},
+	{"<=", OpType::lessEq, 7},
+	{">=", OpType::greaterEq, 7},
+	{"<", OpType::less, 7},
+	{">", OpType::greater, 7},
+	{"+", OpType::add, 9},
+	{"-", OpType::sub, 9},
+	{"*", OpType::mult, 10},
+	{"/", OpType::div, 10},
+	{"%", OpType::mod, 10},
+};
+
+// Returns the binary operator at the start of src, null if there is none.
+constexpr const BinaryOperator* matchBinaryOperator(std::string_view src) {
+	for(auto& op : binaryOperators) {
+		if(src.substr(0, op.token.size()) == op.token) {
+			return &op;
+		}
+	}
+
+	return nullptr;
+}
+
+constexpr const BinaryOperator* findBinaryOperator(OpType type) {
+	for(auto& op : binaryOperators) {
+		if(op.op == type) {
+			return &op;
+		}
+	}
+
+	return nullptr;
+}
+
+// Whether the operator compares its operands, the result is a bool.
+constexpr bool isComparison(OpType op) {
+	switch(op) {
+		case OpType::eq:
+		case OpType::neq:
+		case OpType::less:
+		case OpType::lessEq:
+		case OpType::greater:
+		case OpType::greaterEq:
+			return true;
+		default:
+			return false;
+	}
+}
+
+} // namespace ast
@@ -0,0 +1,87 @@
+#include "printer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+
+namespace ast {
+
+namespace {
+
+// flush the buffer into the stream when it gets larger than this
+constexpr auto flushSize = 64u * 1024u;
+constexpr std::string_view truncated = "...";
+
+} // anon namespace
+
+Printer& Printer::operator<<(std::string_view str) {
+	if(str.empty()) {
+		return *this;
+	}
+
+	if(full()) {
+		markTruncated();
+		return *this;
+	}
+
+	if(lineStart_) {
+		lineStart_ = false;
+		for(auto i = 0u; i < depth_; ++i) {
+			append(indent_);
+		}
+	}
+
+	append(str);
+	return *this;
+}
+
+Printer& Printer::operator<<(double val) {
+	char buf[512]; // large enough for every double with %f
+	auto len = std::snprintf(buf, sizeof(buf), "%f", val);
+	return *this << std::string_view(buf, len);
+}
+
+Printer& Printer::operator<<(std::int32_t val) {
+	char buf[16];
+	auto len = std::snprintf(buf, sizeof(buf), "%d", int(val));
+	return *this << std::string_view(buf, len);
+}
+
+Printer& Printer::operator<<(std::uint32_t val) {
+	char buf[16];
+	auto len = std::snprintf(buf, sizeof(buf), "%u", unsigned(val));
+	return *this << std::string_view(buf, len);
+}
+
+void Printer::newline() {
+	*this << '\n';
+	lineStart_ = true;
+}
+
+void Printer::append(std::string_view str) {
+	auto left = limit_ - written_;
+	buffer_ += str.substr(0, left);
+	written_ += std::min(str.size(), left);
+	if(str.size() > left) {
+		markTruncated();
+	}
+
+	if(os_ && buffer_.size() >= flushSize) {
+		flush();
+	}
+}
+
+void Printer::markTruncated() {
+	if(!truncated_) {
+		buffer_ += truncated;
+		truncated_ = true;
+	}
+}
+
+void Printer::flush() {
+	if(os_ && !buffer_.empty()) {
+		os_->write(buffer_.data(), buffer_.size());
+		buffer_.clear();
+	}
+}
+
+} // namespace ast
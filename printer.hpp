@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace ast {
+
+// Output for printing the ast.
+// Everything is appended to a single buffer, nodes write their children
+// directly instead of concatenating returned strings. When created for
+// a stream, the buffer is flushed into it from time to time.
+// Output beyond the size limit is dropped and marked with "...",
+// printing code can check full() to skip whole subtrees.
+class Printer {
+public:
+	static constexpr auto noLimit = std::numeric_limits<std::size_t>::max();
+
+	explicit Printer(std::size_t limit = noLimit, std::string_view indent = "\t") :
+		limit_(limit), indent_(indent) {}
+	explicit Printer(std::ostream& os, std::size_t limit = noLimit,
+		std::string_view indent = "\t") : os_(&os), limit_(limit), indent_(indent) {}
+	~Printer() { flush(); }
+
+	Printer(const Printer&) = delete;
+	Printer& operator=(const Printer&) = delete;
+
+	Printer& operator<<(std::string_view str);
+	Printer& operator<<(char c) { return *this << std::string_view(&c, 1u); }
+	Printer& operator<<(const char* str) { return *this << std::string_view(str); }
+
+	// Same format as std::to_string
+	Printer& operator<<(double);
+	Printer& operator<<(float val) { return *this << double(val); }
+	Printer& operator<<(std::int32_t);
+	Printer& operator<<(std::uint32_t);
+	Printer& operator<<(bool val) { return *this << std::int32_t(val); }
+
+	// Ends the line, the next output is indented.
+	void newline();
+	void indent() { ++depth_; }
+	void unindent() { --depth_; }
+
+	// Whether the limit was reached.
+	bool full() const { return written_ >= limit_; }
+	// Number of bytes printed so far (including flushed ones).
+	std::size_t written() const { return written_; }
+
+	// Writes the buffer into the stream. No-op without stream.
+	void flush();
+	// Returns the printed string. Only valid without stream.
+	std::string take() { return std::move(buffer_); }
+
+private:
+	void append(std::string_view str);
+	void markTruncated();
+
+	std::ostream* os_ {};
+	std::string buffer_;
+	std::size_t written_ {};
+	std::size_t limit_;
+	std::string_view indent_;
+	unsigned depth_ {};
+	bool lineStart_ {};
+	bool truncated_ {};
+};
+
+} // namespace ast
@@ -0,0 +1,164 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace syn {
+
+namespace {
+
+thread_local RuleProfiler* currentProfiler {};
+
+// Rule names by id, shared by all profilers.
+struct RuleRegistry {
+	std::mutex mutex;
+	std::vector<std::string_view> names;
+};
+
+RuleRegistry& ruleRegistry() {
+	static RuleRegistry registry;
+	return registry;
+}
+
+std::string_view ruleName(unsigned id) {
+	auto& reg = ruleRegistry();
+	std::lock_guard lock(reg.mutex);
+	return reg.names[id];
+}
+
+double ms(RuleProfiler::Clock::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // anon namespace
+
+RuleProfiler::RuleProfiler() : previous_(currentProfiler) {
+	currentProfiler = this;
+}
+
+RuleProfiler::~RuleProfiler() {
+	currentProfiler = previous_;
+}
+
+RuleProfiler* RuleProfiler::current() {
+	return currentProfiler;
+}
+
+unsigned RuleProfiler::ruleId(std::string_view name) {
+	if(name.substr(0, 5) != "syn::") {
+		return noRule;
+	}
+
+	// the names returned by pegtl::demangle are static
+	auto& reg = ruleRegistry();
+	std::lock_guard lock(reg.mutex);
+	reg.names.push_back(name);
+	return unsigned(reg.names.size() - 1);
+}
+
+void RuleProfiler::finish(unsigned rule, const char* pos, bool success) {
+	auto now = Clock::now();
+
+	// Errors unwind the parser without calling success or failure, the
+	// frames of the rules that were aborted that way are dropped.
+	while(!frames_.empty() && frames_.back().rule != rule) {
+		frames_.pop_back();
+	}
+
+	if(frames_.empty()) {
+		return;
+	}
+
+	auto frame = frames_.back();
+	frames_.pop_back();
+
+	if(rule >= stats_.size()) {
+		stats_.resize(rule + 1);
+	}
+
+	auto& stats = stats_[rule];
+	auto inclusive = now - frame.start;
+	++stats.attempts;
+	if(success) {
+		++stats.successes;
+		stats.bytes += pos - frame.begin;
+	} else {
+		++stats.failures;
+	}
+
+	// A recursive rule would otherwise count its time multiple times
+	auto recursive = std::any_of(frames_.begin(), frames_.end(),
+		[&](auto& f) { return f.rule == rule; });
+	if(!recursive) {
+		stats.inclusive += inclusive;
+	}
+
+	stats.exclusive += inclusive - frame.children;
+	if(!frames_.empty()) {
+		frames_.back().children += inclusive;
+	}
+}
+
+std::vector<RuleProfiler::Stats> RuleProfiler::stats() const {
+	std::vector<Stats> ret;
+	for(auto i = 0u; i < stats_.size(); ++i) {
+		if(stats_[i].attempts) {
+			ret.push_back(stats_[i]);
+			ret.back().rule = ruleName(i);
+		}
+	}
+
+	std::sort(ret.begin(), ret.end(), [](auto& a, auto& b) {
+		return a.exclusive > b.exclusive;
+	});
+
+	return ret;
+}
+
+void RuleProfiler::printReport(std::ostream& os) const {
+	char buf[256];
+	std::snprintf(buf, sizeof(buf), "%10s %10s %10s %12s %12s %12s  %s\n",
+		"attempts", "success", "backtrack", "bytes", "incl ms", "excl ms", "rule");
+	os << buf;
+
+	for(auto& s : stats()) {
+		std::snprintf(buf, sizeof(buf), "%10llu %10llu %10llu %12llu %12.3f %12.3f  ",
+			(unsigned long long) s.attempts, (unsigned long long) s.successes,
+			(unsigned long long) s.failures, (unsigned long long) s.bytes,
+			ms(s.inclusive), ms(s.exclusive));
+		os << buf << s.rule << "\n";
+	}
+}
+
+void RuleProfiler::writeJson(std::ostream& os) const {
+	os << "[\n";
+	auto first = true;
+	for(auto& s : stats()) {
+		if(!first) {
+			os << ",\n";
+		}
+
+		first = false;
+		os << "\t{\"rule\": \"";
+		for(auto c : s.rule) {
+			if(c == '"' || c == '\\') {
+				os << '\\';
+			}
+			os << c;
+		}
+
+		os << "\", \"attempts\": " << s.attempts
+			<< ", \"successes\": " << s.successes
+			<< ", \"backtracks\": " << s.failures
+			<< ", \"bytes\": " << s.bytes
+			<< ", \"inclusiveMs\": " << ms(s.inclusive)
+			<< ", \"exclusiveMs\": " << ms(s.exclusive) << "}";
+	}
+
+	os << "\n]\n";
+}
+
+} // namespace syn
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "tao/pegtl.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+namespace syn {
+
+// Collects statistics per grammar rule while parsing.
+// Only rules from the syn namespace are recorded, time spent in the
+// pegtl building blocks is attributed to the enclosing syn rule.
+// A profiler is active for the thread that created it, for as long as
+// it lives. Parse with ProfileControl to feed it.
+class RuleProfiler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		std::string_view rule;
+		std::uint64_t attempts {};
+		std::uint64_t successes {};
+		std::uint64_t failures {}; // backtracked, raised errors count as neither
+		std::uint64_t bytes {}; // consumed by successful matches
+		Clock::duration inclusive {};
+		Clock::duration exclusive {};
+	};
+
+	static constexpr auto noRule = ~0u;
+
+	RuleProfiler();
+	~RuleProfiler();
+
+	RuleProfiler(const RuleProfiler&) = delete;
+	RuleProfiler& operator=(const RuleProfiler&) = delete;
+
+	// Stats of all attempted rules, sorted by exclusive time.
+	std::vector<Stats> stats() const;
+
+	void printReport(std::ostream& os) const;
+	void writeJson(std::ostream& os) const;
+
+	// Called by ProfileControl.
+	// The active profiler of the calling thread, null if there is none.
+	static RuleProfiler* current();
+	// Returns noRule for rules outside of the syn namespace.
+	static unsigned ruleId(std::string_view name);
+
+	void start(unsigned rule, const char* pos) {
+		frames_.push_back({rule, pos, Clock::now(), {}});
+	}
+
+	void finish(unsigned rule, const char* pos, bool success);
+
+private:
+	struct Frame {
+		unsigned rule;
+		const char* begin;
+		Clock::time_point start;
+		Clock::duration children;
+	};
+
+	RuleProfiler* previous_ {};
+	std::vector<Frame> frames_;
+	std::vector<Stats> stats_; // by rule id
+};
+
+template<template<typename...> class Base>
+struct ProfileControl {
+	template<typename Rule>
+	struct type : Base<Rule> {
+		static unsigned id() {
+			static const auto id = RuleProfiler::ruleId(tao::pegtl::demangle<Rule>());
+			return id;
+		}
+
+		template<typename ParseInput, typename... States>
+		static void start(const ParseInput& in, States&&... st) {
+			auto* prof = RuleProfiler::current();
+			if(prof && id() != RuleProfiler::noRule) {
+				prof->start(id(), in.current());
+			}
+
+			Base<Rule>::start(in, st...);
+		}
+
+		template<typename ParseInput, typename... States>
+		static void success(const ParseInput& in, States&&... st) {
+			auto* prof = RuleProfiler::current();
+			if(prof && id() != RuleProfiler::noRule) {
+				prof->finish(id(), in.current(), true);
+			}
+
+			Base<Rule>::success(in, st...);
+		}
+
+		template<typename ParseInput, typename... States>
+		static void failure(const ParseInput& in, States&&... st) {
+			auto* prof = RuleProfiler::current();
+			if(prof && id() != RuleProfiler::noRule) {
+				prof->finish(id(), in.current(), false);
+			}
+
+			Base<Rule>::failure(in, st...);
+		}
+	};
+};
+
+} // namespace syn
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "symbol.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace builder {
+
+// Declarations of nested scopes (module, function, code blocks).
+// There is only one hash table for all scopes. It maps a name to
+// the newest declaration with that name, and every declaration links
+// to the one it shadows. Entering a scope just means taking a mark,
+// leaving it removes the declarations made since then by restoring the
+// shadowed ones. Lookup is a single probe sequence, independent of the
+// scope depth.
+template<typename T>
+class ScopedTable {
+public:
+	using Mark = std::size_t;
+
+	ScopedTable() : keys_(16u), heads_(16u, none) {}
+
+	Mark mark() const { return entries_.size(); }
+
+	void declare(ast::Symbol name, T value) {
+		assert(!name.empty());
+		auto& head = heads_[slot(name)];
+		entries_.push_back({name, std::move(value), head});
+		head = std::uint32_t(entries_.size() - 1);
+	}
+
+	// Removes all declarations made since the mark was taken.
+	void restore(Mark mark) {
+		assert(mark <= entries_.size());
+		while(entries_.size() > mark) {
+			auto& entry = entries_.back();
+			heads_[slot(entry.name)] = entry.shadowed;
+			entries_.pop_back();
+		}
+	}
+
+	// Returns the newest declaration with the given name or null.
+	// When since is given, only declarations made after that mark
+	// are considered, e.g. to check for redeclarations in one scope.
+	const T* find(ast::Symbol name, Mark since = 0u) const {
+		auto mask = keys_.size() - 1;
+		for(auto pos = ast::hashSlot(name.id(), bits_); keys_[pos]; pos = (pos + 1) & mask) {
+			if(keys_[pos] == name.id()) {
+				auto head = heads_[pos];
+				return (head == none || head < since) ? nullptr : &entries_[head].value;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// The i-th declaration that is currently visible, in order.
+	const T& operator[](std::size_t i) const { return entries_[i].value; }
+
+private:
+	static constexpr auto none = std::uint32_t(0xFFFFFFFFu);
+
+	struct Entry {
+		ast::Symbol name;
+		T value;
+		std::uint32_t shadowed; // entry index, none if there is none
+	};
+
+	// Slot for the name, adds it if needed. Names are never removed
+	// from the table, leaving a scope only resets their heads.
+	std::size_t slot(ast::Symbol name) {
+		if(2 * (used_ + 1) > keys_.size()) {
+			grow();
+		}
+
+		auto mask = keys_.size() - 1;
+		auto pos = ast::hashSlot(name.id(), bits_);
+		for(; keys_[pos]; pos = (pos + 1) & mask) {
+			if(keys_[pos] == name.id()) {
+				return pos;
+			}
+		}
+
+		++used_;
+		keys_[pos] = name.id();
+		return pos;
+	}
+
+	void grow() {
+		auto keys = std::move(keys_);
+		auto heads = std::move(heads_);
+		keys_.assign(2 * keys.size(), 0u);
+		heads_.assign(2 * keys.size(), none);
+		++bits_;
+
+		auto mask = keys_.size() - 1;
+		for(auto i = 0u; i < keys.size(); ++i) {
+			if(!keys[i]) {
+				continue;
+			}
+
+			auto pos = ast::hashSlot(keys[i], bits_);
+			while(keys_[pos]) {
+				pos = (pos + 1) & mask;
+			}
+
+			keys_[pos] = keys[i];
+			heads_[pos] = heads[i];
+		}
+	}
+
+	// open addressing, symbol id 0 (the empty symbol) marks free slots
+	std::vector<std::uint32_t> keys_;
+	std::vector<std::uint32_t> heads_;
+	unsigned bits_ {4u}; // log2 of the table size
+	std::size_t used_ {};
+	std::vector<Entry> entries_;
+};
+
+} // namespace builder
@@ -0,0 +1,62 @@
+#include "source.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ast {
+
+SourceFile::SourceFile(std::string path) : path_(std::move(path)) {
+	auto fd = ::open(path_.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw std::system_error(errno, std::generic_category(), path_);
+	}
+
+	struct stat st;
+	if(::fstat(fd, &st) != 0) {
+		auto err = errno;
+		::close(fd);
+		throw std::system_error(err, std::generic_category(), path_);
+	}
+
+	// empty files can't be mapped, keep the empty default text
+	if(st.st_size > 0) {
+		auto size = std::size_t(st.st_size);
+		auto* ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED) {
+			auto err = errno;
+			::close(fd);
+			throw std::system_error(err, std::generic_category(), path_);
+		}
+
+		// the parser reads the whole file from front to back
+		::madvise(ptr, size, MADV_SEQUENTIAL);
+		data_ = static_cast<const char*>(ptr);
+		size_ = size;
+	}
+
+	// the mapping stays valid without the file descriptor
+	::close(fd);
+}
+
+void SourceFile::release() {
+	if(size_) {
+		::munmap(const_cast<char*>(data_), size_);
+	}
+
+	data_ = "";
+	size_ = 0u;
+}
+
+void SourceFile::swap(SourceFile& rhs) noexcept {
+	std::swap(path_, rhs.path_);
+	std::swap(data_, rhs.data_);
+	std::swap(size_, rhs.size_);
+}
+
+} // namespace ast
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace ast {
+
+// Read-only source file that is mapped into memory instead of being
+// copied. The text stays valid (and at the same address, even when
+// moved) until the SourceFile is destroyed.
+class SourceFile {
+public:
+	SourceFile() = default;
+
+	// Throws std::system_error if the file can't be opened or mapped.
+	explicit SourceFile(std::string path);
+	~SourceFile() { release(); }
+
+	SourceFile(SourceFile&& rhs) noexcept { swap(rhs); }
+	SourceFile& operator=(SourceFile&& rhs) noexcept {
+		release();
+		swap(rhs);
+		return *this;
+	}
+
+	std::string_view text() const { return {data_, size_}; }
+	const std::string& path() const { return path_; }
+
+private:
+	void release();
+	void swap(SourceFile& rhs) noexcept;
+
+	std::string path_;
+	const char* data_ {""};
+	std::size_t size_ {};
+};
+
+} // namespace ast
@@ -0,0 +1,592 @@
+#include "spmd.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+#ifdef ISL_SPMD_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace ast::vm {
+
+namespace {
+
+using BT = BuiltinType::Type;
+using Mask = SpmdMachine::Mask;
+
+constexpr auto noJoin = std::uint32_t(0xFFFFFFFFu);
+
+template<typename T>
+std::array<T, laneCount>& lanes(Lanes& l) {
+	if constexpr(std::is_same_v<T, f32>) {
+		return l.f;
+	} else if constexpr(std::is_same_v<T, i32>) {
+		return l.i;
+	} else if constexpr(std::is_same_v<T, u32>) {
+		return l.u;
+	} else {
+		static_assert(std::is_same_v<T, f64>);
+		return l.d;
+	}
+}
+
+bool isFull(const Mask& mask) {
+	return std::all_of(mask.begin(), mask.end(), [](auto m) { return m != 0u; });
+}
+
+// Writes the value of f for every active lane of dst. The values are
+// computed for all lanes, all operations are defined for any input.
+template<typename T, typename F>
+void write(Lanes& dst, const Mask& mask, bool full, F&& f) {
+	std::array<T, laneCount> res;
+	for(auto l = 0u; l < laneCount; ++l) {
+		res[l] = f(l);
+	}
+
+	auto& d = lanes<T>(dst);
+	if(full) {
+		d = res;
+		return;
+	}
+
+	for(auto l = 0u; l < laneCount; ++l) {
+		d[l] = mask[l] ? res[l] : d[l];
+	}
+}
+
+template<typename T, typename F>
+void each(const Instruction& in, Lanes* r, const Mask& mask, bool full, F&& f) {
+	for(auto c = 0u; c < in.count; ++c) {
+		auto& a = lanes<T>(r[in.a + c]);
+		auto& b = lanes<T>(r[in.b + c]);
+		write<T>(r[in.dst + c], mask, full, [&](auto l) { return f(a[l], b[l]); });
+	}
+}
+
+// dst (bool) = whether f holds for all components, inverted if wanted
+template<typename T, typename F>
+void all(const Instruction& in, Lanes* r, const Mask& mask, bool full,
+		bool invert, F&& f) {
+	std::array<u32, laneCount> res;
+	res.fill(1u);
+	for(auto c = 0u; c < in.count; ++c) {
+		auto& a = lanes<T>(r[in.a + c]);
+		auto& b = lanes<T>(r[in.b + c]);
+		for(auto l = 0u; l < laneCount; ++l) {
+			res[l] &= u32(f(a[l], b[l]));
+		}
+	}
+
+	write<u32>(r[in.dst], mask, full, [&](auto l) { return res[l] ^ u32(invert); });
+}
+
+template<typename T>
+void matMul(const Instruction& in, Lanes* r, const Mask& mask, bool full) {
+	auto rows = unsigned(in.count);
+	auto inner = in.aux & 0xFu;
+	auto cols = unsigned(in.aux) >> 4u;
+	for(auto c = 0u; c < cols; ++c) {
+		for(auto row = 0u; row < rows; ++row) {
+			std::array<T, laneCount> sum {};
+			for(auto k = 0u; k < inner; ++k) {
+				auto& a = lanes<T>(r[in.a + k * rows + row]);
+				auto& b = lanes<T>(r[in.b + c * inner + k]);
+				for(auto l = 0u; l < laneCount; ++l) {
+					sum[l] += a[l] * b[l];
+				}
+			}
+
+			write<T>(r[in.dst + c * rows + row], mask, full,
+				[&](auto l) { return sum[l]; });
+		}
+	}
+}
+
+template<typename T>
+void move(const Instruction& in, Lanes* r, const Mask& mask, bool full) {
+	for(auto c = 0u; c < in.count; ++c) {
+		auto& a = lanes<T>(r[in.a + c]);
+		write<T>(r[in.dst + c], mask, full, [&](auto l) { return a[l]; });
+	}
+}
+
+template<typename T>
+void splat(const Instruction& in, Lanes* r, const Mask& mask, bool full) {
+	auto a = lanes<T>(r[in.a]);
+	for(auto c = 0u; c < in.count; ++c) {
+		write<T>(r[in.dst + c], mask, full, [&](auto l) { return a[l]; });
+	}
+}
+
+// same as in vm.cpp
+i32 shiftRight(i32 a, u32 shift) {
+	return a < 0 ? ~i32(~u32(a) >> shift) : i32(u32(a) >> shift);
+}
+
+// Component types of a value in register order
+void components(const Type& type, std::vector<BT>& out) {
+	if(type.category == Type::Category::eStruct) {
+		for(auto& member : static_cast<const StructType&>(type).members) {
+			components(*member.type, out);
+		}
+		return;
+	}
+
+	auto& btype = static_cast<const BuiltinType&>(type);
+	out.insert(out.end(), slots(type), btype.type);
+}
+
+void load(Lanes& dst, unsigned lane, BT type, const Value& value) {
+	switch(type) {
+		case BT::f64: dst.d[lane] = value.d; break;
+		case BT::eBool: dst.u[lane] = value.b; break;
+		default: dst.u[lane] = value.u; break;
+	}
+}
+
+void store(Value& dst, BT type, const Lanes& src, unsigned lane) {
+	switch(type) {
+		case BT::f64: dst.d = src.d[lane]; break;
+		case BT::eBool: dst.b = src.u[lane] != 0u; break;
+		default: dst.u = src.u[lane]; break;
+	}
+}
+
+#ifdef ISL_SPMD_AVX2
+
+// Explicit avx2 kernels of the 32-bit instructions, one register is
+// one ymm register. Only these functions are compiled for avx2, they
+// are called when the cpu supports it, see supported(Simd).
+// Lambdas don't get the target, so there are none.
+// Results are the same as the ones of the lane loops: no fma and
+// ordered float comparisons like the C++ operators.
+namespace avx2 {
+
+#define ISL_AVX2 __attribute__((target("avx2")))
+
+ISL_AVX2 __m256i get(const Lanes& l) {
+	return _mm256_load_si256(reinterpret_cast<const __m256i*>(&l));
+}
+
+ISL_AVX2 __m256 getF(const Lanes& l) {
+	return _mm256_load_ps(l.f.data());
+}
+
+// Only changes the lanes set in mask
+ISL_AVX2 void put(Lanes& dst, __m256i res, __m256i mask, bool full) {
+	auto* d = reinterpret_cast<__m256i*>(&dst);
+	_mm256_store_si256(d, full ? res : _mm256_blendv_epi8(_mm256_load_si256(d), res, mask));
+}
+
+ISL_AVX2 __m256i componentwise(Opcode op, const Lanes& la, const Lanes& lb) {
+	auto a = get(la);
+	auto b = get(lb);
+	auto shift = _mm256_and_si256(b, _mm256_set1_epi32(31));
+	auto sign = _mm256_set1_epi32(std::int32_t(0x80000000u));
+	switch(op) {
+		case Opcode::addU: return _mm256_add_epi32(a, b);
+		case Opcode::subU: return _mm256_sub_epi32(a, b);
+		case Opcode::mulU: return _mm256_mullo_epi32(a, b);
+		case Opcode::negU: return _mm256_sub_epi32(_mm256_setzero_si256(), a);
+		case Opcode::shrI: return _mm256_srav_epi32(a, shift);
+		case Opcode::andU: case Opcode::andB: return _mm256_and_si256(a, b);
+		case Opcode::orU: case Opcode::orB: return _mm256_or_si256(a, b);
+		case Opcode::xorU: case Opcode::xorB: return _mm256_xor_si256(a, b);
+		case Opcode::shlU: return _mm256_sllv_epi32(a, shift);
+		case Opcode::shrU: return _mm256_srlv_epi32(a, shift);
+		case Opcode::addF: return _mm256_castps_si256(_mm256_add_ps(getF(la), getF(lb)));
+		case Opcode::subF: return _mm256_castps_si256(_mm256_sub_ps(getF(la), getF(lb)));
+		case Opcode::mulF: return _mm256_castps_si256(_mm256_mul_ps(getF(la), getF(lb)));
+		case Opcode::divF: return _mm256_castps_si256(_mm256_div_ps(getF(la), getF(lb)));
+		case Opcode::negF: return _mm256_xor_si256(a, sign);
+		default:
+			assert(!"No componentwise kernel");
+			return a;
+	}
+}
+
+// All bits set where the comparison holds
+ISL_AVX2 __m256i compare(Opcode op, const Lanes& la, const Lanes& lb) {
+	auto a = get(la);
+	auto b = get(lb);
+	auto ones = _mm256_set1_epi32(-1);
+	// unsigned order is the signed one with flipped sign bits
+	auto sign = _mm256_set1_epi32(std::int32_t(0x80000000u));
+	auto ua = _mm256_xor_si256(a, sign);
+	auto ub = _mm256_xor_si256(b, sign);
+	switch(op) {
+		case Opcode::eqU: case Opcode::eqB:
+		case Opcode::neqU: case Opcode::neqB:
+			return _mm256_cmpeq_epi32(a, b);
+		case Opcode::eqF: case Opcode::neqF:
+			return _mm256_castps_si256(_mm256_cmp_ps(getF(la), getF(lb), _CMP_EQ_OQ));
+		case Opcode::lessI: return _mm256_cmpgt_epi32(b, a);
+		case Opcode::lessU: return _mm256_cmpgt_epi32(ub, ua);
+		case Opcode::lessF:
+			return _mm256_castps_si256(_mm256_cmp_ps(getF(la), getF(lb), _CMP_LT_OQ));
+		case Opcode::lessEqI: return _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), ones);
+		case Opcode::lessEqU: return _mm256_xor_si256(_mm256_cmpgt_epi32(ua, ub), ones);
+		case Opcode::lessEqF:
+			return _mm256_castps_si256(_mm256_cmp_ps(getF(la), getF(lb), _CMP_LE_OQ));
+		default:
+			assert(!"No comparison kernel");
+			return a;
+	}
+}
+
+// Executes the instruction if there is a kernel for it, returns
+// false otherwise.
+ISL_AVX2 bool execute(const Instruction& in, Lanes* r, const Mask& active, bool full) {
+	// all bits set for the active lanes
+	auto mask = _mm256_cmpgt_epi32(
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(active.data())),
+		_mm256_setzero_si256());
+	auto one = _mm256_set1_epi32(1);
+
+	switch(in.op) {
+		case Opcode::constant:
+			if(in.aux) {
+				return false;
+			}
+			put(r[in.dst], _mm256_set1_epi32(std::int32_t(in.a)), mask, full);
+			return true;
+		case Opcode::move:
+			if(in.aux) {
+				return false;
+			}
+			for(auto c = 0u; c < in.count; ++c) {
+				put(r[in.dst + c], get(r[in.a + c]), mask, full);
+			}
+			return true;
+		case Opcode::splat: {
+			if(in.aux) {
+				return false;
+			}
+			auto a = get(r[in.a]);
+			for(auto c = 0u; c < in.count; ++c) {
+				put(r[in.dst + c], a, mask, full);
+			}
+			return true;
+		}
+
+		case Opcode::addU: case Opcode::subU: case Opcode::mulU:
+		case Opcode::negU: case Opcode::shrI:
+		case Opcode::andU: case Opcode::orU: case Opcode::xorU:
+		case Opcode::shlU: case Opcode::shrU:
+		case Opcode::addF: case Opcode::subF: case Opcode::mulF:
+		case Opcode::divF: case Opcode::negF:
+		case Opcode::andB: case Opcode::orB: case Opcode::xorB:
+			for(auto c = 0u; c < in.count; ++c) {
+				put(r[in.dst + c], componentwise(in.op, r[in.a + c], r[in.b + c]),
+					mask, full);
+			}
+			return true;
+
+		case Opcode::eqU: case Opcode::eqF: case Opcode::eqB:
+		case Opcode::neqU: case Opcode::neqF: case Opcode::neqB:
+		case Opcode::lessI: case Opcode::lessU: case Opcode::lessF:
+		case Opcode::lessEqI: case Opcode::lessEqU: case Opcode::lessEqF: {
+			auto res = _mm256_set1_epi32(-1);
+			for(auto c = 0u; c < in.count; ++c) {
+				res = _mm256_and_si256(res, compare(in.op, r[in.a + c], r[in.b + c]));
+			}
+
+			res = _mm256_and_si256(res, one);
+			auto invert = in.op == Opcode::neqU || in.op == Opcode::neqF ||
+				in.op == Opcode::neqB;
+			put(r[in.dst], invert ? _mm256_xor_si256(res, one) : res, mask, full);
+			return true;
+		}
+
+		// integer division and modulo have no instructions, the
+		// 64-bit ones and the rest use the lane loops
+		default:
+			return false;
+	}
+}
+
+#undef ISL_AVX2
+
+} // namespace avx2
+
+#endif // ISL_SPMD_AVX2
+
+} // anon namespace
+
+bool supported(Simd simd) {
+	switch(simd) {
+		case Simd::none:
+			return true;
+		case Simd::avx2:
+#ifdef ISL_SPMD_AVX2
+			return __builtin_cpu_supports("avx2");
+#else
+			return false;
+#endif
+	}
+
+	return false;
+}
+
+Simd bestSimd() {
+	return supported(Simd::avx2) ? Simd::avx2 : Simd::none;
+}
+
+SpmdMachine::SpmdMachine(const Program& program, Simd simd) :
+		program_(program), simd_(simd) {
+	assert(supported(simd));
+}
+
+nytl::span<const Lanes> SpmdMachine::runBatch(unsigned function,
+		nytl::span<const Lanes> args, unsigned active) {
+	auto& functions = program_.functions();
+	assert(function < functions.size());
+	auto& entry = functions[function];
+	assert(args.size() == entry.paramSlots);
+	assert(active > 0u && active <= laneCount);
+
+	if(registers_.size() < entry.registerCount) {
+		registers_.resize(entry.registerCount);
+	}
+
+	std::copy(args.begin(), args.end(), registers_.begin());
+
+	Mask mask {};
+	std::fill_n(mask.begin(), active, 1u);
+	return execute(entry, mask);
+}
+
+void SpmdMachine::run(unsigned function, std::size_t count,
+		nytl::span<const Value> args, nytl::span<Value> results) {
+	auto& entry = program_.functions()[function];
+	assert(args.size() == count * entry.paramSlots);
+	assert(results.size() == count * entry.resultSlots);
+
+	std::vector<BT> params;
+	for(auto* param : entry.decl->parameters()) {
+		components(*param, params);
+	}
+
+	std::vector<BT> result;
+	if(entry.resultSlots) {
+		components(entry.decl->returnType(), result);
+	}
+
+	std::vector<Lanes> batch(entry.paramSlots);
+	for(auto start = std::size_t(0u); start < count; start += laneCount) {
+		auto active = unsigned(std::min<std::size_t>(laneCount, count - start));
+		for(auto l = 0u; l < active; ++l) {
+			auto* values = &args[(start + l) * entry.paramSlots];
+			for(auto s = 0u; s < entry.paramSlots; ++s) {
+				load(batch[s], l, params[s], values[s]);
+			}
+		}
+
+		auto res = runBatch(function, batch, active);
+		for(auto l = 0u; l < active; ++l) {
+			auto* values = &results[(start + l) * entry.resultSlots];
+			for(auto s = 0u; s < entry.resultSlots; ++s) {
+				store(values[s], result[s], res[s], l);
+			}
+		}
+	}
+}
+
+nytl::span<const Lanes> SpmdMachine::execute(const FunctionEntry& entry,
+		const Mask& activeMask) {
+	frames_.clear();
+	branches_.clear();
+
+	constexpr auto min = std::numeric_limits<i32>::min();
+	auto& functions = program_.functions();
+	auto* code = program_.code().data();
+	auto pc = entry.entry;
+	auto base = std::size_t(0u);
+	auto* r = registers_.data();
+
+	auto mask = activeMask;
+	auto full = isFull(mask);
+	auto join = noJoin; // of the innermost branch in the current function
+	auto innermostJoin = [&]{
+		auto& b = branches_;
+		return (!b.empty() && b.back().frame == frames_.size()) ? b.back().join : noJoin;
+	};
+
+	while(true) {
+		// all lanes of the path reached the join, continue with the
+		// second path or with all lanes together
+		while(pc == join) {
+			auto& branch = branches_.back();
+			if(branch.pending != branch.join) {
+				pc = branch.pending;
+				mask = branch.pendingMask;
+				branch.pending = branch.join;
+			} else {
+				mask = branch.mask;
+				branches_.pop_back();
+				join = innermostJoin();
+			}
+
+			full = isFull(mask);
+		}
+
+		auto& in = code[pc++];
+#ifdef ISL_SPMD_AVX2
+		if(simd_ == Simd::avx2 && avx2::execute(in, r, mask, full)) {
+			continue;
+		}
+#endif
+
+		switch(in.op) {
+			case Opcode::constant: {
+				auto bits = std::uint64_t(in.a) | (std::uint64_t(in.b) << 32u);
+				if(in.aux) {
+					f64 value;
+					std::memcpy(&value, &bits, sizeof(value));
+					write<f64>(r[in.dst], mask, full, [&](auto) { return value; });
+				} else {
+					write<u32>(r[in.dst], mask, full, [&](auto) { return u32(bits); });
+				}
+				break;
+			} case Opcode::move:
+				in.aux ? move<f64>(in, r, mask, full) : move<u32>(in, r, mask, full);
+				break;
+			case Opcode::splat:
+				in.aux ? splat<f64>(in, r, mask, full) : splat<u32>(in, r, mask, full);
+				break;
+
+			case Opcode::addU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a + b; }); break;
+			case Opcode::subU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a - b; }); break;
+			case Opcode::mulU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a * b; }); break;
+			case Opcode::divU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return b ? a / b : 0u; }); break;
+			case Opcode::modU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return b ? a % b : 0u; }); break;
+			case Opcode::negU: each<u32>(in, r, mask, full, [](u32 a, u32) { return 0u - a; }); break;
+			case Opcode::divI:
+				each<i32>(in, r, mask, full, [&](i32 a, i32 b) {
+					return !b ? 0 : (a == min && b == -1) ? min : a / b;
+				});
+				break;
+			case Opcode::modI:
+				each<i32>(in, r, mask, full, [&](i32 a, i32 b) {
+					return (!b || (a == min && b == -1)) ? 0 : a % b;
+				});
+				break;
+			case Opcode::shrI: each<i32>(in, r, mask, full, [](i32 a, i32 b) { return shiftRight(a, u32(b) & 31u); }); break;
+			case Opcode::andU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a & b; }); break;
+			case Opcode::orU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a | b; }); break;
+			case Opcode::xorU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a ^ b; }); break;
+			case Opcode::shlU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a << (b & 31u); }); break;
+			case Opcode::shrU: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a >> (b & 31u); }); break;
+
+			case Opcode::addF: each<f32>(in, r, mask, full, [](f32 a, f32 b) { return a + b; }); break;
+			case Opcode::subF: each<f32>(in, r, mask, full, [](f32 a, f32 b) { return a - b; }); break;
+			case Opcode::mulF: each<f32>(in, r, mask, full, [](f32 a, f32 b) { return a * b; }); break;
+			case Opcode::divF: each<f32>(in, r, mask, full, [](f32 a, f32 b) { return a / b; }); break;
+			case Opcode::modF: each<f32>(in, r, mask, full, [](f32 a, f32 b) { return std::fmod(a, b); }); break;
+			case Opcode::negF: each<f32>(in, r, mask, full, [](f32 a, f32) { return -a; }); break;
+
+			case Opcode::addD: each<f64>(in, r, mask, full, [](f64 a, f64 b) { return a + b; }); break;
+			case Opcode::subD: each<f64>(in, r, mask, full, [](f64 a, f64 b) { return a - b; }); break;
+			case Opcode::mulD: each<f64>(in, r, mask, full, [](f64 a, f64 b) { return a * b; }); break;
+			case Opcode::divD: each<f64>(in, r, mask, full, [](f64 a, f64 b) { return a / b; }); break;
+			case Opcode::modD: each<f64>(in, r, mask, full, [](f64 a, f64 b) { return std::fmod(a, b); }); break;
+			case Opcode::negD: each<f64>(in, r, mask, full, [](f64 a, f64) { return -a; }); break;
+
+			// booleans are 0 or 1
+			case Opcode::andB: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a & b; }); break;
+			case Opcode::orB: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a | b; }); break;
+			case Opcode::xorB: each<u32>(in, r, mask, full, [](u32 a, u32 b) { return a ^ b; }); break;
+
+			case Opcode::matMulF: matMul<f32>(in, r, mask, full); break;
+			case Opcode::matMulD: matMul<f64>(in, r, mask, full); break;
+
+			case Opcode::eqU: all<u32>(in, r, mask, full, false, std::equal_to<>()); break;
+			case Opcode::eqF: all<f32>(in, r, mask, full, false, std::equal_to<>()); break;
+			case Opcode::eqD: all<f64>(in, r, mask, full, false, std::equal_to<>()); break;
+			case Opcode::eqB: all<u32>(in, r, mask, full, false, std::equal_to<>()); break;
+			case Opcode::neqU: all<u32>(in, r, mask, full, true, std::equal_to<>()); break;
+			case Opcode::neqF: all<f32>(in, r, mask, full, true, std::equal_to<>()); break;
+			case Opcode::neqD: all<f64>(in, r, mask, full, true, std::equal_to<>()); break;
+			case Opcode::neqB: all<u32>(in, r, mask, full, true, std::equal_to<>()); break;
+			case Opcode::lessI: all<i32>(in, r, mask, full, false, std::less<>()); break;
+			case Opcode::lessU: all<u32>(in, r, mask, full, false, std::less<>()); break;
+			case Opcode::lessF: all<f32>(in, r, mask, full, false, std::less<>()); break;
+			case Opcode::lessD: all<f64>(in, r, mask, full, false, std::less<>()); break;
+			case Opcode::lessEqI: all<i32>(in, r, mask, full, false, std::less_equal<>()); break;
+			case Opcode::lessEqU: all<u32>(in, r, mask, full, false, std::less_equal<>()); break;
+			case Opcode::lessEqF: all<f32>(in, r, mask, full, false, std::less_equal<>()); break;
+			case Opcode::lessEqD: all<f64>(in, r, mask, full, false, std::less_equal<>()); break;
+
+			case Opcode::jump:
+				pc = in.dst;
+				break;
+			case Opcode::jumpIf:
+			case Opcode::jumpIfNot: {
+				auto& cond = r[in.a].u;
+				auto flip = u32(in.op == Opcode::jumpIfNot);
+				Mask taken, staying;
+				auto anyTaken = 0u, anyStaying = 0u;
+				for(auto l = 0u; l < laneCount; ++l) {
+					auto jumps = (cond[l] ^ flip) & 1u;
+					taken[l] = mask[l] & jumps;
+					staying[l] = mask[l] & (jumps ^ 1u);
+					anyTaken |= taken[l];
+					anyStaying |= staying[l];
+				}
+
+				if(!anyTaken) {
+					break;
+				} else if(!anyStaying) {
+					pc = in.dst;
+					break;
+				}
+
+				// divergent: the staying lanes go first, the others
+				// wait at the target
+				branches_.push_back({in.b, std::uint32_t(frames_.size()),
+					mask, taken, in.dst});
+				mask = staying;
+				full = false;
+				join = in.b;
+				break;
+			} case Opcode::call: {
+				// the active lanes stay the same
+				auto& callee = functions[in.a];
+				frames_.push_back({pc, base});
+				base += in.dst;
+				if(registers_.size() < base + callee.registerCount) {
+					registers_.resize(std::max(base + callee.registerCount,
+						2 * registers_.size()));
+				}
+
+				r = registers_.data() + base;
+				pc = callee.entry;
+				join = noJoin;
+				break;
+			} case Opcode::ret: {
+				// all lanes joined again, the inactive ones of the
+				// window are temporaries of the caller
+				std::memmove(r, &r[in.a], in.count * sizeof(Lanes));
+				if(frames_.empty()) {
+					return {r, in.count};
+				}
+
+				auto frame = frames_.back();
+				frames_.pop_back();
+				pc = frame.pc;
+				base = frame.base;
+				r = registers_.data() + base;
+				join = innermostJoin();
+				break;
+			} default:
+				assert(!"Invalid opcode");
+				return {};
+		}
+	}
+}
+
+} // namespace ast::vm
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vm.hpp"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Runs vm programs for many invocations at once, SPMD style like ispc:
+// every invocation is one lane of a fixed width batch and each
+// instruction is executed for all lanes together.
+// Registers are stored as structure of arrays, a register holds one
+// component for all lanes, so a vec3 is three lane arrays. 32-bit
+// components are packed, with avx2 a register is one ymm register and
+// the 32-bit instructions have explicit kernels, see Simd.
+// Divergent conditional jumps execute both paths one after the other,
+// with only the lanes taking the path active. The paths join again at
+// the point the compiler recorded in the jump.
+namespace ast::vm {
+
+constexpr unsigned laneCount = 8u;
+
+// One register of a batch. Booleans are stored as u32 0 or 1.
+union alignas(64) Lanes {
+	std::array<f32, laneCount> f;
+	std::array<i32, laneCount> i;
+	std::array<u32, laneCount> u;
+	std::array<f64, laneCount> d;
+};
+
+// Instruction sets a batch can be executed with
+enum class Simd {
+	none, // plain lane loops, whatever the compiler makes of them
+	avx2, // intrinsics for the 32-bit instructions, the rest uses the loops
+};
+
+// Whether the kernels were built (the 'simd' meson option) and the
+// cpu supports them.
+bool supported(Simd simd);
+
+// The widest supported instruction set
+Simd bestSimd();
+
+class SpmdMachine {
+public:
+	// Active lanes are 1, others 0
+	using Mask = std::array<u32, laneCount>;
+
+	// The instruction set must be supported
+	explicit SpmdMachine(const Program& program, Simd simd = bestSimd());
+
+	Simd simd() const { return simd_; }
+
+	// Runs one batch. There are paramSlots argument registers, only
+	// the first 'active' lanes are evaluated. The returned result
+	// registers are valid until the next run.
+	nytl::span<const Lanes> runBatch(unsigned function,
+		nytl::span<const Lanes> args, unsigned active = laneCount);
+
+	// Runs count invocations. The arguments and results are given per
+	// invocation, in the layout Machine::run uses, i.e. args has
+	// count * paramSlots and results count * resultSlots values.
+	void run(unsigned function, std::size_t count,
+		nytl::span<const Value> args, nytl::span<Value> results);
+
+private:
+	// Paths of a divergent branch
+	struct Branch {
+		std::uint32_t join; // instruction where the paths join
+		std::uint32_t frame; // call depth of the branch
+		Mask mask; // active lanes before the branch
+		Mask pendingMask; // lanes of the second path
+		std::uint32_t pending; // start of the second path, join if none
+	};
+
+	struct Frame {
+		std::uint32_t pc;
+		std::size_t base;
+	};
+
+	nytl::span<const Lanes> execute(const FunctionEntry& entry, const Mask& mask);
+
+	const Program& program_;
+	Simd simd_;
+	std::vector<Lanes> registers_;
+	std::vector<Frame> frames_;
+	std::vector<Branch> branches_;
+};
+
+} // namespace ast::vm
@@ -0,0 +1,940 @@
+#include "spvgen.hpp"
+#include "fold.hpp"
+#include "types.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ast::spirv {
+
+namespace {
+
+using BT = BuiltinType::Type;
+using Id = std::uint32_t;
+using Words = std::vector<std::uint32_t>;
+
+// The emitted subset of SPIR-V, values from the specification
+enum class Op : std::uint16_t {
+	undef = 1,
+	name = 5,
+	memberName = 6,
+	memoryModel = 14,
+	capability = 17,
+
+	typeVoid = 19,
+	typeBool = 20,
+	typeInt = 21,
+	typeFloat = 22,
+	typeVector = 23,
+	typeMatrix = 24,
+	typeStruct = 30,
+	typePointer = 32,
+	typeFunction = 33,
+
+	constantTrue = 41,
+	constantFalse = 42,
+	constant = 43,
+
+	function = 54,
+	functionParameter = 55,
+	functionEnd = 56,
+	functionCall = 57,
+
+	variable = 59,
+	load = 61,
+	store = 62,
+	accessChain = 65,
+
+	decorate = 71,
+	memberDecorate = 72,
+
+	compositeConstruct = 80,
+	compositeExtract = 81,
+
+	sNegate = 126, fNegate = 127,
+	iAdd = 128, fAdd = 129, iSub = 130, fSub = 131, iMul = 132, fMul = 133,
+	uDiv = 134, sDiv = 135, fDiv = 136, uMod = 137, sRem = 138, fRem = 140,
+	vectorTimesScalar = 142, matrixTimesScalar = 143,
+	vectorTimesMatrix = 144, matrixTimesVector = 145, matrixTimesMatrix = 146,
+
+	any = 154, all = 155,
+	logicalEqual = 164, logicalNotEqual = 165, logicalOr = 166, logicalAnd = 167,
+	iEqual = 170, iNotEqual = 171,
+	uGreaterThan = 172, sGreaterThan = 173,
+	uGreaterThanEqual = 174, sGreaterThanEqual = 175,
+	uLessThan = 176, sLessThan = 177,
+	uLessThanEqual = 178, sLessThanEqual = 179,
+	fOrdEqual = 180, fUnordNotEqual = 183,
+	fOrdLessThan = 184, fOrdGreaterThan = 186,
+	fOrdLessThanEqual = 188, fOrdGreaterThanEqual = 190,
+
+	shiftRightLogical = 194, shiftRightArithmetic = 195, shiftLeftLogical = 196,
+	bitwiseOr = 197, bitwiseXor = 198, bitwiseAnd = 199,
+
+	phi = 245,
+	selectionMerge = 247,
+	label = 248,
+	branch = 249,
+	branchConditional = 250,
+	ret = 253,
+	returnValue = 254,
+};
+
+constexpr std::uint32_t magic = 0x07230203u;
+constexpr std::uint32_t version = 0x00010000u; // 1.0
+
+constexpr std::uint32_t capabilityShader = 1u;
+constexpr std::uint32_t capabilityLinkage = 5u;
+constexpr std::uint32_t capabilityFloat64 = 10u;
+constexpr std::uint32_t addressingLogical = 0u;
+constexpr std::uint32_t memoryGLSL450 = 1u;
+constexpr std::uint32_t storageFunction = 7u;
+constexpr std::uint32_t decorationColMajor = 5u;
+constexpr std::uint32_t decorationMatrixStride = 7u;
+constexpr std::uint32_t decorationOffset = 35u;
+constexpr std::uint32_t decorationLinkage = 41u;
+constexpr std::uint32_t linkageExport = 0u;
+constexpr std::uint32_t linkageImport = 1u;
+
+void inst(Words& out, Op op, std::initializer_list<std::uint32_t> operands,
+		const Words& rest = {}) {
+	auto count = std::uint32_t(1u + operands.size() + rest.size());
+	out.push_back((count << 16u) | std::uint32_t(op));
+	out.insert(out.end(), operands);
+	out.insert(out.end(), rest.begin(), rest.end());
+}
+
+// Literal string operand: null terminated and padded to whole words.
+// The first character is in the lowest byte, as on little endian hosts.
+Words literal(std::string_view str) {
+	Words ret(str.size() / 4u + 1u, 0u);
+	std::memcpy(ret.data(), str.data(), str.size());
+	return ret;
+}
+
+// Name the function is exported and imported under, e.g. 'twice(i32)'.
+// Overloads and functions shadowing imported ones need distinct names.
+std::string linkageName(const Function& func) {
+	auto ret = std::string(func.name()) + "(";
+	auto params = func.parameters();
+	for(auto i = 0u; i < params.size(); ++i) {
+		ret += (i ? "," : "");
+		ret += typeName(*params[i]);
+	}
+
+	return ret + ")";
+}
+
+const BuiltinType& builtin(const Type& type) {
+	assert(type.category == Type::Category::primitive &&
+		"Operand must be a scalar, vector or matrix");
+	return static_cast<const BuiltinType&>(type);
+}
+
+bool isScalar(const BuiltinType& type) {
+	return type.rows == 1 && type.cols == 1;
+}
+
+bool isFloat(const BuiltinType& type) {
+	return type.type == BT::f32 || type.type == BT::f64;
+}
+
+bool isVoid(const Type& type) {
+	return &type == &BuiltinType::voidType();
+}
+
+Op arithOp(OpType op, BT type) {
+	auto sint = (type == BT::i32);
+	switch(type) {
+		case BT::f32:
+		case BT::f64:
+			switch(op) {
+				case OpType::add: return Op::fAdd;
+				case OpType::sub: return Op::fSub;
+				case OpType::mult: return Op::fMul;
+				case OpType::div: return Op::fDiv;
+				case OpType::mod: return Op::fRem;
+				default: break;
+			}
+			break;
+		case BT::i32:
+		case BT::u32:
+			switch(op) {
+				case OpType::add: return Op::iAdd;
+				case OpType::sub: return Op::iSub;
+				case OpType::mult: return Op::iMul;
+				case OpType::div: return sint ? Op::sDiv : Op::uDiv;
+				case OpType::mod: return sint ? Op::sRem : Op::uMod;
+				case OpType::bitAnd: return Op::bitwiseAnd;
+				case OpType::bitOr: return Op::bitwiseOr;
+				case OpType::bitXor: return Op::bitwiseXor;
+				case OpType::shiftLeft: return Op::shiftLeftLogical;
+				case OpType::shiftRight:
+					return sint ? Op::shiftRightArithmetic : Op::shiftRightLogical;
+				default: break;
+			}
+			break;
+		case BT::eBool:
+			switch(op) {
+				case OpType::bitAnd: return Op::logicalAnd;
+				case OpType::bitOr: return Op::logicalOr;
+				case OpType::bitXor: return Op::logicalNotEqual;
+				default: break;
+			}
+			break;
+		default:
+			break;
+	}
+
+	assert(!"Invalid operator for the operand type");
+	return Op::undef;
+}
+
+Op compareOp(OpType op, BT type) {
+	auto sint = (type == BT::i32);
+	switch(type) {
+		case BT::f32:
+		case BT::f64:
+			switch(op) {
+				case OpType::eq: return Op::fOrdEqual;
+				case OpType::neq: return Op::fUnordNotEqual;
+				case OpType::less: return Op::fOrdLessThan;
+				case OpType::lessEq: return Op::fOrdLessThanEqual;
+				case OpType::greater: return Op::fOrdGreaterThan;
+				case OpType::greaterEq: return Op::fOrdGreaterThanEqual;
+				default: break;
+			}
+			break;
+		case BT::i32:
+		case BT::u32:
+			switch(op) {
+				case OpType::eq: return Op::iEqual;
+				case OpType::neq: return Op::iNotEqual;
+				case OpType::less: return sint ? Op::sLessThan : Op::uLessThan;
+				case OpType::lessEq: return sint ? Op::sLessThanEqual : Op::uLessThanEqual;
+				case OpType::greater: return sint ? Op::sGreaterThan : Op::uGreaterThan;
+				case OpType::greaterEq:
+					return sint ? Op::sGreaterThanEqual : Op::uGreaterThanEqual;
+				default: break;
+			}
+			break;
+		case BT::eBool:
+			switch(op) {
+				case OpType::eq: return Op::logicalEqual;
+				case OpType::neq: return Op::logicalNotEqual;
+				default: break;
+			}
+			break;
+		default:
+			break;
+	}
+
+	assert(!"Invalid comparison for the operand type");
+	return Op::undef;
+}
+
+class Generator {
+public:
+	explicit Generator(const Module& mod) : mod_(mod) {}
+	Words generate();
+
+private:
+	struct Value {
+		Id id;
+		const Type* type;
+	};
+
+	// Declarations, in the global sections
+	Id type(const Type& type);
+	Id structType(const StructType& type);
+	Id pointer(const Type& type);
+	Id constant(const BuiltinType& type, const Constant::Component& value);
+	Id index(unsigned i);
+	Id undef(const Type& type);
+	Id function(const Callable& callable);
+	void declare(const Function& func, Id id);
+	void name(Id id, std::string_view name);
+	void linkage(Id id, std::string_view name, std::uint32_t type);
+
+	void define(const Function& func);
+
+	// Code of the current function
+	Id label() { return next_++; }
+	void block(Id label);
+	void jump(Id label) { inst(code_, Op::branch, {label}); }
+	Value op(Op code, const Type& type, std::initializer_list<Id> operands,
+		const Words& rest = {});
+	void bind(const VariableDeclaration& decl, Value value);
+
+	void statement(const Statement& stmt);
+	Value body(const CodeBlock& block, const Type& type);
+	Value expr(const Expression& expr);
+	Value lvalue(const Expression& expr); // pointer to the value
+	Value ifExpr(const IfExpression& expr, unsigned branch, const Type& type);
+	Value logical(const OpExpression& expr);
+	Value binary(OpType op, Value a, Value b);
+	Value compare(OpType op, Value a, Value b);
+	Value negate(Value a);
+	Value convert(Value value, const Type& type);
+	Value splat(Id scalar, const BuiltinType& type);
+
+	const Module& mod_;
+	Id next_ {1u};
+	bool float64_ {};
+
+	// sections, in module order
+	Words debug_;
+	Words annotations_;
+	Words globals_; // types and constants
+	Words declarations_; // imported functions
+	Words definitions_;
+
+	std::unordered_map<const Type*, Id> types_;
+	std::unordered_map<const Type*, Id> pointers_;
+	std::unordered_map<const Type*, Id> undefs_;
+	std::map<std::pair<Id, std::uint64_t>, Id> constants_;
+	std::unordered_map<const Callable*, Id> functions_;
+
+	// current function
+	Words variables_; // must be at the start of the first block
+	Words code_;
+	Id current_ {}; // label of the current block
+	// The value of a variable, or the pointer to it if it's assigned
+	std::unordered_map<const VariableDeclaration*, Id> values_;
+	std::unordered_set<const VariableDeclaration*> assigned_;
+	std::unordered_set<const Expression*> assigning_;
+};
+
+Words Generator::generate() {
+	for(auto* t : mod_.types) {
+		if(t->category == Type::Category::eStruct) {
+			type(*t);
+		}
+	}
+
+	// ids first, functions may call later ones
+	for(auto* func : mod_.functions) {
+		functions_[func] = next_++;
+	}
+
+	for(auto* func : mod_.functions) {
+		if(func->code) {
+			define(*func);
+		} else {
+			declare(*func, functions_[func]);
+		}
+	}
+
+	Words ret {magic, version, 0u, next_, 0u};
+	inst(ret, Op::capability, {capabilityShader});
+	inst(ret, Op::capability, {capabilityLinkage});
+	if(float64_) {
+		inst(ret, Op::capability, {capabilityFloat64});
+	}
+
+	inst(ret, Op::memoryModel, {addressingLogical, memoryGLSL450});
+	for(auto* section : {&debug_, &annotations_, &globals_, &declarations_, &definitions_}) {
+		ret.insert(ret.end(), section->begin(), section->end());
+	}
+
+	return ret;
+}
+
+Id Generator::type(const Type& t) {
+	auto it = types_.find(&t);
+	if(it != types_.end()) {
+		return it->second;
+	}
+
+	Id id {};
+	switch(t.category) {
+		case Type::Category::primitive: {
+			auto& bt = static_cast<const BuiltinType&>(t);
+			if(bt.cols > 1) {
+				assert(isFloat(bt) && "Only float matrices can be emitted");
+				auto column = type(BuiltinType::vecType(bt.type, bt.rows));
+				id = next_++;
+				inst(globals_, Op::typeMatrix, {id, column, bt.cols});
+			} else if(bt.rows > 1) {
+				auto component = type(BuiltinType::vecType(bt.type, 1u));
+				id = next_++;
+				inst(globals_, Op::typeVector, {id, component, bt.rows});
+			} else {
+				id = next_++;
+				switch(bt.type) {
+					case BT::eVoid: inst(globals_, Op::typeVoid, {id}); break;
+					case BT::eBool: inst(globals_, Op::typeBool, {id}); break;
+					case BT::f32: inst(globals_, Op::typeFloat, {id, 32u}); break;
+					case BT::f64:
+						float64_ = true;
+						inst(globals_, Op::typeFloat, {id, 64u});
+						break;
+					case BT::i32: inst(globals_, Op::typeInt, {id, 32u, 1u}); break;
+					case BT::u32: inst(globals_, Op::typeInt, {id, 32u, 0u}); break;
+					default: assert(!"Invalid builtin type");
+				}
+			}
+			break;
+		} case Type::Category::eStruct:
+			id = structType(static_cast<const StructType&>(t));
+			break;
+		case Type::Category::function: {
+			auto& ft = static_cast<const FunctionType&>(t);
+			auto ret = type(*ft.returnType);
+			Words params;
+			for(auto* param : ft.parameterTypes) {
+				params.push_back(type(*param));
+			}
+
+			id = next_++;
+			inst(globals_, Op::typeFunction, {id, ret}, params);
+			break;
+		} default:
+			assert(!"Enums can't be emitted yet");
+			break;
+	}
+
+	types_[&t] = id;
+	return id;
+}
+
+Id Generator::structType(const StructType& t) {
+	Words members;
+	for(auto& member : t.members) {
+		members.push_back(type(*member.type));
+	}
+
+	auto id = next_++;
+	inst(globals_, Op::typeStruct, {id}, members);
+	name(id, t.name.str());
+
+	// std430, see StructType::finish
+	for(auto i = 0u; i < t.members.size(); ++i) {
+		auto& member = t.members[i];
+		auto memberName = literal(member.name.name.str());
+		inst(debug_, Op::memberName, {id, i}, memberName);
+		inst(annotations_, Op::memberDecorate, {id, i, decorationOffset, member.offset});
+
+		auto& mtype = *member.type;
+		if(mtype.category == Type::Category::primitive &&
+				static_cast<const BuiltinType&>(mtype).cols > 1) {
+			auto stride = layout(mtype).alignment;
+			inst(annotations_, Op::memberDecorate, {id, i, decorationColMajor});
+			inst(annotations_, Op::memberDecorate, {id, i, decorationMatrixStride, stride});
+		}
+	}
+
+	return id;
+}
+
+Id Generator::pointer(const Type& t) {
+	auto it = pointers_.find(&t);
+	if(it != pointers_.end()) {
+		return it->second;
+	}
+
+	auto pointee = type(t);
+	auto id = next_++;
+	inst(globals_, Op::typePointer, {id, storageFunction, pointee});
+	pointers_[&t] = id;
+	return id;
+}
+
+Id Generator::constant(const BuiltinType& t, const Constant::Component& value) {
+	assert(isScalar(t));
+	auto tid = type(t);
+	std::uint64_t bits {};
+	if(t.type == BT::f64) {
+		std::memcpy(&bits, &value.d, sizeof(value.d));
+	} else if(t.type == BT::eBool) {
+		bits = value.b;
+	} else {
+		bits = value.u;
+	}
+
+	auto [it, inserted] = constants_.emplace(std::pair{tid, bits}, 0u);
+	if(!inserted) {
+		return it->second;
+	}
+
+	auto id = it->second = next_++;
+	if(t.type == BT::eBool) {
+		inst(globals_, bits ? Op::constantTrue : Op::constantFalse, {tid, id});
+	} else if(t.type == BT::f64) {
+		inst(globals_, Op::constant, {tid, id, Id(bits), Id(bits >> 32u)});
+	} else {
+		inst(globals_, Op::constant, {tid, id, Id(bits)});
+	}
+
+	return id;
+}
+
+Id Generator::index(unsigned i) {
+	Constant::Component value;
+	value.u = i;
+	return constant(BuiltinType::u32Type(), value);
+}
+
+Id Generator::undef(const Type& t) {
+	auto it = undefs_.find(&t);
+	if(it != undefs_.end()) {
+		return it->second;
+	}
+
+	auto tid = type(t);
+	auto id = next_++;
+	inst(globals_, Op::undef, {tid, id});
+	undefs_[&t] = id;
+	return id;
+}
+
+Id Generator::function(const Callable& callable) {
+	auto it = functions_.find(&callable);
+	if(it != functions_.end()) {
+		return it->second;
+	}
+
+	// from an imported module
+	auto* func = dynamic_cast<const Function*>(&callable);
+	assert(func && "Builtin functions can't be emitted yet");
+	auto id = next_++;
+	functions_[func] = id;
+	declare(*func, id);
+	return id;
+}
+
+void Generator::declare(const Function& func, Id id) {
+	auto& signature = TypeContext::get().function(func.returnType(), func.parameters());
+	auto ret = type(func.returnType());
+	auto ftype = type(signature);
+	inst(declarations_, Op::function, {ret, id, 0u, ftype});
+	for(auto* param : func.parameters()) {
+		auto ptype = type(*param);
+		inst(declarations_, Op::functionParameter, {ptype, next_++});
+	}
+	inst(declarations_, Op::functionEnd, {});
+
+	name(id, func.name());
+	linkage(id, linkageName(func), linkageImport);
+}
+
+void Generator::name(Id id, std::string_view str) {
+	inst(debug_, Op::name, {id}, literal(str));
+}
+
+void Generator::linkage(Id id, std::string_view str, std::uint32_t type) {
+	auto operands = literal(str);
+	operands.push_back(type);
+	inst(annotations_, Op::decorate, {id, decorationLinkage}, operands);
+}
+
+void Generator::define(const Function& func) {
+	variables_.clear();
+	code_.clear();
+	values_.clear();
+	assigned_.clear();
+	assigning_.clear();
+
+	// variables that need memory
+	struct Collector : Visitor {
+		using Visitor::visit;
+		std::unordered_set<const VariableDeclaration*>& assigned;
+
+		Collector(std::unordered_set<const VariableDeclaration*>& a) : assigned(a) {}
+		void visit(AssignStatement& s) override {
+			auto* target = s.left();
+			while(auto* access = dynamic_cast<MemberAccess*>(target)) {
+				target = access->accessed;
+			}
+
+			if(auto* ident = dynamic_cast<IdentifierExpression*>(target)) {
+				assigned.insert(ident->decl);
+			}
+			Visitor::visit(s);
+		}
+	};
+
+	// the visitor doesn't change the nodes
+	Collector collector(assigned_);
+	const_cast<CodeBlock&>(*func.code).visit(collector);
+	markAssigning(*func.code, assigning_);
+
+	auto id = functions_.at(&func);
+	auto& retType = func.returnType();
+	auto& signature = TypeContext::get().function(retType, func.parameters());
+	auto ret = type(retType);
+	auto ftype = type(signature);
+	name(id, func.name());
+	linkage(id, linkageName(func), linkageExport);
+
+	Words head;
+	inst(head, Op::function, {ret, id, 0u, ftype});
+	std::vector<Value> params;
+	for(auto* param : func.params) {
+		auto ptype = type(*param->type);
+		auto pid = next_++;
+		inst(head, Op::functionParameter, {ptype, pid});
+		name(pid, param->name.name.str());
+		params.push_back({pid, param->type});
+	}
+
+	current_ = label();
+	inst(head, Op::label, {current_});
+	for(auto i = 0u; i < params.size(); ++i) {
+		bind(*func.params[i], params[i]);
+	}
+
+	auto value = body(*func.code, retType);
+	if(isVoid(retType)) {
+		inst(code_, Op::ret, {});
+	} else {
+		inst(code_, Op::returnValue, {value.id});
+	}
+	inst(code_, Op::functionEnd, {});
+
+	for(auto* section : {&head, &variables_, &code_}) {
+		definitions_.insert(definitions_.end(), section->begin(), section->end());
+	}
+}
+
+void Generator::block(Id label) {
+	inst(code_, Op::label, {label});
+	current_ = label;
+}
+
+Generator::Value Generator::op(Op code, const Type& t,
+		std::initializer_list<Id> operands, const Words& rest) {
+	auto tid = type(t);
+	auto id = next_++;
+	Words all(operands);
+	all.insert(all.end(), rest.begin(), rest.end());
+	inst(code_, code, {tid, id}, all);
+	return {id, &t};
+}
+
+void Generator::bind(const VariableDeclaration& decl, Value value) {
+	if(!assigned_.count(&decl)) {
+		values_[&decl] = value.id;
+		return;
+	}
+
+	auto ptr = pointer(*decl.type);
+	auto id = next_++;
+	inst(variables_, Op::variable, {ptr, id, storageFunction});
+	inst(code_, Op::store, {id, value.id});
+	name(id, decl.name.name.str());
+	values_[&decl] = id;
+}
+
+void Generator::statement(const Statement& stmt) {
+	if(auto* decl = dynamic_cast<const DeclarationStatement*>(&stmt)) {
+		auto& var = *decl->decl;
+		bind(var, convert(expr(*var.init), *var.type));
+	} else if(auto* assign = dynamic_cast<const AssignStatement*>(&stmt)) {
+		auto value = expr(*assign->right());
+		auto target = lvalue(*assign->left());
+		value = convert(value, *target.type);
+		inst(code_, Op::store, {target.id, value.id});
+	} else if(auto* exprStmt = dynamic_cast<const ExpressionStatement*>(&stmt)) {
+		expr(*exprStmt->expr);
+	} else {
+		assert(!"Invalid statement");
+	}
+}
+
+Generator::Value Generator::body(const CodeBlock& block, const Type& t) {
+	for(auto* stmt : block.statements) {
+		statement(*stmt);
+	}
+
+	if(isVoid(t)) {
+		if(block.ret) {
+			expr(*block.ret);
+		}
+		return {0u, &t};
+	}
+
+	if(!block.ret) {
+		return {undef(t), &t};
+	}
+
+	return convert(expr(*block.ret), t);
+}
+
+Generator::Value Generator::expr(const Expression& e) {
+	if(auto* lit = dynamic_cast<const Literal*>(&e)) {
+		auto value = ast::constant(*lit);
+		return {constant(*value.type, value.values[0]), value.type};
+	} else if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+		auto it = values_.find(ident->decl);
+		assert(it != values_.end() && "Variable not known");
+		if(assigned_.count(ident->decl)) {
+			return op(Op::load, *ident->decl->type, {it->second});
+		}
+		return {it->second, ident->decl->type};
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+		auto base = expr(*access->accessed);
+		auto& stype = static_cast<const StructType&>(*base.type);
+		return op(Op::compositeExtract, *access->accessor->type,
+			{base.id, stype.slot(*access->accessor)});
+	} else if(auto* call = dynamic_cast<const FunctionCall*>(&e)) {
+		auto params = call->called->parameters();
+		assert(params.size() == call->arguments.size());
+		Words args;
+		for(auto i = 0u; i < params.size(); ++i) {
+			args.push_back(convert(expr(*call->arguments[i]), *params[i]).id);
+		}
+
+		auto id = function(*call->called);
+		return op(Op::functionCall, call->called->returnType(), {id}, args);
+	} else if(auto* opExpr = dynamic_cast<const OpExpression*>(&e)) {
+		auto opType = opExpr->opType;
+		if(opType == OpType::logicalAnd || opType == OpType::logicalOr) {
+			return logical(*opExpr);
+		} else if(opType == OpType::neg) {
+			assert(opExpr->children.size() == 1u);
+			return negate(expr(*opExpr->children[0]));
+		}
+
+		// variables are loaded when evaluated, the operands are
+		// read in order even if later ones assign
+		auto acc = expr(*opExpr->children[0]);
+		for(auto i = 1u; i < opExpr->children.size(); ++i) {
+			acc = binary(opType, acc, expr(*opExpr->children[i]));
+		}
+		return acc;
+	} else if(auto* codeBlock = dynamic_cast<const CodeBlock*>(&e)) {
+		return body(*codeBlock, typeOf(e));
+	} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&e)) {
+		return this->ifExpr(*ifExpr, 0u, typeOf(e));
+	}
+
+	assert(!"Invalid expression");
+	return {};
+}
+
+Generator::Value Generator::lvalue(const Expression& e) {
+	if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+		assert(assigned_.count(ident->decl) && values_.count(ident->decl));
+		return {values_[ident->decl], ident->decl->type};
+	} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+		auto base = lvalue(*access->accessed);
+		auto& stype = static_cast<const StructType&>(*base.type);
+		auto& member = *access->accessor;
+		auto ptr = pointer(*member.type);
+		auto slot = index(stype.slot(member));
+		auto id = next_++;
+		inst(code_, Op::accessChain, {ptr, id, base.id, slot});
+		return {id, member.type};
+	}
+
+	assert(!"Can only assign to variables and their members");
+	return {};
+}
+
+// Every branch is a selection construct, else-if branches are nested
+// in the else block of the previous one.
+Generator::Value Generator::ifExpr(const IfExpression& e, unsigned i, const Type& t) {
+	auto& branch = i ? e.elsifBranches[i - 1] : e.ifBranch;
+	auto cond = expr(*branch.condition);
+	auto header = current_;
+	auto then = label();
+	auto merge = label();
+	auto hasElse = i < e.elsifBranches.size() || e.elseBranch;
+	auto otherwise = hasElse ? label() : merge;
+	inst(code_, Op::selectionMerge, {merge, 0u});
+	inst(code_, Op::branchConditional, {cond.id, then, otherwise});
+
+	Words incoming; // value, parent block
+	block(then);
+	auto value = body(*branch.code, t);
+	incoming.insert(incoming.end(), {value.id, current_});
+	jump(merge);
+
+	if(hasElse) {
+		block(otherwise);
+		value = (i < e.elsifBranches.size()) ?
+			ifExpr(e, i + 1, t) :
+			body(*e.elseBranch, t);
+		incoming.insert(incoming.end(), {value.id, current_});
+		jump(merge);
+	}
+
+	block(merge);
+	if(isVoid(t)) {
+		return {0u, &t};
+	}
+
+	if(!hasElse) {
+		incoming.insert(incoming.end(), {undef(t), header});
+	}
+
+	return op(Op::phi, t, {}, incoming);
+}
+
+Generator::Value Generator::logical(const OpExpression& e) {
+	auto isAnd = (e.opType == OpType::logicalAnd);
+	auto& boolType = BuiltinType::boolType();
+	auto acc = expr(*e.children[0]);
+	for(auto i = 1u; i < e.children.size(); ++i) {
+		auto& child = *e.children[i];
+		if(!assigning_.count(&child)) {
+			auto rhs = expr(child);
+			acc = op(isAnd ? Op::logicalAnd : Op::logicalOr, boolType, {acc.id, rhs.id});
+			continue;
+		}
+
+		// the operand has side effects, only evaluate it when needed
+		auto header = current_;
+		auto rhsLabel = label();
+		auto merge = label();
+		inst(code_, Op::selectionMerge, {merge, 0u});
+		if(isAnd) {
+			inst(code_, Op::branchConditional, {acc.id, rhsLabel, merge});
+		} else {
+			inst(code_, Op::branchConditional, {acc.id, merge, rhsLabel});
+		}
+
+		block(rhsLabel);
+		auto rhs = expr(child);
+		auto end = current_;
+		jump(merge);
+
+		block(merge);
+		acc = op(Op::phi, boolType, {acc.id, header, rhs.id, end});
+	}
+
+	return acc;
+}
+
+Generator::Value Generator::binary(OpType opType, Value a, Value b) {
+	if(isComparison(opType)) {
+		return compare(opType, a, b);
+	}
+
+	auto& ta = builtin(*a.type);
+	auto& tb = builtin(*b.type);
+	auto& result = builtin(resultType(opType, *a.type, *b.type));
+	if(isMatrixProduct(opType, ta, tb)) {
+		assert(isFloat(ta) && "Only float matrices can be multiplied");
+		auto code = (ta.cols == 1) ? Op::vectorTimesMatrix :
+			(tb.cols == 1) ? Op::matrixTimesVector : Op::matrixTimesMatrix;
+		return op(code, result, {a.id, b.id});
+	}
+
+	if(opType == OpType::mult && isFloat(ta) && isScalar(ta) != isScalar(tb)) {
+		auto [value, scalar] = isScalar(ta) ? std::pair{b, a} : std::pair{a, b};
+		auto code = (result.cols > 1) ? Op::matrixTimesScalar : Op::vectorTimesScalar;
+		return op(code, result, {value.id, scalar.id});
+	}
+
+	// the other operations need operands of the same type
+	if(isScalar(ta) && !isScalar(tb)) {
+		a = splat(a.id, tb);
+	} else if(isScalar(tb) && !isScalar(ta)) {
+		b = splat(b.id, ta);
+	}
+
+	auto code = arithOp(opType, result.type);
+	if(result.cols == 1) {
+		return op(code, result, {a.id, b.id});
+	}
+
+	// matrices column by column
+	auto& column = BuiltinType::vecType(result.type, result.rows);
+	Words columns;
+	for(auto c = 0u; c < result.cols; ++c) {
+		auto ca = op(Op::compositeExtract, column, {a.id, c});
+		auto cb = op(Op::compositeExtract, column, {b.id, c});
+		columns.push_back(op(code, column, {ca.id, cb.id}).id);
+	}
+
+	return op(Op::compositeConstruct, result, {}, columns);
+}
+
+Generator::Value Generator::compare(OpType opType, Value a, Value b) {
+	auto& ta = builtin(*a.type);
+	auto& tb = builtin(*b.type);
+	if(isScalar(ta) && !isScalar(tb)) {
+		a = splat(a.id, tb);
+	} else if(isScalar(tb) && !isScalar(ta)) {
+		b = splat(b.id, ta);
+	}
+
+	auto& operand = builtin(*a.type);
+	auto& boolType = BuiltinType::boolType();
+	auto code = compareOp(opType, operand.type);
+	if(isScalar(operand)) {
+		return op(code, boolType, {a.id, b.id});
+	}
+
+	// vectors and matrices compare as a whole, like in the vm
+	assert((opType == OpType::eq || opType == OpType::neq) &&
+		"Only scalars can be ordered");
+	auto eq = (opType == OpType::eq);
+	auto& column = BuiltinType::vecType(operand.type, operand.rows);
+	auto& result = BuiltinType::vecType(BT::eBool, operand.rows);
+	Value acc {};
+	for(auto c = 0u; c < operand.cols; ++c) {
+		auto ca = a.id;
+		auto cb = b.id;
+		if(operand.cols > 1) {
+			ca = op(Op::compositeExtract, column, {a.id, c}).id;
+			cb = op(Op::compositeExtract, column, {b.id, c}).id;
+		}
+
+		auto components = op(code, result, {ca, cb});
+		auto value = op(eq ? Op::all : Op::any, boolType, {components.id});
+		acc = (c == 0u) ? value :
+			op(eq ? Op::logicalAnd : Op::logicalOr, boolType, {acc.id, value.id});
+	}
+
+	return acc;
+}
+
+Generator::Value Generator::negate(Value a) {
+	auto& operand = builtin(*a.type);
+	auto code = isFloat(operand) ? Op::fNegate : Op::sNegate;
+	if(operand.cols == 1) {
+		return op(code, operand, {a.id});
+	}
+
+	auto& column = BuiltinType::vecType(operand.type, operand.rows);
+	Words columns;
+	for(auto c = 0u; c < operand.cols; ++c) {
+		auto ca = op(Op::compositeExtract, column, {a.id, c});
+		columns.push_back(op(code, column, {ca.id}).id);
+	}
+
+	return op(Op::compositeConstruct, operand, {}, columns);
+}
+
+Generator::Value Generator::convert(Value value, const Type& t) {
+	if(value.type == &t) {
+		return value;
+	}
+
+	// scalars are broadcast to vectors and matrices
+	assert(isScalar(builtin(*value.type)) && "Value has a different type");
+	return splat(value.id, builtin(t));
+}
+
+Generator::Value Generator::splat(Id scalar, const BuiltinType& t) {
+	if(t.cols > 1) {
+		auto column = splat(scalar, BuiltinType::vecType(t.type, t.rows));
+		return op(Op::compositeConstruct, t, {}, Words(t.cols, column.id));
+	}
+
+	return op(Op::compositeConstruct, t, {}, Words(t.rows, scalar));
+}
+
+} // anon namespace
+
+std::vector<std::uint32_t> generate(const Module& mod) {
+	return Generator(mod).generate();
+}
+
+} // namespace ast::spirv
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Lowers a module directly to a SPIR-V binary, without going through
+// any text. The result is a library module (Linkage capability): every
+// function is exported under its name and parameter types, e.g.
+// 'twice(i32)', so that overloads don't clash. Functions of imported
+// modules that are called are declared as imports under the same
+// names, to be linked e.g. with spirv-link.
+// Struct types get std430 layout decorations (offsets, matrix strides).
+// If expressions become selection constructs with a phi for their
+// value, variables are only given memory when they are assigned.
+// Unlike the vm, integer division by zero and shifts by 32 or more are
+// undefined, as in SPIR-V.
+namespace ast::spirv {
+
+std::vector<std::uint32_t> generate(const Module& mod);
+
+} // namespace ast::spirv
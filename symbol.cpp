@@ -0,0 +1,136 @@
+#include "symbol.hpp"
+#include "arena.hpp"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace ast {
+
+namespace {
+
+// The lookup maps are split into shards by hash so that threads
+// interning different strings rarely wait for each other.
+// The names are stored in fixed-size chunks that never move, reading
+// the name of a symbol therefore doesn't need a lock.
+class SymbolTable {
+public:
+	static constexpr auto shardCount = 16u;
+	static constexpr auto chunkBits = 12u;
+	static constexpr auto chunkSize = 1u << chunkBits;
+	static constexpr auto maxChunks = 4096u;
+
+	SymbolTable() {
+		// id 0 is the empty string
+		auto& shard = shards_[shardIndex({})];
+		shard.ids.emplace(std::string_view{}, 0u);
+		chunk(0u)[0] = {};
+	}
+
+	~SymbolTable() {
+		for(auto& c : chunks_) {
+			delete[] c.load(std::memory_order_relaxed);
+		}
+	}
+
+	std::uint32_t intern(std::string_view str) {
+		auto& shard = shards_[shardIndex(str)];
+		std::lock_guard lock(shard.mutex);
+		auto it = shard.ids.find(str);
+		if(it != shard.ids.end()) {
+			return it->second;
+		}
+
+		auto id = next_.fetch_add(1u, std::memory_order_relaxed);
+		assert(id < maxChunks * chunkSize && "Too many symbols");
+
+		// the table owns a copy of every distinct string since it outlives
+		// the sources the strings come from
+		auto* data = static_cast<char*>(shard.strings.allocate(str.size(), 1u));
+		std::memcpy(data, str.data(), str.size());
+		auto stored = std::string_view(data, str.size());
+
+		chunk(id)[id & (chunkSize - 1)] = stored;
+		shard.ids.emplace(stored, id);
+		return id;
+	}
+
+	std::uint32_t find(std::string_view str) {
+		auto& shard = shards_[shardIndex(str)];
+		std::lock_guard lock(shard.mutex);
+		auto it = shard.ids.find(str);
+		return (it == shard.ids.end()) ? 0u : it->second;
+	}
+
+	std::string_view lookup(std::uint32_t id) const {
+		auto* c = chunks_[id >> chunkBits].load(std::memory_order_acquire);
+		assert(c && "Invalid symbol");
+		return c[id & (chunkSize - 1)];
+	}
+
+	std::size_t count() const {
+		return next_.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<std::string_view, std::uint32_t> ids;
+		Arena strings {4096};
+	};
+
+	static unsigned shardIndex(std::string_view str) {
+		return std::hash<std::string_view>{}(str) % shardCount;
+	}
+
+	std::string_view* chunk(std::uint32_t id) {
+		auto& slot = chunks_[id >> chunkBits];
+		auto* c = slot.load(std::memory_order_acquire);
+		if(c) {
+			return c;
+		}
+
+		// might race with another shard creating the same chunk
+		auto* created = new std::string_view[chunkSize];
+		if(slot.compare_exchange_strong(c, created, std::memory_order_acq_rel)) {
+			return created;
+		}
+
+		delete[] created;
+		return c;
+	}
+
+	std::array<Shard, shardCount> shards_;
+	std::array<std::atomic<std::string_view*>, maxChunks> chunks_ {};
+	std::atomic<std::uint32_t> next_ {1u};
+};
+
+SymbolTable& symbolTable() {
+	static SymbolTable table;
+	return table;
+}
+
+} // anon namespace
+
+std::uint32_t Symbol::intern(std::string_view str) {
+	return symbolTable().intern(str);
+}
+
+std::string_view Symbol::lookup(std::uint32_t id) {
+	return symbolTable().lookup(id);
+}
+
+Symbol Symbol::find(std::string_view str) {
+	Symbol ret;
+	ret.id_ = symbolTable().find(str);
+	return ret;
+}
+
+std::size_t Symbol::count() {
+	return symbolTable().count();
+}
+
+} // namespace ast
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+namespace ast {
+
+// Interned string, e.g. the name of an identifier.
+// Equal strings always get the same 32-bit id, so comparing and hashing
+// symbols are integer operations. The table of interned strings is
+// global and thread-safe, symbols can be shared between modules and
+// threads. The empty string has id 0, which is also the default.
+class Symbol {
+public:
+	Symbol() = default;
+	explicit Symbol(std::string_view str) : id_(intern(str)) {}
+
+	std::uint32_t id() const { return id_; }
+	bool empty() const { return id_ == 0u; }
+
+	// The interned string, valid for the whole lifetime of the program.
+	std::string_view str() const { return lookup(id_); }
+
+	// Returns the symbol for the given string if it was already
+	// interned, otherwise the empty symbol.
+	static Symbol find(std::string_view str);
+
+	// Number of distinct symbols interned so far.
+	static std::size_t count();
+
+	friend bool operator==(Symbol a, Symbol b) { return a.id_ == b.id_; }
+	friend bool operator!=(Symbol a, Symbol b) { return a.id_ != b.id_; }
+	friend bool operator<(Symbol a, Symbol b) { return a.id_ < b.id_; }
+
+private:
+	static std::uint32_t intern(std::string_view str);
+	static std::string_view lookup(std::uint32_t id);
+
+	std::uint32_t id_ {};
+};
+
+// Start slot of a symbol id in an open addressing table with 2^bits
+// slots. Fibonacci hashing: the high bits of the product depend on all
+// bits of the id, sequential ids are spread over the whole table.
+inline std::size_t hashSlot(std::uint32_t id, unsigned bits) {
+	return bits ? std::size_t((id * 2654435769u) >> (32u - bits)) : 0u;
+}
+
+} // namespace ast
+
+template<>
+struct std::hash<ast::Symbol> {
+	std::size_t operator()(ast::Symbol sym) const noexcept {
+		return sym.id();
+	}
+};
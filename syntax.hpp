@@ -1,9 +1,48 @@
+#pragma once
+
 #include "tao/pegtl.hpp"
+#include "lexer.hpp"
+#include "operators.hpp"
 
 namespace pegtl = tao::pegtl;
 
 namespace syn {
 
+// Rule that matches via the precomputed tokens when parsing a
+// lex::TokenInput and like the character-level Rule otherwise.
+// Derives from Rule so that pegtl::analyze sees the character-level rule.
+// Lexed must provide `static bool match(lex::TokenInput&)`.
+template<typename Rule, typename Lexed>
+struct Lexable : Rule {
+	template<pegtl::apply_mode A, pegtl::rewind_mode M,
+		template<typename...> class Action,
+		template<typename...> class Control,
+		typename ParseInput, typename... States>
+	static bool match(ParseInput& in, States&&... st) {
+		if constexpr(lex::isTokenInput<ParseInput>) {
+			return Lexed::match(in);
+		} else {
+			return Rule::template match<A, M, Action, Control>(in, st...);
+		}
+	}
+};
+
+struct LexedSeparators {
+	static bool match(lex::TokenInput& in) { return in.skipSeparators(); }
+};
+
+struct LexedWord {
+	static bool match(lex::TokenInput& in) { return in.matchWord(); }
+};
+
+template<lex::TokenKind Kind>
+struct LexedToken {
+	static bool match(lex::TokenInput& in) { return in.matchToken(Kind); }
+};
+
+template<lex::TokenKind Kind, char... Cs>
+struct Keyword : Lexable<pegtl::keyword<Cs...>, LexedToken<Kind>> {};
+
 // https://stackoverflow.com/questions/53427551/pegtl-how-to-skip-spaces-for-the-entire-grammar
 struct LineComment : pegtl::seq<
 		pegtl::sor<
@@ -19,44 +58,62 @@ struct InlineComment : pegtl::seq<
 			pegtl::utf8::any>> {};
 
 struct Comment : pegtl::disable<pegtl::sor<LineComment, InlineComment>> {};
-struct Separator : pegtl::sor<tao::pegtl::ascii::space, Comment> {};
+// With a lex::TokenInput this skips all separators in one step
+struct Separator : Lexable<
+	pegtl::sor<tao::pegtl::ascii::space, Comment>,
+	LexedSeparators> {};
 struct Seps : tao::pegtl::star<Separator> {}; // Any separators, whitespace or comments
 
 template<typename S, typename... R> using Interleaved = pegtl::seq<S, pegtl::seq<R, S>...>;
 template<typename S, typename... R> using IfMustSep =
 	pegtl::if_must<pegtl::pad<S, Separator>, Seps, R...>;
 
-struct Plus : pegtl::one<'+'> {};
-struct Minus : pegtl::one<'-'> {};
-struct Mult : pegtl::one<'*'> {};
-struct Divide : pegtl::one<'/'> {};
 struct Comma : pegtl::one<','> {};
 struct Dot : pegtl::one<'.'> {};
 struct Semicolon : pegtl::one<';'> {};
 struct Colon : pegtl::one<':'> {};
 
 
-struct Identifier : pegtl::plus<pegtl::alpha> {};
+// Keywords
+struct KwTrue : Keyword<lex::TokenKind::kwTrue, 't', 'r', 'u', 'e'> {};
+struct KwFalse : Keyword<lex::TokenKind::kwFalse, 'f', 'a', 'l', 's', 'e'> {};
+struct KwIf : Keyword<lex::TokenKind::kwIf, 'i', 'f'> {};
+struct KwElse : Keyword<lex::TokenKind::kwElse, 'e', 'l', 's', 'e'> {};
+struct KwEnum : Keyword<lex::TokenKind::kwEnum, 'e', 'n', 'u', 'm'> {};
+struct KwStruct : Keyword<lex::TokenKind::kwStruct, 's', 't', 'r', 'u', 'c', 't'> {};
+struct KwUsing : Keyword<lex::TokenKind::kwUsing, 'u', 's', 'i', 'n', 'g'> {};
+struct KwNamespace : Keyword<lex::TokenKind::kwNamespace,
+	'n', 'a', 'm', 'e', 's', 'p', 'a', 'c', 'e'> {};
+struct KwImport : Keyword<lex::TokenKind::kwImport, 'i', 'm', 'p', 'o', 'r', 't'> {};
+
+struct Keywords : pegtl::sor<KwTrue, KwFalse, KwIf, KwElse, KwEnum,
+	KwStruct, KwUsing, KwNamespace, KwImport> {};
+
+// Keywords are not valid identifiers, otherwise e.g. a struct
+// declaration would first be tried as function returning 'struct'.
+struct Identifier : Lexable<
+	pegtl::seq<pegtl::not_at<Keywords>, pegtl::identifier>,
+	LexedWord> {};
 
 // Literals
-struct TrueLiteral : pegtl::keyword<'t', 'r', 'u', 'e'> {};
-struct FalseLiteral : pegtl::keyword<'f', 'a', 'l', 's', 'e'> {};
+struct TrueLiteral : pegtl::seq<KwTrue> {};
+struct FalseLiteral : pegtl::seq<KwFalse> {};
 struct BooleanLiteral : pegtl::sor<TrueLiteral, FalseLiteral> {};
 
 // Number literals
 // Default decimal suffix: 32-bit integer
 struct SuffixI32 : pegtl::sor<
-	pegtl::string<'i'>,
-	pegtl::string<'i', '3', '2'>
+	pegtl::string<'i', '3', '2'>,
+	pegtl::string<'i'>
 > {};
 struct SuffixU32 : pegtl::sor<
-	pegtl::string<'u'>,
-	pegtl::string<'u', '3', '2'>
+	pegtl::string<'u', '3', '2'>,
+	pegtl::string<'u'>
 > {};
 // Default float suffix
 struct SuffixF32 : pegtl::sor<
-	pegtl::string<'f'>,
-	pegtl::string<'f', '3', '2'>
+	pegtl::string<'f', '3', '2'>,
+	pegtl::string<'f'>
 > {};
 struct SuffixF64 : pegtl::string<'f', '6', '4'> {};
 
@@ -88,16 +145,34 @@ struct Literal : pegtl::sor<
 struct Expr;
 struct IfExpr;
 
-struct Assign : Interleaved<Seps,
-	Expr,
-	pegtl::one<'='>,
-	Expr> {};
-
-struct ExprStatement : pegtl::seq<Expr> {};
+// Expression statements and assignments share the left hand side,
+// it is parsed only once and then followed by an optional assignment.
+struct AssignValue : pegtl::seq<Expr> {};
+struct Assign : pegtl::if_must<
+	pegtl::seq<pegtl::one<'='>, pegtl::not_at<pegtl::one<'='>>>,
+	Seps,
+	AssignValue> {};
+struct ExprStatement : Interleaved<Seps, Expr, pegtl::opt<Assign>> {};
 struct StatementSemi : Interleaved<Seps,
-	pegtl::sor<Assign, ExprStatement>,
+	ExprStatement,
 	Semicolon> {};
-struct Statement : pegtl::sor<StatementSemi, IfExpr> {};
+
+struct Type : pegtl::seq<Identifier> {};
+
+// Variable declaration, e.g. 'f32 x = 1.0;'. Only commits once type,
+// name and '=' were matched, otherwise it is an expression statement.
+struct VariableInit : pegtl::seq<Expr> {};
+struct VariableDecl : pegtl::if_must<
+	pegtl::seq<Type, Seps, Identifier, Seps, pegtl::one<'='>, pegtl::not_at<pegtl::one<'='>>>,
+	Seps,
+	VariableInit> {};
+struct VariableDeclEnd : pegtl::one<';'> {};
+struct VariableDeclSemi : pegtl::if_must<VariableDecl, Seps, VariableDeclEnd> {};
+
+// If expressions don't need a semicolon when used as statement.
+// Tried first so they aren't parsed as expression statement before.
+struct IfStatement : pegtl::seq<IfExpr, pegtl::opt<Seps, Semicolon>> {};
+struct Statement : pegtl::sor<IfStatement, VariableDeclSemi, StatementSemi> {};
 
 struct CodeBlockReturn : pegtl::seq<Expr> {};
 struct OptCodeBlockReturn : pegtl::opt<CodeBlockReturn> {};
@@ -112,10 +187,10 @@ struct CodeBlock : pegtl::if_must<pegtl::one<'{'>,
 	CodeBlockClose
 > {};
 
-struct ElseKeyword : pegtl::keyword<'e', 'l', 's', 'e'> {};
+struct ElseKeyword : pegtl::seq<KwElse> {};
 struct ElseIfKeyword : Interleaved<Seps,
-	pegtl::keyword<'e', 'l', 's', 'e'>,
-	pegtl::keyword<'i', 'f'>
+	KwElse,
+	KwIf
 > {};
 struct Branch : Interleaved<Seps, Expr, CodeBlock> {};
 struct ElseIfBranch : pegtl::if_must<ElseIfKeyword, Seps, Branch> {};
@@ -123,13 +198,11 @@ struct ElseCodeBlock : CodeBlock {};
 struct ElseBranch : pegtl::if_must<ElseKeyword, Seps, ElseCodeBlock> {};
 struct ElseIfs : pegtl::star<ElseIfBranch> {};
 struct IfExpr : Interleaved<Seps,
-	pegtl::if_must<pegtl::keyword<'i', 'f'>, Seps, Branch>,
+	pegtl::if_must<KwIf, Seps, Branch>,
 	ElseIfs,
 	pegtl::opt<ElseBranch>
 > {};
 
-struct Type : pegtl::seq<Identifier> {};
-
 // function
 struct FunctionParameter : Interleaved<Seps,
 	Type,
@@ -159,7 +232,7 @@ struct ContentEnumValue : Interleaved<Seps,
 > {};
 struct EnumValue : pegtl::sor<ContentEnumValue, PlainEnumValue> {};
 struct EnumDecl : Interleaved<Seps,
-	pegtl::keyword<'e', 'n', 'u', 'm'>,
+	KwEnum,
 	Identifier,
 	pegtl::one<'{'>,
 	pegtl::list_tail<EnumValue, Comma, Separator>,
@@ -178,7 +251,7 @@ struct StructMember : Interleaved<Seps,
 	pegtl::opt<StructMemberInit>
 > {};
 struct StructDecl : Interleaved<Seps,
-	pegtl::keyword<'s', 't', 'r', 'u', 'c', 't'>,
+	KwStruct,
 	Identifier,
 	pegtl::one<'{'>,
 	pegtl::list_tail<StructMember, Semicolon, Separator>,
@@ -187,7 +260,7 @@ struct StructDecl : Interleaved<Seps,
 
 // using declarations
 struct UsingTypeDecl : Interleaved<Seps,
-	pegtl::keyword<'u', 's', 'i', 'n', 'g'>,
+	KwUsing,
 	Identifier,
 	pegtl::one<'='>,
 	Identifier,
@@ -195,8 +268,8 @@ struct UsingTypeDecl : Interleaved<Seps,
 > {};
 
 // expression
-struct IdentifierExpr : pegtl::sor<Identifier,
-	pegtl::star<pegtl::if_must<Colon, Colon, Identifier>>
+struct IdentifierExpr : pegtl::seq<Identifier,
+	pegtl::star<pegtl::if_must<pegtl::seq<Colon, Colon>, Identifier>>
 > {};
 struct AtomExpr : pegtl::sor<Literal, IdentifierExpr> {};
 
@@ -224,7 +297,7 @@ struct Expr0 : pegtl::sor<
 	AtomExpr
 > {};
 
-struct FunctionArgsList : pegtl::opt<pegtl::list_tail<Identifier, Comma, Separator>> {};
+struct FunctionArgsList : pegtl::opt<pegtl::list_tail<Expr, Comma, Separator>> {};
 struct FunctionArgsListClose : pegtl::one<')'> {};
 struct FunctionArgsListP : pegtl::if_must<
 	pegtl::one<'('>,
@@ -281,40 +354,41 @@ struct MemberFunctionChain : Interleaved<Seps,
 // 	pegtl::star<MemberAccess>
 // > {};
 
-struct PrimaryExpr : pegtl::sor<
-	// TODO: make if_must?
-	Interleaved<Seps, pegtl::one<'-'>, MemberFunctionChain>,
+struct Negate : pegtl::one<'-'> {};
+struct PrimaryExpr : Interleaved<Seps,
+	pegtl::opt<Negate>,
 	MemberFunctionChain> {};
 
 template<typename R, typename... S>
 struct OptIfMust : pegtl::if_then_else<R, pegtl::must<S...>, pegtl::success> {};
 
-struct AddExpr;
-struct MultExpr;
-struct SubExpr;
-struct DivExpr;
-
-// struct AddRest : pegtl::opt<Interleaved<Seps, Plus, AddExpr>> {};
-// struct DivRest : pegtl::opt<Interleaved<Seps, Divide, PrimaryExpr>> {};
-// struct SubRest : pegtl::opt<Interleaved<Seps, Minus, MultExpr>> {};
-// struct MultRest : pegtl::opt<Interleaved<Seps, Mult, DivExpr>> {};
-
-struct AddPart : pegtl::seq<SubExpr> {};
-struct DivPart : pegtl::seq<PrimaryExpr> {};
-struct SubPart : pegtl::seq<MultExpr> {};
-struct MultPart : pegtl::seq<DivExpr> {};
-
-struct AddRest : pegtl::star<pegtl::if_must<Plus, Seps, SubPart, Seps>> {};
-struct DivRest : pegtl::star<pegtl::if_must<Divide, Seps, DivPart, Seps>> {};
-struct SubRest : pegtl::star<pegtl::if_must<Minus, Seps, MultPart, Seps>> {};
-struct MultRest : pegtl::star<pegtl::if_must<Mult, Seps, DivPart, Seps>> {};
-
-struct DivExpr : Interleaved<Seps, PrimaryExpr, DivRest> {};
-struct MultExpr : Interleaved<Seps, DivExpr, MultRest> {};
-struct SubExpr : Interleaved<Seps, MultExpr, SubRest> {};
-struct AddExpr : Interleaved<Seps, SubExpr, AddRest> {};
-
-struct Expr : pegtl::sor<IfExpr, AddExpr> {};
+// Matches the longest operator from ast::binaryOperators.
+// Derives from a character rule so that pegtl::analyze sees a rule
+// that consumes input.
+struct BinaryOp : pegtl::one<'+', '-', '*', '/', '%', '<', '>', '=', '!', '&', '|', '^'> {
+	template<pegtl::apply_mode A, pegtl::rewind_mode M,
+		template<typename...> class Action,
+		template<typename...> class Control,
+		typename ParseInput, typename... States>
+	static bool match(ParseInput& in, States&&...) {
+		auto* op = ast::matchBinaryOperator({in.current(), in.size()});
+		if(!op) {
+			return false;
+		}
+
+		in.bump(op->token.size());
+		return true;
+	}
+};
+
+struct BinaryOperand : pegtl::seq<PrimaryExpr> {};
+struct BinaryRest : pegtl::star<pegtl::if_must<BinaryOp, Seps, BinaryOperand, Seps>> {};
+
+// Flat list of operands and operators, precedence and associativity
+// are resolved when building the ast (see builder::BuilderBase::binaryExpr).
+struct BinaryExpr : Interleaved<Seps, PrimaryExpr, BinaryRest> {};
+
+struct Expr : pegtl::sor<IfExpr, BinaryExpr> {};
 
 // Inputs
 /*
@@ -329,7 +403,7 @@ struct GlobalDecls : pegtl::star<pegtl::pad<GlobalDecl, Separator>> {};
 
 // namespace
 struct NamespaceDecl : Interleaved<Seps,
-	pegtl::keyword<'n', 'a', 'm', 'e', 's', 'p', 'a', 'c', 'e'>,
+	KwNamespace,
 	Identifier,
 	pegtl::one<'{'>,
 	GlobalDecls,
@@ -337,15 +411,22 @@ struct NamespaceDecl : Interleaved<Seps,
 > {};
 
 // import
+// The name of the imported module, i.e. the file name without extension.
+struct ImportName : pegtl::seq<Identifier> {};
 struct ImportDecl : Interleaved<Seps,
-	pegtl::keyword<'i', 'm', 'p', 'o', 'r', 't'>,
-	Identifier
+	KwImport,
+	ImportName
 > {};
 
+// Imports have to come first so that they can be found by just
+// parsing the start of a file, see ImportScan.
+struct Imports : pegtl::star<pegtl::pad<ImportDecl, Separator>> {};
+struct ImportScan : pegtl::seq<Seps, Imports> {};
+
 // TODO: export
 
 // Module
-struct Module : GlobalDecls {};
+struct Module : pegtl::seq<Imports, GlobalDecls> {};
 
 struct Eof : pegtl::eof {};
 struct Grammar : pegtl::must<Module, Eof> {};
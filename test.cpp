@@ -1,5 +1,18 @@
 #include "syntax.hpp"
+#include "errors.hpp"
+#include "lexer.hpp"
 #include "ast.hpp"
+#include "flat.hpp"
+#include "fold.hpp"
+#include "vm.hpp"
+#include "cppgen.hpp"
+#include "spvgen.hpp"
+#include "ir.hpp"
+#include "inliner.hpp"
+#include "actions.hpp"
+#include "driver.hpp"
+#include "profiler.hpp"
+#include "timetrace.hpp"
 
 #include "tao/pegtl.hpp"
 #include "tao/pegtl/contrib/trace.hpp"
@@ -9,6 +22,7 @@
 
 #include <cstdio>
 #include <fstream>
+#include <optional>
 
 struct Discard : pegtl::parse_tree::apply<Discard> {
 	template<typename Node, typename... States>
@@ -100,6 +114,8 @@ struct Keep : pegtl::parse_tree::apply<Keep> {
 template<typename Rule> struct selector : FoldDiscard {};
 
 template<> struct selector<syn::Identifier> : DiscardChildren {};
+template<> struct selector<syn::IdentifierExpr> : DiscardChildren {};
+template<> struct selector<syn::MemberAccess> : DiscardChildren {};
 
 template<> struct selector<syn::CodeBlock> : ConsumeFirst {};
 template<> struct selector<syn::CodeBlockStatements> : Keep {};
@@ -111,6 +127,8 @@ template<> struct selector<syn::IfExpr> : ConsumeFirst {};
 template<> struct selector<syn::ElseIfs> : Keep {};
 
 template<> struct selector<syn::ExprStatement> : Keep {};
+template<> struct selector<syn::VariableDecl> : Keep {};
+template<> struct selector<syn::Negate> : Keep {};
 
 template<> struct selector<syn::TrueLiteral> : Keep {};
 template<> struct selector<syn::FalseLiteral> : Keep {};
@@ -127,95 +145,316 @@ template<> struct selector<syn::FunctionArgsList> : Keep {};
 
 // template<> struct selector<syn::FunctionArgLists> : Keep {};
 // template<> struct selector<syn::MemberAccessors> : Keep {};
-template<> struct selector<syn::AddRest> : Keep {};
-template<> struct selector<syn::MultRest> : Keep {};
-template<> struct selector<syn::DivRest> : Keep {};
-template<> struct selector<syn::SubRest> : Keep {};
+template<> struct selector<syn::BinaryOp> : Keep {};
+template<> struct selector<syn::BinaryRest> : Keep {};
 template<> struct selector<syn::MemberFunctionChainLinks> : Keep {};
+template<> struct selector<syn::MemberFunctionChainAccess> : Keep {};
+template<> struct selector<syn::MemberFunctionChainCall> : Keep {};
 
-template<> struct selector<syn::AddExpr> : ChainSelector<> {};
-template<> struct selector<syn::SubExpr> : ChainSelector<> {};
-template<> struct selector<syn::DivExpr> : ChainSelector<> {};
-template<> struct selector<syn::MultExpr> : ChainSelector<> {};
+template<> struct selector<syn::BinaryExpr> : ChainSelector<> {};
 // template<> struct selector<syn::MemberAccessChain> : ChainSelector<> {};
 // template<> struct selector<syn::FunctionCall> : ChainSelector<> {};
 // template<> struct selector<syn::MemberAccessor> : ChainSelector<false> {};
 template<> struct selector<syn::MemberFunctionChain> : ChainSelector<> {};
 
 template<> struct selector<syn::Seps> : Discard {};
-template<> struct selector<syn::Plus> : Discard {};
-template<> struct selector<syn::Minus> : Discard {};
-template<> struct selector<syn::Mult> : Discard {};
-template<> struct selector<syn::Divide> : Discard {};
 template<char c> struct selector<pegtl::one<c>> : Discard {};
 
-// errors
-template<typename> inline constexpr const char* error_message = nullptr;
-template<> inline constexpr const char* error_message<syn::AddPart> = "Expected expression after '+'";
-template<> inline constexpr const char* error_message<syn::MultPart> = "Expected expression after '*'";
-template<> inline constexpr const char* error_message<syn::DivPart> = "Expected expression after '/'";
-template<> inline constexpr const char* error_message<syn::SubPart> = "Expected expression after '-'";
-template<> inline constexpr const char* error_message<syn::ParanthExprClose> = "Closing ')' after expression is missing";
-template<> inline constexpr const char* error_message<syn::CodeBlockClose> = "Closing '}' after code block is missing";
-template<> inline constexpr const char* error_message<syn::Eof> = "Expected end of file";
-template<> inline constexpr const char* error_message<syn::Branch> = "Expected branch (condition and codeblock)";
-template<> inline constexpr const char* error_message<syn::ElseCodeBlock> = "Expected codeblock after 'else'";
-template<> inline constexpr const char* error_message<syn::Expr> = "Expected expression";
-template<> inline constexpr const char* error_message<syn::MemberAccessor> = "Expected member-access expression after '.'";
-template<> inline constexpr const char* error_message<syn::FunctionArgsListClose> = "Expected ')' to close function arguments list";
-
-template<> inline constexpr const char* error_message<syn::FunctionArgsList> = "Expected expression as function parameter"; // can't fail i guess?
-template<> inline constexpr const char* error_message<syn::CodeBlockStatements> = "Expected statement"; // can't fail I guess?
-template<> inline constexpr const char* error_message<syn::OptCodeBlockReturn> = "Expected (optional) code block return"; // can't fail I guess?
-template<> inline constexpr const char* error_message<syn::Seps> = "Unexpected parser error: Expected separator"; // can't fail I guess?
-
-struct error {
-	template<typename Rule> static constexpr auto message = error_message<Rule>;
-
-	// template<typename Rule> static constexpr auto message =
-	// 	error_message<Rule> ? error_message<Rule> : tao::demangle<Rule>().data();
+
+// Runs the function with the given name and without parameters on
+// the bytecode vm and prints its result.
+void run(const ast::Module& mod, std::string_view name, bool bytecode) {
+	for(auto* func : mod.functions) {
+		if(func->name() != name || !func->params.empty()) {
+			continue;
+		}
+
+		ast::vm::Program program;
+		auto index = program.add(*func);
+		ast::Printer printer(std::cout);
+		if(bytecode) {
+			program.write(printer);
+		}
+
+		ast::vm::Machine machine(program);
+		auto result = machine.run(index, {});
+		printer << name << "() = ";
+		ast::vm::write(printer, func->returnType(), result.data());
+		printer.newline();
+	}
+}
+
+// Lowers every function of the module to the ir, verifies and prints it.
+// With gvn, redundant instructions are removed first.
+void printIr(const ast::Module& mod, bool gvn) {
+	ast::Printer printer(std::cout);
+	for(auto* func : mod.functions) {
+		auto ir = ast::ir::lower(*func);
+		if(gvn) {
+			auto removed = ast::ir::removeRedundant(ir);
+			printer << func->name() << ": gvn removed " << removed << " instructions";
+			printer.newline();
+		}
+
+		ast::ir::write(printer, ir);
+		printer.newline();
+
+		auto error = ast::ir::verify(ir);
+		if(!error.empty()) {
+			printer << "invalid ir: " << error;
+			printer.newline();
+		}
+	}
+}
+
+// What --modules does with the compiled modules, see main
+struct ModuleOptions {
+	unsigned threads {std::thread::hardware_concurrency()};
+	std::string_view runFunction;
+	bool bytecode {};
+	bool cpp {};
+	bool spirv {};
+	bool ir {};
+	bool gvn {};
+	bool inlining {};
 };
 
-template<typename Rule> using control = tao::pegtl::must_if<error>::control<Rule>;
+int compileModules(const std::vector<std::string>& files, const ModuleOptions& opts) {
+	driver::Compiler compiler(opts.threads);
+	auto success = compiler.compile(files);
+	for(auto& unit : compiler.units()) {
+		if(!unit->error.empty()) {
+			std::cout << unit->error << "\n";
+			continue;
+		}
+
+		auto& mod = *unit->module;
+		std::cout << mod.name.str() << ": " << mod.functions.size() << " functions, "
+			<< mod.types.size() << " types, " << mod.imports.size() << " imports\n";
+		if(opts.inlining) {
+			ast::Inliner inliner(mod.arena);
+			inliner.run(mod);
+			auto& stats = inliner.stats();
+			std::cout << "inlined " << stats.inlined << " calls (" << stats.added
+				<< " nodes), kept " << stats.rejected << "\n";
+		}
 
-std::string readFile(std::string_view filename) {
-	auto openmode = std::ios::openmode(std::ios::ate);
+		if(!opts.runFunction.empty()) {
+			run(mod, opts.runFunction, opts.bytecode);
+		}
 
-	std::ifstream ifs(std::string{filename}, openmode);
-	ifs.exceptions(std::ostream::failbit | std::ostream::badbit);
+		if(opts.cpp) {
+			ast::Printer printer(std::cout);
+			ast::cpp::write(mod, printer);
+		}
 
-	auto size = ifs.tellg();
-	ifs.seekg(0, std::ios::beg);
+		if(opts.ir || opts.gvn) {
+			printIr(mod, opts.gvn);
+		}
 
-	std::string buffer;
-	buffer.resize(size);
-	ifs.read(buffer.data(), size);
+		if(opts.spirv) {
+			auto words = ast::spirv::generate(mod);
+			auto name = std::string(mod.name.str()) + ".spv";
+			std::ofstream(name, std::ios::binary).write(
+				reinterpret_cast<const char*>(words.data()),
+				std::streamsize(words.size() * sizeof(words[0])));
+			std::cout << "wrote " << name << "\n";
+		}
+	}
 
-	return buffer;
+	return success ? 0 : 3;
+}
+
+// Measures the time and allocations of all selector transforms, they
+// get the accumulator as parse state. There is one call per parse tree
+// node, the accumulator does nothing when the trace is disabled.
+template<typename Rule>
+struct TimedSelector : selector<Rule> {
+	template<typename Node, typename... States>
+	static void transform(std::unique_ptr<Node>& n,
+			driver::TimeTrace::Accumulator& transforms, States&&... st) {
+		transforms.begin();
+		selector<Rule>::transform(n, transforms, st...);
+		transforms.end();
+	}
+};
+
+using Grammar = pegtl::must<syn::Expr, syn::Eof>;
+
+struct Options {
+	bool parseTree {};
+	bool flat {};
+	bool fold {};
+	std::size_t printLimit {ast::Printer::noLimit};
+};
+
+// Streams the ast into stdout, folded nodes are created in the arena
+void output(ast::Expression* expr, ast::Arena& arena, const Options& opts,
+		driver::TimeTrace& trace) {
+	if(opts.fold) {
+		auto foldScope = trace.scope("fold");
+		ast::ConstantFolder folder(arena);
+		expr = folder.fold(*expr);
+	}
+
+	auto outputScope = trace.scope("output");
+	ast::Printer printer(std::cout, opts.printLimit);
+	if(opts.flat) {
+		ast::flat::Tree tree;
+		auto id = ast::flat::flatten(tree, *expr);
+		ast::flat::write(tree, id, printer);
+	} else {
+		expr->write(printer);
+	}
+
+	printer.flush();
+	std::cout << "\n";
+}
+
+template<template<typename...> class Control>
+void parse(lex::TokenInput& in, builder::ActionBuilder& builder, const Options& opts,
+		driver::TimeTrace& trace) {
+	if(opts.parseTree) {
+		driver::TimeTrace::Accumulator transforms(trace);
+		auto parseScope = trace.scope("parse");
+		auto root = tao::pegtl::parse_tree::parse<Grammar, builder::TreeNode,
+			TimedSelector, pegtl::nothing, Control>(in, transforms);
+		parseScope.end();
+
+		// the transforms run while parsing, they get their own lane
+		trace.add("selector transforms (total)", transforms, 2u);
+
+		auto buildScope = trace.scope("build");
+		builder::TreeBuilder treeBuilder;
+		auto expr = treeBuilder.parseExpr(*root->children.front());
+		buildScope.end();
+
+		auto of = std::ofstream("test.dot");
+		pegtl::parse_tree::print_dot(of, *root);
+		output(expr, treeBuilder.module().arena, opts, trace);
+	} else {
+		// the ast is built while parsing
+		auto parseScope = trace.scope("parse");
+		pegtl::parse<Grammar, builder::Action,
+			builder::ActionControl<Control>::template type>(in, builder);
+		auto expr = builder.popExpr();
+		parseScope.end();
+
+		output(expr, builder.module().arena, opts, trace);
+	}
 }
 
 int main(int argc, char** argv) {
-	if(argc < 2) {
+	// --tree: build the parse tree and output it as test.dot instead
+	// of building the ast directly.
+	// --flat: print the ast through its flat representation.
+	// --fold: fold constants before printing.
+	// --print-limit <n>: stop printing the ast after n bytes.
+	// --modules: all files are modules, compile them in parallel.
+	// -j <n>: number of threads for --modules.
+	// --run <function>: run the function (without parameters) of the
+	// modules on the vm and print the result.
+	// --bytecode: print the vm bytecode of the run function.
+	// --cpp: print the modules as C++ source, see cppgen.hpp.
+	// --spirv: write the modules as SPIR-V to <module>.spv.
+	// --ir: print the ir of every function, see ir.hpp.
+	// --gvn: print it after removing redundant instructions.
+	// --inline: inline calls of small functions first, see inliner.hpp.
+	// --profile: print statistics for every grammar rule.
+	// --profile-json <file>: write them as json instead.
+	// --time-trace <file>: write the time and memory usage of the
+	// compile phases as chrome trace.
+	Options opts;
+	ModuleOptions moduleOpts;
+	auto modules = false;
+	auto profile = false;
+	const char* profileJson = nullptr;
+	const char* timeTraceFile = nullptr;
+	std::vector<std::string> files;
+	for(auto i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--tree") {
+			opts.parseTree = true;
+		} else if(arg == "--fold") {
+			opts.fold = true;
+		} else if(arg == "--flat") {
+			opts.flat = true;
+		} else if(arg == "--print-limit" && i + 1 < argc) {
+			opts.printLimit = std::stoull(argv[++i]);
+		} else if(arg == "--modules") {
+			modules = true;
+		} else if(arg == "--profile") {
+			profile = true;
+		} else if(arg == "--profile-json" && i + 1 < argc) {
+			profileJson = argv[++i];
+			profile = true;
+		} else if(arg == "--time-trace" && i + 1 < argc) {
+			timeTraceFile = argv[++i];
+		} else if(arg == "--run" && i + 1 < argc) {
+			moduleOpts.runFunction = argv[++i];
+		} else if(arg == "--bytecode") {
+			moduleOpts.bytecode = true;
+		} else if(arg == "--cpp") {
+			moduleOpts.cpp = true;
+		} else if(arg == "--spirv") {
+			moduleOpts.spirv = true;
+		} else if(arg == "--ir") {
+			moduleOpts.ir = true;
+		} else if(arg == "--gvn") {
+			moduleOpts.gvn = true;
+		} else if(arg == "--inline") {
+			moduleOpts.inlining = true;
+		} else if(arg == "-j" && i + 1 < argc) {
+			moduleOpts.threads = std::stoul(argv[++i]);
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+
+	if(files.empty()) {
 		std::printf("No argument given\n");
 		return 1;
 	}
 
+	driver::TimeTrace trace(timeTraceFile != nullptr);
+	auto analyzeScope = trace.scope("analyze");
 	if(pegtl::analyze<syn::Grammar>() != 0) {
 		std::printf("cycles without progress detected!\n");
 		return 2;
-   }
+	}
+
+	analyzeScope.end();
 
 	// pegtl::file_input in(argv[1]);
 
-	auto file = readFile(argv[1]);
-	pegtl::memory_input in(file, argv[1]);
+	if(modules) {
+		return compileModules(files, moduleOpts);
+	}
+
+	auto& filename = files.back();
+
+	// The source is mapped and owned by the module, the ast and the
+	// input only reference it.
+	builder::ActionBuilder builder;
+	auto& source = builder.module().source;
+
+	auto readScope = trace.scope("read");
+	source = ast::SourceFile(filename);
+	readScope.end();
+
+	auto lexScope = trace.scope("lex");
+	lex::TokenInput in(source.text(), filename);
+	lexScope.end();
 	// pegtl::standard_trace<syn::Grammar>(in);
 
-	using Grammar = pegtl::must<syn::Expr, syn::Eof>;
+	std::optional<syn::RuleProfiler> profiler;
 	try {
-		auto root = tao::pegtl::parse_tree::parse<Grammar, selector, pegtl::nothing, control>(in);
-		auto of = std::ofstream("test.dot");
-		pegtl::parse_tree::print_dot(of, *root);
+		if(profile) {
+			profiler.emplace();
+			parse<syn::ProfileControl<syn::Control>::type>(in, builder, opts, trace);
+		} else {
+			parse<syn::Control>(in, builder, opts, trace);
+		}
 	} catch(const pegtl::parse_error& error) {
 		auto& pos = error.positions()[0];
 		auto msg = error.message();
@@ -245,4 +484,16 @@ int main(int argc, char** argv) {
 
 		std::cout << "^\n";
 	}
+
+	if(timeTraceFile) {
+		auto of = std::ofstream(timeTraceFile);
+		trace.write(of);
+	}
+
+	if(profiler && profileJson) {
+		auto of = std::ofstream(profileJson);
+		profiler->writeJson(of);
+	} else if(profiler) {
+		profiler->printReport(std::cout);
+	}
 }
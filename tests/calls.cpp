@@ -0,0 +1,17 @@
+#include "common.hpp"
+
+// Calls in calls.isl, resolved by the builder and run on the vm.
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& mod = test::module(*compiler, "calls");
+	test::check(mod.functions.size() == 6u, "all functions are added");
+	test::check(test::run(test::function(mod, "main")).i == 55 + 9 + 5,
+		"recursion, overloads and shadowing");
+	test::check(test::run(test::function(mod, "mainf")).f == 2.25f,
+		"the f32 overload is called for f32 arguments");
+	return test::failures ? 1 : 0;
+}
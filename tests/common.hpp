@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../driver.hpp"
+#include "../vm.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+
+// Helpers shared by the checks in this directory. Every check is a
+// small program getting its fixtures as arguments, it returns
+// non-zero when one of its checks failed.
+namespace test {
+
+inline unsigned failures = 0u;
+
+inline void check(bool cond, const char* what) {
+	if(!cond) {
+		std::fprintf(stderr, "check failed: %s\n", what);
+		++failures;
+	}
+}
+
+// Compiles the given files as modules, nullptr when one of them
+// can't be built.
+inline std::unique_ptr<driver::Compiler> compile(int argc, char** argv) {
+	auto compiler = std::make_unique<driver::Compiler>(1u);
+	auto success = compiler->compile({argv + 1, argv + argc});
+	for(auto& unit : compiler->units()) {
+		if(!unit->error.empty()) {
+			std::fprintf(stderr, "%s\n", unit->error.c_str());
+		}
+	}
+
+	return success ? std::move(compiler) : nullptr;
+}
+
+inline ast::Module& module(const driver::Compiler& compiler, std::string_view name) {
+	for(auto& unit : compiler.units()) {
+		if(unit->module && unit->module->name.str() == name) {
+			return *unit->module;
+		}
+	}
+
+	std::fprintf(stderr, "no module %.*s\n", int(name.size()), name.data());
+	std::abort();
+}
+
+inline ast::Function& function(const ast::Module& mod, std::string_view name) {
+	for(auto* func : mod.functions) {
+		if(func->name() == name) {
+			return *func;
+		}
+	}
+
+	std::fprintf(stderr, "no function %.*s\n", int(name.size()), name.data());
+	std::abort();
+}
+
+// Runs the function without parameters on the vm, returns the first
+// component of the result.
+inline ast::vm::Value run(const ast::Function& func) {
+	ast::vm::Program program;
+	auto index = program.add(func);
+	ast::vm::Machine machine(program);
+	auto result = machine.run(index, {});
+	check(!result.empty(), "function returns a value");
+	return result.empty() ? ast::vm::Value {} : result[0];
+}
+
+} // namespace test
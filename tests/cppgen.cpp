@@ -0,0 +1,155 @@
+#include "common.hpp"
+#include "../cppgen.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Generates headers for the fixtures, compiles a driver calling their
+// functions with the host compiler and compares the results with the
+// ones of the vm.
+// The compiler command is taken from $CXX, islmath.hpp from
+// $ISL_INCLUDE, the files are written to $OUT_DIR.
+namespace {
+
+struct Call {
+	std::string_view module;
+	std::string_view function;
+	std::vector<double> args; // converted to the parameter types
+};
+
+const char* env(const char* name, const char* fallback) {
+	auto* value = std::getenv(name);
+	return value ? value : fallback;
+}
+
+// Writes the value as literal of the given scalar type
+void literal(std::string& out, const ast::Type& type, ast::vm::Value value) {
+	auto& bt = static_cast<const ast::BuiltinType&>(type);
+	char buf[64];
+	switch(bt.type) {
+		case ast::BuiltinType::Type::i32:
+			std::snprintf(buf, sizeof(buf), "isl::i32(%d)", value.i);
+			break;
+		case ast::BuiltinType::Type::u32:
+			std::snprintf(buf, sizeof(buf), "isl::u32(%uu)", value.u);
+			break;
+		case ast::BuiltinType::Type::f32:
+			// hex floats read back exactly
+			std::snprintf(buf, sizeof(buf), "isl::f32(%af)", double(value.f));
+			break;
+		case ast::BuiltinType::Type::eBool:
+			std::snprintf(buf, sizeof(buf), "%s", value.b ? "true" : "false");
+			break;
+		default:
+			std::fprintf(stderr, "only scalar parameters and results\n");
+			std::abort();
+	}
+
+	out += buf;
+}
+
+ast::vm::Value convert(const ast::Type& type, double arg) {
+	ast::vm::Value ret {};
+	switch(static_cast<const ast::BuiltinType&>(type).type) {
+		case ast::BuiltinType::Type::i32: ret.i = ast::i32(arg); break;
+		case ast::BuiltinType::Type::u32: ret.u = ast::u32(arg); break;
+		case ast::BuiltinType::Type::f32: ret.f = ast::f32(arg); break;
+		case ast::BuiltinType::Type::eBool: ret.b = arg != 0.0; break;
+		default:
+			std::fprintf(stderr, "only scalar parameters and results\n");
+			std::abort();
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	std::string outDir = env("OUT_DIR", ".");
+	for(auto& unit : compiler->units()) {
+		auto& mod = *unit->module;
+		auto path = outDir + "/" + std::string(mod.name.str()) + ".hpp";
+		std::ofstream(path) << ast::cpp::generate(mod);
+	}
+
+	std::vector<Call> calls = {
+		{"calls", "main", {}},
+		{"calls", "mainf", {}},
+		{"calls", "fib", {7}},
+		{"calls", "shadow", {-3}},
+		{"mathlib", "clamp", {-4, 0, 20}},
+		{"imports", "main", {}},
+		{"imports", "mainf", {}},
+	};
+
+	for(auto x = -2; x < 30; ++x) {
+		calls.push_back({"spmd", "diverge", {double(x), (x % 7) * 2.5}});
+		calls.push_back({"spmd", "weight", {double(x)}});
+	}
+
+	// the driver checks the results of the generated code against
+	// the ones of the vm
+	std::string driver =
+		"#include <cstdio>\n"
+		"#include \"calls.hpp\"\n"
+		"#include \"imports.hpp\"\n"
+		"#include \"spmd.hpp\"\n\n"
+		"int failures = 0;\n\n"
+		"template<typename T>\n"
+		"void check(const char* call, T got, T expected) {\n"
+		"\tif(!(got == expected)) {\n"
+		"\t\tstd::fprintf(stderr, \"check failed: %s\\n\", call);\n"
+		"\t\t++failures;\n"
+		"\t}\n"
+		"}\n\n"
+		"int main() {\n";
+
+	for(auto& call : calls) {
+		auto& func = test::function(test::module(*compiler, call.module), call.function);
+		auto params = func.parameters();
+		test::check(params.size() == call.args.size(), "arguments for all parameters");
+
+		std::vector<ast::vm::Value> args;
+		std::string code = std::string(call.module) + "::" + std::string(call.function) + "(";
+		for(auto i = 0u; i < params.size(); ++i) {
+			args.push_back(convert(*params[i], call.args[i]));
+			code += (i ? ", " : "");
+			literal(code, *params[i], args.back());
+		}
+		code += ")";
+
+		ast::vm::Program program;
+		auto index = program.add(func);
+		ast::vm::Machine machine(program);
+		auto result = machine.run(index, args);
+
+		driver += "\tcheck(\"" + code + "\", " + code + ", ";
+		literal(driver, func.returnType(), result[0]);
+		driver += ");\n";
+	}
+
+	driver += "\treturn failures ? 1 : 0;\n}\n";
+	auto source = outDir + "/cppgen_driver.cpp";
+	std::ofstream(source) << driver;
+
+	auto binary = outDir + "/cppgen_driver";
+	auto command = std::string(env("CXX", "c++")) + " -std=c++17" +
+		" -I\"" + env("ISL_INCLUDE", "..") + "\"" +
+		" -I\"" + outDir + "\"" +
+		" -o \"" + binary + "\" \"" + source + "\"";
+	test::check(std::system(command.c_str()) == 0, "the generated code compiles");
+	if(!test::failures) {
+		auto run = "\"" + binary + "\"";
+		test::check(std::system(run.c_str()) == 0, "the results match the vm");
+	}
+
+	return test::failures ? 1 : 0;
+}
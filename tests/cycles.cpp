@@ -0,0 +1,32 @@
+#include "common.hpp"
+
+#include <string>
+
+// cyclea.isl and cycleb.isl import each other, cyclec.isl only
+// imports cyclea.isl. Only the first two are reported as cycle.
+int main(int argc, char** argv) {
+	driver::Compiler compiler(1u);
+	test::check(!compiler.compile({argv + 1, argv + argc}), "compiling fails");
+
+	auto error = [&](std::string_view name) -> const std::string& {
+		for(auto& unit : compiler.units()) {
+			if(unit->name.str() == name) {
+				return unit->error;
+			}
+		}
+
+		std::fprintf(stderr, "no unit %.*s\n", int(name.size()), name.data());
+		std::abort();
+	};
+
+	auto endsWith = [](const std::string& str, std::string_view end) {
+		return str.size() >= end.size() &&
+			std::string_view(str).substr(str.size() - end.size()) == end;
+	};
+
+	test::check(endsWith(error("cyclea"), ": Import cycle"), "cyclea is on the cycle");
+	test::check(endsWith(error("cycleb"), ": Import cycle"), "cycleb is on the cycle");
+	test::check(endsWith(error("cyclec"), "cyclea.isl, which failed"),
+		"cyclec only imports a module on the cycle");
+	return test::failures ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+#include "common.hpp"
+#include "../fold.hpp"
+
+#include <limits>
+#include <vector>
+
+// Folds the functions of fold.isl and compares their results on the vm
+// with the ones before folding.
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& mod = test::module(*compiler, "fold");
+	std::vector<ast::vm::Value> before;
+	for(auto* func : mod.functions) {
+		before.push_back(test::run(*func));
+	}
+
+	ast::ConstantFolder folder(mod.arena);
+	folder.fold(mod);
+
+	for(auto i = 0u; i < mod.functions.size(); ++i) {
+		auto& func = *mod.functions[i];
+		auto after = test::run(func);
+		auto same = (&func.returnType() == &ast::BuiltinType::boolType()) ?
+			after.b == before[i].b : after.u == before[i].u;
+		test::check(same, "the result doesn't change by folding");
+	}
+
+	auto ret = [&](const char* name) { return test::function(mod, name).code->ret; };
+	auto folded = [&](const char* name) {
+		return dynamic_cast<ast::Literal*>(ret(name)) != nullptr;
+	};
+
+	test::check(folded("wrapI") && test::run(test::function(mod, "wrapI")).i ==
+		std::numeric_limits<ast::i32>::min(), "i32 wraps around");
+	test::check(folded("wrapMul") && test::run(test::function(mod, "wrapMul")).i == 0,
+		"i32 products wrap around");
+	test::check(folded("wrapU") && test::run(test::function(mod, "wrapU")).u == 0xFFFFFFFFu,
+		"u32 wraps around");
+
+	test::check(!folded("divZero") && !folded("modZero"),
+		"division by zero isn't folded");
+	test::check(!folded("shiftU") && !folded("shiftI"),
+		"shifts by 32 or more aren't folded");
+
+	test::check(folded("vecEq") && test::run(test::function(mod, "vecEq")).b,
+		"equal vectors are equal");
+	test::check(folded("vecNeq") && test::run(test::function(mod, "vecNeq")).b,
+		"different vectors aren't equal");
+
+	test::check(!dynamic_cast<ast::IfExpression*>(ret("collapse")) &&
+		!dynamic_cast<ast::IfExpression*>(ret("propagate")),
+		"ifs with constant conditions collapse");
+	test::check(folder.stats().branches == 3u, "three constant conditions");
+	return test::failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#include "common.hpp"
+#include "../ir.hpp"
+
+// Lowers the functions of gvn.isl and removes redundant instructions
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& mod = test::module(*compiler, "gvn");
+
+	// returns the number of instructions with the opcode that are left
+	auto count = [](const ast::ir::Function& ir, ast::ir::Opcode opcode) {
+		auto ret = 0u;
+		for(auto& block : ir.blocks) {
+			for(auto id : block.code) {
+				ret += (ir.values[id].opcode == opcode);
+			}
+		}
+		return ret;
+	};
+
+	auto run = [&](const char* name, unsigned removed, unsigned ops, unsigned extracts) {
+		auto ir = ast::ir::lower(test::function(mod, name));
+		test::check(ast::ir::verify(ir).empty(), "lowered ir is valid");
+		test::check(ast::ir::removeRedundant(ir) == removed, name);
+		test::check(ast::ir::verify(ir).empty(), "ir is valid after gvn");
+		test::check(count(ir, ast::ir::Opcode::op) == ops, name);
+		test::check(count(ir, ast::ir::Opcode::extract) == extracts, name);
+	};
+
+	// Before the assignments 'a.b.c + x * y' is computed once, after them
+	// once again. a.b.c is then read from the inserted value directly.
+	// The two sums of each pair are the same value as well.
+	run("members", 9u, 8u, 3u);
+	run("branches", 0u, 3u, 0u);
+	return test::failures ? 1 : 0;
+}
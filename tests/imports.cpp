@@ -0,0 +1,24 @@
+#include "common.hpp"
+
+// Calls of functions from mathlib.isl in imports.isl
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& lib = test::module(*compiler, "mathlib");
+	auto& mod = test::module(*compiler, "imports");
+	test::check(mod.imports.size() == 1u && mod.imports[0] == &lib, "mathlib is imported");
+
+	auto& main = test::function(mod, "main");
+	auto& sum = dynamic_cast<ast::OpExpression&>(*main.code->ret);
+	auto& call = dynamic_cast<ast::FunctionCall&>(*sum.children[0]);
+	test::check(call.called == &test::function(lib, "twice"),
+		"the imported overload is called for i32 arguments");
+	test::check(test::run(main).i == 40 + 7,
+		"imported functions are called, shadowed ones are not");
+	test::check(test::run(test::function(mod, "mainf")).f == 2.5f,
+		"the local overload is called for f32 arguments");
+	return test::failures ? 1 : 0;
+}
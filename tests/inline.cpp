@@ -0,0 +1,56 @@
+#include "common.hpp"
+#include "../inliner.hpp"
+
+// Inlines the calls in inline.isl, one function at a time
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& mod = test::module(*compiler, "inline");
+	test::check(ast::Inliner::size(*test::function(mod, "inc").code) == 4u, "size of inc");
+	test::check(ast::Inliner::size(*test::function(mod, "big").code) == 25u, "size of big");
+	test::check(ast::Inliner::size(*test::function(mod, "fib").code) == 17u, "size of fib");
+
+	// every call of inc adds 4 nodes, the budget is enough for 4 of them
+	ast::Inliner::Limits limits;
+	limits.maxSize = 20u;
+	limits.budget = 18u;
+
+	struct Calls : ast::Visitor {
+		using ast::Visitor::visit;
+		unsigned count {};
+		void visit(ast::FunctionCall& call) override {
+			++count;
+			ast::Visitor::visit(call);
+		}
+	};
+
+	auto expand = [&](const char* name, unsigned inlined, unsigned rejected, unsigned calls) {
+		auto& func = test::function(mod, name);
+		auto before = test::run(func).i;
+
+		ast::Inliner inliner(mod.arena, limits);
+		inliner.run(func);
+		test::check(inliner.stats().inlined == inlined, name);
+		test::check(inliner.stats().rejected == rejected, name);
+
+		Calls remaining;
+		func.code->visit(remaining);
+		test::check(remaining.count == calls, name);
+		test::check(test::run(func).i == before, "inlining doesn't change the result");
+	};
+
+	expand("single", 1u, 0u, 0u);
+	expand("large", 0u, 1u, 1u);
+	expand("many", 4u, 1u, 1u);
+	expand("recursive", 1u, 0u, 2u);
+
+	// the calls in the recursive function itself
+	ast::Inliner inliner(mod.arena, limits);
+	inliner.run(test::function(mod, "fib"));
+	test::check(inliner.stats().inlined == 0u && inliner.stats().rejected == 0u,
+		"recursive calls are never inlined");
+	return test::failures ? 1 : 0;
+}
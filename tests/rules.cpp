@@ -0,0 +1,60 @@
+#include "common.hpp"
+#include "../errors.hpp"
+#include "../lexer.hpp"
+#include "../profiler.hpp"
+#include "../syntax.hpp"
+
+#include <string>
+
+// Counts the grammar rules tried for long expression and assignment
+// statements: the left hand side of a statement and the operands must
+// only be parsed once, there is no backtracking over them.
+int main() {
+	constexpr auto statements = 64u;
+	constexpr auto operands = 16u;
+
+	// every statement has 'operands' operands, the assignments one more
+	std::string source = "i32 f(i32 a, i32 b, i32 c) {\n";
+	for(auto s = 0u; s < statements; ++s) {
+		source += (s % 2) ? "\ta = " : "\t";
+		for(auto o = 0u; o < operands; ++o) {
+			source += o ? (o % 3 ? " + " : " * ") : "";
+			source += "abc"[(s + o) % 3];
+		}
+		source += ";\n";
+	}
+	source += "\ta\n}\n";
+
+	lex::TokenInput in(source, "rules");
+	syn::RuleProfiler profiler;
+	pegtl::parse<syn::Grammar, pegtl::nothing,
+		syn::ProfileControl<syn::Control>::type>(in);
+
+	auto stats = [&](std::string_view rule) {
+		for(auto& s : profiler.stats()) {
+			if(s.rule == rule) {
+				return s;
+			}
+		}
+
+		std::fprintf(stderr, "rule %.*s not attempted\n", int(rule.size()), rule.data());
+		return syn::RuleProfiler::Stats {};
+	};
+
+	// The return value 'a' is parsed as statement first, that fails at
+	// the missing ';' and it is parsed again as return expression.
+	auto assignments = statements / 2;
+	auto stmt = stats("syn::ExprStatement");
+	test::check(stmt.attempts == statements + 1, "ExprStatement once per statement");
+	test::check(stmt.failures == 0u, "ExprStatement doesn't backtrack");
+
+	auto expr = stats("syn::Expr");
+	test::check(expr.attempts == statements + assignments + 2, "Expr once per expression");
+	test::check(expr.failures == 0u, "Expr doesn't backtrack");
+
+	auto primary = stats("syn::PrimaryExpr");
+	test::check(primary.attempts == statements * operands + assignments + 2,
+		"PrimaryExpr once per operand");
+	test::check(primary.failures == 0u, "PrimaryExpr doesn't backtrack");
+	return test::failures ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+#include "common.hpp"
+#include "../spvgen.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Checks the structure of the SPIR-V generated for the fixtures without
+// any external tools: the header, ids, blocks and where variables and
+// phis are placed, and that the imports of every module are exported
+// by the modules it imports.
+// See spirvval.cpp for a check with spirv-val.
+namespace {
+
+using Words = std::vector<std::uint32_t>;
+
+// Opcodes from the specification, only the ones relevant here
+constexpr std::uint32_t opDecorate = 71u;
+constexpr std::uint32_t opFunction = 54u;
+constexpr std::uint32_t opFunctionParameter = 55u;
+constexpr std::uint32_t opFunctionEnd = 56u;
+constexpr std::uint32_t opVariable = 59u;
+constexpr std::uint32_t opPhi = 245u;
+constexpr std::uint32_t opLabel = 248u;
+constexpr std::uint32_t decorationLinkage = 41u;
+constexpr std::uint32_t linkageExport = 0u;
+
+bool isTerminator(std::uint32_t op) {
+	// OpBranch, OpBranchConditional, OpReturn, OpReturnValue
+	return op == 249u || op == 250u || op == 253u || op == 254u;
+}
+
+// Index of the result id in the instruction, 0 if it has none
+unsigned resultIndex(std::uint32_t op) {
+	if((op >= 19u && op <= 33u) || op == opLabel) {
+		return 1u; // types and labels have no result type
+	}
+
+	auto typed = op == 1u || (op >= 41u && op <= 43u) ||
+		op == opFunction || op == opFunctionParameter || op == 57u ||
+		op == opVariable || op == 61u || op == 65u || op == 80u || op == 81u ||
+		(op >= 126u && op <= 199u) || op == opPhi;
+	return typed ? 2u : 0u;
+}
+
+std::string literal(const std::uint32_t* words, std::size_t count) {
+	auto chars = reinterpret_cast<const char*>(words);
+	auto end = std::memchr(chars, '\0', count * 4u);
+	return end ? std::string(chars, static_cast<const char*>(end)) :
+		std::string(chars, count * 4u);
+}
+
+struct Linkage {
+	std::set<std::string> exports;
+	std::set<std::string> imports;
+};
+
+Linkage check(const Words& words) {
+	Linkage linkage;
+	test::check(words.size() >= 5u, "the header is complete");
+	if(words.size() < 5u) {
+		return linkage;
+	}
+
+	test::check(words[0] == 0x07230203u, "magic number");
+	test::check(words[1] == 0x00010000u, "version 1.0");
+	test::check(words[4] == 0u, "schema is 0");
+	auto bound = words[3];
+
+	std::vector<bool> defined(bound);
+	auto inFunction = false;
+	auto inBlock = false;
+	auto blocks = 0u; // in the current function
+	std::uint32_t last = 0u; // previous opcode in the block
+
+	for(auto i = std::size_t(5u); i < words.size();) {
+		auto count = words[i] >> 16u;
+		auto op = words[i] & 0xFFFFu;
+		test::check(count > 0u && i + count <= words.size(), "instruction is in bounds");
+		if(count == 0u || i + count > words.size()) {
+			break;
+		}
+
+		if(auto res = resultIndex(op); res && res < count) {
+			auto id = words[i + res];
+			auto valid = id > 0u && id < bound;
+			test::check(valid, "result id is below the bound");
+			test::check(!valid || !defined[id], "result id is defined once");
+			if(valid) {
+				defined[id] = true;
+			}
+		}
+
+		if(op == opDecorate && count >= 4u && words[i + 2] == decorationLinkage) {
+			auto name = literal(&words[i + 3], count - 4u);
+			auto& names = (words[i + count - 1] == linkageExport) ?
+				linkage.exports : linkage.imports;
+			test::check(names.insert(name).second, "linkage names are unique");
+		}
+
+		if(op == opFunction) {
+			test::check(!inFunction, "functions aren't nested");
+			inFunction = true;
+			blocks = 0u;
+		} else if(op == opFunctionEnd) {
+			test::check(inFunction && !inBlock, "the last block is terminated");
+			inFunction = false;
+		} else if(op == opLabel) {
+			test::check(inFunction && !inBlock, "the previous block is terminated");
+			inBlock = true;
+			++blocks;
+			last = op;
+		} else if(inBlock) {
+			test::check(op != opVariable || (blocks == 1u &&
+				(last == opLabel || last == opVariable)),
+				"variables are at the start of the first block");
+			test::check(op != opPhi || last == opLabel || last == opPhi,
+				"phis are at the start of a block");
+			inBlock = !isTerminator(op);
+			last = op;
+		} else if(inFunction) {
+			test::check(op == opFunctionParameter, "code is in a block");
+		}
+
+		i += count;
+	}
+
+	test::check(!inFunction, "the last function is ended");
+	for(auto& name : linkage.imports) {
+		test::check(!linkage.exports.count(name), "imports and exports are distinct");
+	}
+
+	return linkage;
+}
+
+} // anon namespace
+
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	std::unordered_map<const ast::Module*, Linkage> linkages;
+	for(auto& unit : compiler->units()) {
+		auto& mod = *unit->module;
+		linkages[&mod] = check(ast::spirv::generate(mod));
+	}
+
+	for(auto& [mod, linkage] : linkages) {
+		for(auto& name : linkage.imports) {
+			auto found = false;
+			for(auto* imp : mod->imports) {
+				found |= linkages.at(imp).exports.count(name) != 0u;
+			}
+
+			test::check(found, "imports are exported by an imported module");
+		}
+	}
+
+	auto& calls = linkages[&test::module(*compiler, "calls")];
+	test::check(calls.exports.count("square(i32)") && calls.exports.count("square(f32)"),
+		"overloads are exported under distinct names");
+	auto& imports = linkages[&test::module(*compiler, "imports")];
+	test::check(imports.imports.count("twice(i32)") && imports.exports.count("twice(f32)"),
+		"the imported overload is distinct from the local one");
+
+	return test::failures ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#include "common.hpp"
+#include "../spvgen.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+// Writes the SPIR-V of the fixtures to $OUT_DIR and validates it with
+// the spirv-val given in $SPIRV_VAL. Skipped when it isn't set.
+int main(int argc, char** argv) {
+	auto* validator = std::getenv("SPIRV_VAL");
+	if(!validator) {
+		std::fprintf(stderr, "spirv-val wasn't found, skipping\n");
+		return 77; // skipped, for meson
+	}
+
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto* outDir = std::getenv("OUT_DIR");
+	for(auto& unit : compiler->units()) {
+		auto& mod = *unit->module;
+		auto words = ast::spirv::generate(mod);
+		auto path = std::string(outDir ? outDir : ".") + "/" +
+			std::string(mod.name.str()) + ".spv";
+		std::ofstream(path, std::ios::binary).write(
+			reinterpret_cast<const char*>(words.data()),
+			std::streamsize(words.size() * sizeof(words[0])));
+
+		auto command = "\"" + std::string(validator) + "\" \"" + path + "\"";
+		if(std::system(command.c_str()) != 0) {
+			std::fprintf(stderr, "spirv-val rejected %s\n", path.c_str());
+			++test::failures;
+		}
+	}
+
+	return test::failures ? 1 : 0;
+}
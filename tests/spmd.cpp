@@ -0,0 +1,44 @@
+#include "common.hpp"
+#include "../spmd.hpp"
+
+#include <vector>
+
+// Runs diverge in spmd.isl on the spmd machine, with every supported
+// instruction set, and compares the result of every invocation with
+// the one of the scalar machine.
+int main(int argc, char** argv) {
+	auto compiler = test::compile(argc, argv);
+	if(!compiler) {
+		return 1;
+	}
+
+	auto& mod = test::module(*compiler, "spmd");
+	ast::vm::Program program;
+	auto index = program.add(test::function(mod, "diverge"));
+
+	// not a multiple of the lane count, the last batch is partial
+	constexpr auto count = 3u * ast::vm::laneCount + 5u;
+	std::vector<ast::vm::Value> args(2u * count);
+	for(auto i = 0u; i < count; ++i) {
+		args[2 * i].i = ast::i32(i);
+		args[2 * i + 1].f = float(i % 7u) * 2.5f;
+	}
+
+	for(auto simd : {ast::vm::Simd::none, ast::vm::Simd::avx2}) {
+		if(!ast::vm::supported(simd)) {
+			continue;
+		}
+
+		std::vector<ast::vm::Value> results(count);
+		ast::vm::SpmdMachine spmd(program, simd);
+		spmd.run(index, count, args, results);
+
+		ast::vm::Machine machine(program);
+		for(auto i = 0u; i < count; ++i) {
+			auto expected = machine.run(index, {args.data() + 2 * i, 2u});
+			test::check(results[i].i == expected[0].i, "lane matches the scalar machine");
+		}
+	}
+
+	return test::failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace driver {
+
+namespace {
+
+// The pool and queue the current thread works for, if any.
+thread_local const ThreadPool* currentPool {};
+thread_local unsigned currentQueue {};
+
+} // anon namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+	threadCount = std::max(threadCount, 1u);
+	for(auto i = 0u; i < threadCount; ++i) {
+		queues_.emplace_back(std::make_unique<Queue>());
+	}
+
+	for(auto i = 0u; i < threadCount; ++i) {
+		threads_.emplace_back([this, i]{ run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard lock(mutex_);
+		stop_ = true;
+	}
+
+	wake_.notify_all();
+	for(auto& thread : threads_) {
+		thread.join();
+	}
+}
+
+void ThreadPool::add(Task task) {
+	auto id = (currentPool == this) ?
+		currentQueue :
+		next_.fetch_add(1u, std::memory_order_relaxed) % queues_.size();
+
+	// Incremented before the task is published, a worker popping it
+	// decrements afterwards so the counter never wraps. A worker that
+	// is about to sleep either sees it or gets the notification.
+	pending_.fetch_add(1u);
+	queued_.fetch_add(1u);
+	{
+		auto& queue = *queues_[id];
+		std::lock_guard lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+	}
+	wake_.notify_one();
+}
+
+void ThreadPool::wait() {
+	assert(currentPool != this && "ThreadPool::wait called from a task");
+	std::unique_lock lock(mutex_);
+	done_.wait(lock, [&]{ return pending_.load() == 0u; });
+}
+
+bool ThreadPool::pop(unsigned id, Task& task) {
+	// own queue first, newest task
+	{
+		auto& queue = *queues_[id];
+		std::lock_guard lock(queue.mutex);
+		if(!queue.tasks.empty()) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// steal the oldest task from another queue
+	for(auto i = 1u; i < queues_.size(); ++i) {
+		auto& queue = *queues_[(id + i) % queues_.size()];
+		std::lock_guard lock(queue.mutex);
+		if(!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::run(unsigned id) {
+	currentPool = this;
+	currentQueue = id;
+
+	Task task;
+	while(true) {
+		if(pop(id, task)) {
+			queued_.fetch_sub(1u);
+			task();
+			task = {};
+
+			if(pending_.fetch_sub(1u) == 1u) {
+				std::lock_guard lock(mutex_);
+				done_.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock lock(mutex_);
+		wake_.wait(lock, [&]{ return stop_ || queued_.load() > 0u; });
+		if(stop_) {
+			return;
+		}
+	}
+}
+
+} // namespace driver
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace driver {
+
+// Work-stealing thread pool.
+// Every worker has its own task queue. Tasks added from a worker go
+// to its own queue and are taken from the back (most recently added
+// first), idle workers steal from the front of the other queues.
+// Tasks added from other threads are distributed round-robin.
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+	explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+	~ThreadPool(); // finishes all tasks
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Can be called from any thread, including from within tasks.
+	void add(Task task);
+
+	// Blocks until all tasks (including the ones they add) are finished.
+	// Must not be called from a task.
+	void wait();
+
+	unsigned threadCount() const { return unsigned(threads_.size()); }
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run(unsigned id);
+	bool pop(unsigned id, Task& task);
+
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_; // for sleeping/waking, protects stop_
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	bool stop_ {};
+
+	std::atomic<unsigned> queued_ {}; // tasks in the queues
+	std::atomic<unsigned> pending_ {}; // queued or running tasks
+	std::atomic<unsigned> next_ {}; // round-robin for external adds
+};
+
+} // namespace driver
@@ -0,0 +1,281 @@
+#include "timetrace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+#if defined(__GLIBC__)
+	#include <malloc.h>
+#elif defined(__APPLE__)
+	#include <malloc/malloc.h>
+#endif
+
+namespace driver {
+
+namespace {
+
+std::atomic<bool> counting {};
+std::atomic<std::uint64_t> allocCount {};
+std::atomic<std::uint64_t> allocBytes {};
+std::atomic<std::int64_t> allocLive {};
+std::atomic<std::int64_t> allocPeak {};
+
+// Peaks of the open scopes, innermost last. Allocations raise the
+// peaks of all of them.
+constexpr auto maxScopes = 32u;
+std::atomic<std::int64_t> scopePeaks[maxScopes] {};
+std::atomic<unsigned> openScopes {};
+
+void raise(std::atomic<std::int64_t>& peak, std::int64_t live) {
+	auto current = peak.load(std::memory_order_relaxed);
+	while(live > current && !peak.compare_exchange_weak(current, live,
+			std::memory_order_relaxed)) {
+	}
+}
+
+// Opens a peak starting at the given usage, returns its index
+unsigned openPeak(std::int64_t live) {
+	auto depth = openScopes.load(std::memory_order_relaxed);
+	assert(depth < maxScopes && "TimeTrace scopes nested too deep");
+	scopePeaks[depth].store(live, std::memory_order_relaxed);
+	openScopes.store(depth + 1u, std::memory_order_relaxed);
+	return depth;
+}
+
+// Closes the innermost peak and returns it
+std::int64_t closePeak(unsigned depth) {
+	assert(openScopes.load(std::memory_order_relaxed) == depth + 1u &&
+		"TimeTrace scopes must end in reverse order");
+	auto peak = scopePeaks[depth].load(std::memory_order_relaxed);
+	openScopes.store(depth, std::memory_order_relaxed);
+	return peak;
+}
+
+// Also what is subtracted when freeing, 0 if it can't be queried
+std::int64_t usableSize(void* ptr) {
+#if defined(__GLIBC__)
+	return std::int64_t(::malloc_usable_size(ptr));
+#elif defined(__APPLE__)
+	return std::int64_t(::malloc_size(ptr));
+#else
+	(void) ptr;
+	return 0;
+#endif
+}
+
+void* countedAlloc(std::size_t size, std::size_t align) {
+	size = size ? size : 1u;
+	auto* ptr = (align > alignof(std::max_align_t)) ?
+		std::aligned_alloc(align, (size + align - 1) & ~(align - 1)) :
+		std::malloc(size);
+	if(!ptr || !counting.load(std::memory_order_relaxed)) {
+		return ptr;
+	}
+
+	auto usable = usableSize(ptr);
+	allocCount.fetch_add(1u, std::memory_order_relaxed);
+	allocBytes.fetch_add(usable ? std::uint64_t(usable) : size, std::memory_order_relaxed);
+	if(!usable) {
+		return ptr;
+	}
+
+	auto live = allocLive.fetch_add(usable, std::memory_order_relaxed) + usable;
+	raise(allocPeak, live);
+	auto open = openScopes.load(std::memory_order_relaxed);
+	for(auto i = 0u; i < open; ++i) {
+		raise(scopePeaks[i], live);
+	}
+
+	return ptr;
+}
+
+void* countedAllocOrThrow(std::size_t size, std::size_t align) {
+	auto* ptr = countedAlloc(size, align);
+	if(!ptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void countedFree(void* ptr) {
+	if(!ptr) {
+		return;
+	}
+
+	if(counting.load(std::memory_order_relaxed)) {
+		allocLive.fetch_sub(usableSize(ptr), std::memory_order_relaxed);
+	}
+	std::free(ptr);
+}
+
+} // anon namespace
+
+void countAllocations(bool enable) {
+	counting.store(enable, std::memory_order_relaxed);
+}
+
+AllocStats allocStats() {
+	AllocStats ret;
+	ret.count = allocCount.load(std::memory_order_relaxed);
+	ret.bytes = allocBytes.load(std::memory_order_relaxed);
+	ret.live = allocLive.load(std::memory_order_relaxed);
+	ret.peak = allocPeak.load(std::memory_order_relaxed);
+	return ret;
+}
+
+TimeTrace::TimeTrace(bool enabled) : enabled_(enabled), start_(Clock::now()) {
+	if(enabled_) {
+		countAllocations(true);
+	}
+}
+
+TimeTrace::~TimeTrace() {
+	if(enabled_) {
+		countAllocations(false);
+	}
+}
+
+TimeTrace::Scope::Scope(TimeTrace& trace, std::string name) :
+		trace_(&trace), name_(std::move(name)) {
+	// The peak of this span starts at the current usage
+	allocs_ = allocStats();
+	depth_ = openPeak(allocs_.live);
+	start_ = Clock::now();
+}
+
+TimeTrace::Scope& TimeTrace::Scope::operator=(Scope&& rhs) noexcept {
+	end();
+	trace_ = rhs.trace_;
+	name_ = std::move(rhs.name_);
+	start_ = rhs.start_;
+	allocs_ = rhs.allocs_;
+	depth_ = rhs.depth_;
+	rhs.trace_ = {};
+	return *this;
+}
+
+void TimeTrace::Scope::end() {
+	if(!trace_) {
+		return;
+	}
+
+	auto duration = Clock::now() - start_;
+	auto now = allocStats();
+
+	AllocStats allocs;
+	allocs.count = now.count - allocs_.count;
+	allocs.bytes = now.bytes - allocs_.bytes;
+	allocs.live = now.live;
+	allocs.peak = closePeak(depth_);
+
+	trace_->events_.push_back({std::move(name_), start_, duration, 1u, allocs});
+	trace_ = {};
+}
+
+TimeTrace::Scope TimeTrace::scope(std::string name) {
+	if(!enabled_) {
+		return {};
+	}
+
+	return {*this, std::move(name)};
+}
+
+void TimeTrace::Accumulator::begin() {
+	if(!trace_.enabled()) {
+		return;
+	}
+
+	before_ = allocStats();
+	depth_ = openPeak(before_.live);
+	start_ = Clock::now();
+	if(!started_) {
+		first_ = start_;
+		started_ = true;
+	}
+}
+
+void TimeTrace::Accumulator::end() {
+	if(!trace_.enabled()) {
+		return;
+	}
+
+	total_ += Clock::now() - start_;
+	auto now = allocStats();
+	allocs_.count += now.count - before_.count;
+	allocs_.bytes += now.bytes - before_.bytes;
+	allocs_.live = now.live;
+	allocs_.peak = std::max(allocs_.peak, closePeak(depth_));
+}
+
+void TimeTrace::add(std::string name, const Accumulator& acc, unsigned lane) {
+	if(enabled_ && acc.started_) {
+		events_.push_back({std::move(name), acc.first_, acc.total_, lane, acc.allocs_});
+	}
+}
+
+void TimeTrace::write(std::ostream& os) const {
+	auto us = [](Clock::duration d) {
+		return std::chrono::duration<double, std::micro>(d).count();
+	};
+
+	os << "{\"traceEvents\": [\n";
+	auto first = true;
+	for(auto& e : events_) {
+		if(!first) {
+			os << ",\n";
+		}
+
+		first = false;
+		os << "\t{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1"
+			<< ", \"tid\": " << e.lane
+			<< ", \"ts\": " << us(e.start - start_)
+			<< ", \"dur\": " << us(e.duration);
+		os << ", \"args\": {\"allocations\": " << e.allocs.count
+			<< ", \"allocatedBytes\": " << e.allocs.bytes
+			<< ", \"peakBytes\": " << e.allocs.peak
+			<< ", \"liveBytesAtEnd\": " << e.allocs.live << "}}";
+	}
+
+	os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+} // namespace driver
+
+// Replacements of the global allocation functions that count
+void* operator new(std::size_t size) {
+	return driver::countedAllocOrThrow(size, 0u);
+}
+
+void* operator new[](std::size_t size) {
+	return driver::countedAllocOrThrow(size, 0u);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+	return driver::countedAllocOrThrow(size, std::size_t(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+	return driver::countedAllocOrThrow(size, std::size_t(align));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return driver::countedAlloc(size, 0u);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return driver::countedAlloc(size, 0u);
+}
+
+void operator delete(void* ptr) noexcept { driver::countedFree(ptr); }
+void operator delete[](void* ptr) noexcept { driver::countedFree(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { driver::countedFree(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { driver::countedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { driver::countedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { driver::countedFree(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { driver::countedFree(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { driver::countedFree(ptr); }
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace driver {
+
+// Counters of the global operator new/delete (replaced in timetrace.cpp),
+// covering everything allocated through them, including arena blocks.
+// Only allocations while counting is enabled are counted. Freeing also
+// subtracts memory allocated before, so live is relative to the usage
+// when counting started.
+// Live and peak are only known where the size of an allocation can be
+// queried (glibc and macOS), they stay 0 otherwise.
+struct AllocStats {
+	std::uint64_t count {}; // number of allocations
+	std::uint64_t bytes {}; // allocated bytes, in total
+	std::int64_t live {}; // currently allocated bytes
+	std::int64_t peak {}; // highest value of live
+};
+
+AllocStats allocStats();
+
+// Off by default, then the allocation functions don't touch any
+// counter. Enabled TimeTraces count while they exist.
+void countAllocations(bool enable);
+
+// Records spans and writes them in the chrome trace event format, e.g.
+// for chrome://tracing or ui.perfetto.dev.
+// Every span also gets the number and size of the allocations done
+// while it was open as well as the peak of allocated memory.
+// When disabled, nothing is recorded. Not thread-safe: scopes must be
+// opened and ended on one thread, strictly nested. Allocations of all
+// threads count towards the open scopes.
+class TimeTrace {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	class Scope {
+	public:
+		Scope() = default;
+		Scope(TimeTrace& trace, std::string name);
+		~Scope() { end(); }
+
+		Scope(Scope&& rhs) noexcept { *this = std::move(rhs); }
+		Scope& operator=(Scope&& rhs) noexcept;
+
+		void end();
+
+	private:
+		TimeTrace* trace_ {};
+		std::string name_;
+		Clock::time_point start_;
+		AllocStats allocs_;
+		unsigned depth_ {}; // index of its peak
+	};
+
+	// Sums up the time and allocations of many short pieces of work,
+	// e.g. calls spread out over a phase, to add them as one span.
+	// The pieces are nested into the open scopes like scopes.
+	class Accumulator {
+	public:
+		explicit Accumulator(TimeTrace& trace) : trace_(trace) {}
+
+		void begin();
+		void end();
+
+	private:
+		friend class TimeTrace;
+
+		TimeTrace& trace_;
+		Clock::time_point first_ {}; // start of the first piece
+		Clock::time_point start_ {};
+		Clock::duration total_ {};
+		AllocStats before_ {}; // at the start of the current piece
+		AllocStats allocs_ {}; // sum of all pieces
+		unsigned depth_ {};
+		bool started_ {};
+	};
+
+	explicit TimeTrace(bool enabled);
+	~TimeTrace();
+
+	TimeTrace(const TimeTrace&) = delete;
+	TimeTrace& operator=(const TimeTrace&) = delete;
+
+	bool enabled() const { return enabled_; }
+
+	// Starts a span that ends when the returned scope is destroyed.
+	Scope scope(std::string name);
+
+	// Adds the pieces of the accumulator as one span, starting with
+	// the first one, on its own lane.
+	void add(std::string name, const Accumulator& acc, unsigned lane);
+
+	void write(std::ostream& os) const;
+
+private:
+	struct Event {
+		std::string name;
+		Clock::time_point start;
+		Clock::duration duration;
+		unsigned lane;
+		AllocStats allocs;
+	};
+
+	bool enabled_;
+	Clock::time_point start_;
+	std::vector<Event> events_;
+};
+
+} // namespace driver
@@ -0,0 +1,186 @@
+#include "types.hpp"
+#include <cassert>
+#include <string>
+
+namespace ast {
+
+TypeContext& TypeContext::get() {
+	static TypeContext context;
+	return context;
+}
+
+TypeContext::TypeContext() {
+	using BT = BuiltinType::Type;
+	struct Scalar {
+		BT type;
+		const char* name;
+		const char* prefix; // for vectors and matrices
+		bool matrix;
+	};
+
+	constexpr Scalar scalars[] = {
+		{BT::f32, "f32", "", true},
+		{BT::f64, "f64", "d", true},
+		{BT::i32, "i32", "i", false},
+		{BT::u32, "u32", "u", false},
+		{BT::eBool, "bool", "b", false},
+	};
+
+	// square matrices have two names, the short one is added first
+	builtinNames_.resize(BuiltinType::builtinCount + 1u);
+	auto add = [&](Symbol name, const BuiltinType& type) {
+		builtins_.emplace(name, &type);
+		if(builtinNames_[type.id].empty()) {
+			builtinNames_[type.id] = name;
+		}
+	};
+
+	add(Symbol("void"), BuiltinType::voidType());
+	for(auto& scalar : scalars) {
+		add(Symbol(scalar.name), BuiltinType::matType(scalar.type, 1, 1));
+
+		auto prefix = std::string(scalar.prefix);
+		for(auto n = 2u; n <= 4; ++n) {
+			auto vec = prefix + "vec" + std::to_string(n);
+			add(Symbol(vec), BuiltinType::vecType(scalar.type, n));
+		}
+
+		if(!scalar.matrix) {
+			continue;
+		}
+
+		for(auto c = 2u; c <= 4; ++c) {
+			auto mat = prefix + "mat" + std::to_string(c);
+			add(Symbol(mat), BuiltinType::matType(scalar.type, c, c));
+			for(auto r = 2u; r <= 4; ++r) {
+				auto name = mat + "x" + std::to_string(r);
+				add(Symbol(name), BuiltinType::matType(scalar.type, r, c));
+			}
+		}
+	}
+}
+
+const BuiltinType* TypeContext::findBuiltin(Symbol name) const {
+	auto it = builtins_.find(name);
+	return (it == builtins_.end()) ? nullptr : it->second;
+}
+
+Symbol TypeContext::builtinName(const BuiltinType& type) const {
+	assert(type.id && type.id < builtinNames_.size());
+	return builtinNames_[type.id];
+}
+
+const FunctionType& TypeContext::function(const Type& ret,
+		nytl::span<const Type* const> params) {
+	FunctionType key;
+	key.category = Type::Category::function;
+	key.returnType = &ret;
+	key.parameterTypes = {params.begin(), params.end()};
+
+	std::lock_guard lock(mutex_);
+	auto it = functions_.find(&key);
+	if(it != functions_.end()) {
+		return **it;
+	}
+
+	auto* type = arena_.create<FunctionType>(std::move(key));
+	type->id = nextID_.fetch_add(1u, std::memory_order_relaxed);
+	functions_.insert(type);
+	return *type;
+}
+
+void TypeContext::add(Type& nominal) {
+	assert(nominal.category == Type::Category::eStruct ||
+		nominal.category == Type::Category::eEnum);
+	assert(nominal.id == 0u && "Type was already added");
+	nominal.id = nextID_.fetch_add(1u, std::memory_order_relaxed);
+}
+
+std::size_t TypeContext::FunctionHash::operator()(const FunctionType* type) const {
+	// the parameter types are canonical, their ids identify them
+	std::size_t hash = type->returnType->id;
+	for(auto* param : type->parameterTypes) {
+		hash = hash * 31u + param->id;
+	}
+
+	return hash;
+}
+
+namespace {
+
+const BuiltinType& builtin(const Type& type) {
+	assert(type.category == Type::Category::primitive &&
+		"Operand must be a scalar, vector or matrix");
+	return static_cast<const BuiltinType&>(type);
+}
+
+bool isScalar(const BuiltinType& type) {
+	return type.rows == 1 && type.cols == 1;
+}
+
+} // anon namespace
+
+bool isMatrixProduct(OpType op, const BuiltinType& a, const BuiltinType& b) {
+	return op == OpType::mult && (a.cols > 1 || b.cols > 1) &&
+		!isScalar(a) && !isScalar(b);
+}
+
+const Type& resultType(OpType op, const Type& a, const Type& b) {
+	auto& ba = builtin(a);
+	auto& bb = builtin(b);
+	assert(ba.type == bb.type && "Operands have different types");
+
+	if(isComparison(op)) {
+		return BuiltinType::boolType();
+	}
+
+	if(isMatrixProduct(op, ba, bb)) {
+		auto rows = (ba.cols == 1) ? 1u : ba.rows;
+		auto inner = (ba.cols == 1) ? ba.rows : ba.cols;
+		assert(inner == bb.rows && "Invalid matrix product dimensions");
+		(void) inner;
+		return (rows == 1) ?
+			BuiltinType::vecType(ba.type, bb.cols) :
+			BuiltinType::matType(ba.type, rows, bb.cols);
+	}
+
+	if(isScalar(ba)) {
+		return bb;
+	} else if(isScalar(bb)) {
+		return ba;
+	}
+
+	assert(ba.rows == bb.rows && ba.cols == bb.cols && "Operands have different dimensions");
+	return ba;
+}
+
+const Type& typeOf(const Expression& expr) {
+	if(auto* op = dynamic_cast<const OpExpression*>(&expr)) {
+		auto* type = &typeOf(*op->children[0]);
+		for(auto i = 1u; i < op->children.size(); ++i) {
+			type = &resultType(op->opType, *type, typeOf(*op->children[i]));
+		}
+		return *type;
+	} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&expr)) {
+		return typeOf(*ifExpr->ifBranch.code);
+	} else if(auto* block = dynamic_cast<const CodeBlock*>(&expr)) {
+		return block->ret ? typeOf(*block->ret) : BuiltinType::voidType();
+	}
+
+	return expr.type();
+}
+
+std::string_view typeName(const Type& type) {
+	switch(type.category) {
+		case Type::Category::primitive:
+			return TypeContext::get().builtinName(
+				static_cast<const BuiltinType&>(type)).str();
+		case Type::Category::eStruct:
+			return static_cast<const StructType&>(type).name.str();
+		default:
+			// enums and functions have no name (yet)
+			return {};
+	}
+}
+
+} // namespace ast
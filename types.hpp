@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ast.hpp"
+#include "span.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ast {
+
+// Interns all types so that equal types are the same object.
+// Builtin (scalar, vector, matrix) and function types are structural and
+// created on demand here. Structs and enums are nominal, every declaration
+// is its own type and only gets an id. Comparing types is therefore a
+// pointer comparison, hashing uses the id.
+// Shared by all modules and threads, like the symbol table.
+class TypeContext {
+public:
+	static TypeContext& get();
+
+	// Builtin type with the given name, e.g. "f32", "vec3", "ivec2", "mat4"
+	// or "dmat2x3" (2 columns, 3 rows). Null if there is none.
+	const BuiltinType* findBuiltin(Symbol name) const;
+	// Name of a builtin type, as accepted by findBuiltin.
+	Symbol builtinName(const BuiltinType& type) const;
+
+	const FunctionType& function(const Type& ret,
+		nytl::span<const Type* const> params);
+
+	// Gives a newly declared struct or enum type its id.
+	void add(Type& nominal);
+
+	// Number of types with an id
+	std::size_t count() const { return nextID_.load(std::memory_order_relaxed) - 1u; }
+
+private:
+	TypeContext();
+
+	struct FunctionHash {
+		std::size_t operator()(const FunctionType* type) const;
+	};
+
+	struct FunctionEqual {
+		bool operator()(const FunctionType* a, const FunctionType* b) const {
+			return a->returnType == b->returnType &&
+				a->parameterTypes == b->parameterTypes;
+		}
+	};
+
+	// immutable after construction, no lock needed
+	std::unordered_map<Symbol, const BuiltinType*> builtins_;
+	std::vector<Symbol> builtinNames_; // by id
+
+	std::mutex mutex_;
+	Arena arena_;
+	std::unordered_set<const FunctionType*, FunctionHash, FunctionEqual> functions_;
+
+	std::atomic<std::uint32_t> nextID_ {BuiltinType::builtinCount + 1u};
+};
+
+// Whether 'a op b' is a matrix product, i.e. a multiplication where
+// neither operand is a scalar and at least one is a matrix.
+bool isMatrixProduct(OpType op, const BuiltinType& a, const BuiltinType& b);
+
+// Type of 'a op b' with the rules of ast::evaluate: scalars are
+// broadcast, comparisons result in a bool and vectors on the left side
+// of matrix products are rows. Operands of different scalar types or
+// dimensions are asserted.
+const Type& resultType(OpType op, const Type& a, const Type& b);
+
+// Type of the expression. OpExpression and IfExpression only know
+// theirs after type checking, until then it's derived here.
+const Type& typeOf(const Expression& expr);
+
+struct TypeHash {
+	std::size_t operator()(const Type* type) const { return type->id; }
+};
+
+} // namespace ast
@@ -0,0 +1,947 @@
+#include "vm.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <unordered_set>
+
+namespace ast::vm {
+
+namespace {
+
+using BT = BuiltinType::Type;
+
+constexpr std::string_view opcodeNames[] = {
+	"constant", "move", "splat",
+	"addU", "subU", "mulU", "divU", "modU", "negU",
+	"divI", "modI", "shrI",
+	"andU", "orU", "xorU", "shlU", "shrU",
+	"addF", "subF", "mulF", "divF", "modF", "negF",
+	"addD", "subD", "mulD", "divD", "modD", "negD",
+	"andB", "orB", "xorB",
+	"matMulF", "matMulD",
+	"eqU", "eqF", "eqD", "eqB",
+	"neqU", "neqF", "neqD", "neqB",
+	"lessI", "lessU", "lessF", "lessD",
+	"lessEqI", "lessEqU", "lessEqF", "lessEqD",
+	"jump", "jumpIf", "jumpIfNot", "call", "ret",
+};
+
+static_assert(std::size(opcodeNames) == std::size_t(Opcode::count));
+
+const BuiltinType& builtin(const Type& type) {
+	assert(type.category == Type::Category::primitive &&
+		"Operand must be a scalar, vector or matrix");
+	return static_cast<const BuiltinType&>(type);
+}
+
+bool isScalar(const BuiltinType& type) {
+	return type.rows == 1 && type.cols == 1;
+}
+
+// Componentwise instruction for the operator, Opcode::count if there is none
+Opcode componentwise(OpType op, BT type) {
+	if(type == BT::i32) {
+		switch(op) {
+			case OpType::div: return Opcode::divI;
+			case OpType::mod: return Opcode::modI;
+			case OpType::shiftRight: return Opcode::shrI;
+			default: type = BT::u32; break;
+		}
+	}
+
+	switch(type) {
+		case BT::u32:
+			switch(op) {
+				case OpType::add: return Opcode::addU;
+				case OpType::sub: return Opcode::subU;
+				case OpType::mult: return Opcode::mulU;
+				case OpType::div: return Opcode::divU;
+				case OpType::mod: return Opcode::modU;
+				case OpType::neg: return Opcode::negU;
+				case OpType::bitAnd: return Opcode::andU;
+				case OpType::bitOr: return Opcode::orU;
+				case OpType::bitXor: return Opcode::xorU;
+				case OpType::shiftLeft: return Opcode::shlU;
+				case OpType::shiftRight: return Opcode::shrU;
+				default: break;
+			}
+			break;
+		case BT::f32:
+			switch(op) {
+				case OpType::add: return Opcode::addF;
+				case OpType::sub: return Opcode::subF;
+				case OpType::mult: return Opcode::mulF;
+				case OpType::div: return Opcode::divF;
+				case OpType::mod: return Opcode::modF;
+				case OpType::neg: return Opcode::negF;
+				default: break;
+			}
+			break;
+		case BT::f64:
+			switch(op) {
+				case OpType::add: return Opcode::addD;
+				case OpType::sub: return Opcode::subD;
+				case OpType::mult: return Opcode::mulD;
+				case OpType::div: return Opcode::divD;
+				case OpType::mod: return Opcode::modD;
+				case OpType::neg: return Opcode::negD;
+				default: break;
+			}
+			break;
+		case BT::eBool:
+			switch(op) {
+				case OpType::bitAnd: return Opcode::andB;
+				case OpType::bitOr: return Opcode::orB;
+				case OpType::bitXor: return Opcode::xorB;
+				default: break;
+			}
+			break;
+		default:
+			break;
+	}
+
+	return Opcode::count;
+}
+
+// Comparison instruction, greater and greaterEq must have been
+// swapped to less and lessEq already.
+Opcode comparison(OpType op, BT type) {
+	constexpr auto none = Opcode::count;
+	auto select = [&](Opcode i, Opcode u, Opcode f, Opcode d, Opcode b) {
+		switch(type) {
+			case BT::i32: return i;
+			case BT::u32: return u;
+			case BT::f32: return f;
+			case BT::f64: return d;
+			case BT::eBool: return b;
+			default: return none;
+		}
+	};
+
+	switch(op) {
+		case OpType::eq:
+			return select(Opcode::eqU, Opcode::eqU, Opcode::eqF, Opcode::eqD, Opcode::eqB);
+		case OpType::neq:
+			return select(Opcode::neqU, Opcode::neqU, Opcode::neqF, Opcode::neqD, Opcode::neqB);
+		case OpType::less:
+			return select(Opcode::lessI, Opcode::lessU, Opcode::lessF, Opcode::lessD, none);
+		case OpType::lessEq:
+			return select(Opcode::lessEqI, Opcode::lessEqU, Opcode::lessEqF, Opcode::lessEqD, none);
+		default:
+			return none;
+	}
+}
+
+std::uint8_t wide(BT type) {
+	return type == BT::f64;
+}
+
+unsigned slotOffset(const StructType& type, const StructMember& member) {
+	auto offset = 0u;
+	for(auto i = 0u; i < type.slot(member); ++i) {
+		offset += slots(*type.members[i].type);
+	}
+
+	return offset;
+}
+
+} // anon namespace
+
+std::string_view name(Opcode op) {
+	return opcodeNames[unsigned(op)];
+}
+
+unsigned slots(const Type& type) {
+	switch(type.category) {
+		case Type::Category::primitive: {
+			auto& btype = static_cast<const BuiltinType&>(type);
+			return (btype.type == BT::eVoid) ? 0u : btype.rows * btype.cols;
+		} case Type::Category::eStruct: {
+			auto count = 0u;
+			for(auto& member : static_cast<const StructType&>(type).members) {
+				count += slots(*member.type);
+			}
+			return count;
+		} default:
+			assert(!"Type can't be stored in registers");
+			return 0u;
+	}
+}
+
+// Compiles one function at a time. Registers are allocated like a
+// stack: every statement and code block frees the temporaries it used,
+// variables stay until their block ends.
+class Program::Compiler {
+public:
+	explicit Compiler(Program& program) : program_(program), code_(program.code_) {}
+
+	void function(unsigned index) {
+		auto& func = *program_.functions_[index].decl;
+		assert(func.code && "Function has no body");
+
+		FunctionEntry entry {&func};
+		entry.entry = std::uint32_t(code_.size());
+		for(auto* param : func.params) {
+			vars_[param] = alloc(slots(*param->type));
+		}
+
+		entry.paramSlots = next_;
+		markAssigning(*func.code, assigning_);
+
+		// like block() but the result can stay where it is
+		for(auto* stmt : func.code->statements) {
+			statement(*stmt);
+		}
+
+		auto& retType = func.returnType();
+		Result res {0u, &BuiltinType::voidType(), true};
+		if(func.code->ret) {
+			res = expr(*func.code->ret);
+		}
+
+		assert((res.type == &retType || slots(retType) == 0u) &&
+			"Function returns a different type");
+
+		entry.resultSlots = slots(retType);
+		emit(Opcode::ret, entry.resultSlots, 0u, res.reg);
+		entry.registerCount = std::max(max_, entry.resultSlots);
+		program_.functions_[index] = entry;
+	}
+
+private:
+	static constexpr auto none = Reg(0xFFFFFFFFu);
+
+	struct Result {
+		Reg reg;
+		const Type* type;
+		bool owned; // allocated for this expression, not a variable
+	};
+
+	Reg alloc(unsigned count) {
+		auto reg = next_;
+		next_ += count;
+		max_ = std::max(max_, next_);
+		return reg;
+	}
+
+	Reg target(Reg dst, const Type& type) {
+		return (dst == none) ? alloc(slots(type)) : dst;
+	}
+
+	std::uint32_t here() {
+		label_ = std::uint32_t(code_.size());
+		return label_;
+	}
+
+	std::uint32_t emit(Opcode op, unsigned count = 1u, Reg dst = 0u,
+			Reg a = 0u, Reg b = 0u) {
+		assert(count <= std::numeric_limits<std::uint16_t>::max());
+		code_.push_back({op, 0u, std::uint16_t(count), dst, a, b});
+		return std::uint32_t(code_.size() - 1);
+	}
+
+	// Moves the result into dst, if given
+	Result place(Result res, Reg dst) {
+		if(dst == none || dst == res.reg) {
+			return res;
+		}
+
+		move(dst, res.reg, *res.type);
+		return {dst, res.type, true};
+	}
+
+	// Copies a value. Runs of 32 and 64-bit components get their own
+	// moves, the spmd machine stores them differently.
+	void move(Reg dst, Reg src, const Type& type) {
+		if(type.category == Type::Category::primitive) {
+			auto id = emit(Opcode::move, slots(type), dst, src);
+			code_[id].aux = wide(builtin(type).type);
+			return;
+		}
+
+		std::vector<std::uint8_t> wides;
+		components(type, wides);
+		for(auto i = 0u; i < wides.size();) {
+			auto end = i + 1;
+			while(end < wides.size() && wides[end] == wides[i]) {
+				++end;
+			}
+
+			auto id = emit(Opcode::move, end - i, dst + i, src + i);
+			code_[id].aux = wides[i];
+			i = end;
+		}
+	}
+
+	void components(const Type& type, std::vector<std::uint8_t>& wides) {
+		if(type.category == Type::Category::eStruct) {
+			for(auto& member : static_cast<const StructType&>(type).members) {
+				components(*member.type, wides);
+			}
+			return;
+		}
+
+		wides.insert(wides.end(), slots(type), wide(builtin(type).type));
+	}
+
+	void splat(Reg dst, Reg scalar, const Type& type) {
+		auto id = emit(Opcode::splat, slots(type), dst, scalar);
+		code_[id].aux = wide(builtin(type).type);
+	}
+
+	Result expr(const Expression& e, Reg dst = none) {
+		if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+			auto it = vars_.find(ident->decl);
+			assert(it != vars_.end() && "Variable not known");
+			return place({it->second, ident->decl->type, false}, dst);
+		} else if(auto* op = dynamic_cast<const OpExpression*>(&e)) {
+			return opExpr(*op, dst);
+		} else if(auto* lit = dynamic_cast<const Literal*>(&e)) {
+			auto value = constant(*lit);
+			auto reg = target(dst, *value.type);
+			std::uint64_t bits;
+			std::memcpy(&bits, &value.values[0], sizeof(bits));
+			auto id = emit(Opcode::constant, 1u, reg, Reg(bits), Reg(bits >> 32u));
+			code_[id].aux = wide(value.type->type);
+			return {reg, value.type, true};
+		} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+			// no instruction, the member is a part of the registers
+			auto base = expr(*access->accessed);
+			assert(base.type->category == Type::Category::eStruct);
+			auto& stype = static_cast<const StructType&>(*base.type);
+			auto reg = base.reg + slotOffset(stype, *access->accessor);
+			return place({reg, access->accessor->type, base.owned}, dst);
+		} else if(auto* ifExpr = dynamic_cast<const IfExpression*>(&e)) {
+			return branches(*ifExpr, dst);
+		} else if(auto* codeBlock = dynamic_cast<const CodeBlock*>(&e)) {
+			return block(*codeBlock, dst);
+		} else if(auto* fcall = dynamic_cast<const FunctionCall*>(&e)) {
+			return call(*fcall, dst);
+		}
+
+		assert(!"Unsupported expression");
+		return {};
+	}
+
+	Result opExpr(const OpExpression& e, Reg dst) {
+		auto& children = e.children;
+		if(e.opType == OpType::neg) {
+			auto a = expr(*children[0]);
+			auto& type = builtin(*a.type);
+			auto opcode = componentwise(OpType::neg, type.type);
+			assert(opcode != Opcode::count && "Invalid operand type");
+			auto reg = target(dst, type);
+			emit(opcode, slots(type), reg, a.reg);
+			return {reg, &type, true};
+		}
+
+		auto& boolType = BuiltinType::boolType();
+		if(e.opType == OpType::logicalAnd || e.opType == OpType::logicalOr) {
+			// short-circuit, the result is the last evaluated operand
+			auto jumpOp = (e.opType == OpType::logicalAnd) ?
+				Opcode::jumpIfNot : Opcode::jumpIf;
+			auto reg = target(dst, boolType);
+			std::vector<std::uint32_t> jumps;
+			for(auto i = 0u; i < children.size(); ++i) {
+				if(i > 0) {
+					jumps.push_back(emit(jumpOp, 1u, 0u, reg));
+				}
+
+				auto mark = next_;
+				auto res = expr(*children[i], reg);
+				assert(res.type == &boolType && "Logical operands must be bool");
+				(void) res;
+				next_ = mark;
+			}
+
+			auto end = here();
+			for(auto jump : jumps) {
+				code_[jump].dst = end;
+				code_[jump].b = end;
+			}
+
+			return {reg, &boolType, true};
+		}
+
+		// Left-associative chain. The first operand might be a variable
+		// that is assigned by one of the following operands, it must be
+		// read before that.
+		auto acc = expr(*children[0]);
+		auto assigns = std::any_of(children.begin() + 1, children.end(),
+			[&](auto* child) { return assigning_.count(child) != 0; });
+		if(!acc.owned && assigns) {
+			auto reg = alloc(slots(*acc.type));
+			acc = place(acc, reg);
+		}
+
+		for(auto i = 1u; i < children.size(); ++i) {
+			auto rhs = expr(*children[i]);
+			auto& type = resultType(e.opType, *acc.type, *rhs.type);
+			auto reg = (i + 1 == children.size()) ?
+				target(dst, type) : alloc(slots(type));
+			binary(e.opType, acc, rhs, reg);
+			acc = {reg, &type, true};
+		}
+
+		return acc;
+	}
+
+	void binary(OpType op, Result a, Result b, Reg dst) {
+		auto& ta = builtin(*a.type);
+		auto& tb = builtin(*b.type);
+		if(isMatrixProduct(op, ta, tb)) {
+			auto opcode = (ta.type == BT::f32) ? Opcode::matMulF :
+				(ta.type == BT::f64) ? Opcode::matMulD : Opcode::count;
+			assert(opcode != Opcode::count && "Only float matrices can be multiplied");
+
+			auto rows = (ta.cols == 1) ? 1u : ta.rows;
+			auto inner = (ta.cols == 1) ? ta.rows : ta.cols;
+			auto id = emit(opcode, rows, dst, a.reg, b.reg);
+			code_[id].aux = std::uint8_t(inner | (tb.cols << 4u));
+			return;
+		}
+
+		// scalars are broadcast
+		auto& shape = (slots(ta) < slots(tb)) ? tb : ta;
+		auto count = slots(shape);
+		if(slots(ta) < count) {
+			auto reg = alloc(count);
+			splat(reg, a.reg, shape);
+			a.reg = reg;
+		} else if(slots(tb) < count) {
+			auto reg = alloc(count);
+			splat(reg, b.reg, shape);
+			b.reg = reg;
+		}
+
+		auto opcode = Opcode::count;
+		if(isComparison(op)) {
+			if(op == OpType::greater || op == OpType::greaterEq) {
+				std::swap(a.reg, b.reg);
+				op = (op == OpType::greater) ? OpType::less : OpType::lessEq;
+			}
+
+			assert((count == 1u || op == OpType::eq || op == OpType::neq) &&
+				"Vectors can only be compared for equality");
+			opcode = comparison(op, ta.type);
+		} else {
+			opcode = componentwise(op, ta.type);
+		}
+
+		assert(opcode != Opcode::count && "Invalid operator for the operand type");
+		emit(opcode, count, dst, a.reg, b.reg);
+	}
+
+	Result branches(const IfExpression& e, Reg dst) {
+		auto& type = typeOf(e);
+		if(dst == none && slots(type) > 0) {
+			dst = alloc(slots(type));
+		}
+
+		std::vector<std::uint32_t> ends;
+		std::vector<std::uint32_t> skips;
+		auto branch = [&](const IfExpression::Branch& b, bool last) {
+			auto mark = next_;
+			auto cond = expr(*b.condition);
+			assert(cond.type == &BuiltinType::boolType() && "Condition must be a bool");
+			next_ = mark;
+
+			auto skip = emit(Opcode::jumpIfNot, 1u, 0u, cond.reg);
+			skips.push_back(skip);
+			code(*b.code, dst, type);
+			if(!last) {
+				ends.push_back(emit(Opcode::jump));
+			}
+
+			code_[skip].dst = here();
+		};
+
+		auto& elsifs = e.elsifBranches;
+		branch(e.ifBranch, elsifs.empty() && !e.elseBranch);
+		for(auto i = 0u; i < elsifs.size(); ++i) {
+			branch(elsifs[i], i + 1 == elsifs.size() && !e.elseBranch);
+		}
+
+		if(e.elseBranch) {
+			code(*e.elseBranch, dst, type);
+		}
+
+		auto end = here();
+		for(auto jump : ends) {
+			code_[jump].dst = end;
+		}
+
+		for(auto skip : skips) {
+			code_[skip].b = end;
+		}
+
+		return {dst == none ? 0u : dst, &type, true};
+	}
+
+	// Branch of an if expression, its value goes to dst
+	void code(const CodeBlock& b, Reg dst, const Type& type) {
+		auto res = block(b, dst);
+		assert((dst == none || res.type == &type) && "Branches have different types");
+		(void) res;
+		(void) type;
+	}
+
+	Result block(const CodeBlock& e, Reg dst = none) {
+		if(e.statements.empty() && e.ret) {
+			return expr(*e.ret, dst);
+		}
+
+		if(dst == none && e.ret) {
+			dst = alloc(slots(typeOf(*e.ret)));
+		}
+
+		auto mark = next_;
+		for(auto* stmt : e.statements) {
+			statement(*stmt);
+		}
+
+		Result res {0u, &BuiltinType::voidType(), true};
+		if(e.ret) {
+			res = expr(*e.ret, dst);
+		}
+
+		next_ = mark;
+		return res;
+	}
+
+	Result call(const FunctionCall& e, Reg dst) {
+		auto* func = dynamic_cast<const Function*>(e.called);
+		assert(func && "Only functions can be called");
+		auto index = program_.declare(*func);
+
+		auto params = func->parameters();
+		assert(params.size() == e.arguments.size());
+		auto argSlots = 0u;
+		for(auto* param : params) {
+			argSlots += slots(*param);
+		}
+
+		// the arguments are evaluated in place, the callee's window
+		// starts there
+		auto& retType = func->returnType();
+		auto base = alloc(std::max(argSlots, slots(retType)));
+		auto offset = base;
+		for(auto i = 0u; i < params.size(); ++i) {
+			auto mark = next_;
+			auto arg = expr(*e.arguments[i], offset);
+			assert(arg.type == params[i] && "Argument has a different type");
+			(void) arg;
+			offset += slots(*params[i]);
+			next_ = mark;
+		}
+
+		emit(Opcode::call, 1u, base, index);
+		return place({base, &retType, true}, dst);
+	}
+
+	void statement(const Statement& s) {
+		auto mark = next_;
+		if(auto* decl = dynamic_cast<const DeclarationStatement*>(&s)) {
+			// the variable stays until the end of the block
+			auto& var = *decl->decl;
+			auto reg = alloc(slots(*var.type));
+			mark = next_;
+			if(broadcasts(*var.init, *var.type)) {
+				splat(reg, expr(*var.init).reg, *var.type);
+			} else {
+				auto init = expr(*var.init, reg);
+				assert(init.type == var.type && "Initializer has a different type");
+				(void) init;
+			}
+			vars_[&var] = reg;
+		} else if(auto* assign = dynamic_cast<const AssignStatement*>(&s)) {
+			auto value = expr(*assign->right());
+			auto var = lvalue(*assign->left());
+			if(value.type != var.type && broadcasts(*assign->right(), *var.type)) {
+				splat(var.reg, value.reg, *var.type);
+			} else if(!retarget(value, var.reg)) {
+				assert(value.type == var.type && "Assigned value has a different type");
+				place(value, var.reg);
+			}
+		} else if(auto* exprStmt = dynamic_cast<const ExpressionStatement*>(&s)) {
+			expr(*exprStmt->expr);
+		}
+
+		next_ = mark;
+	}
+
+	// Whether the scalar value initializes all components of the vector
+	// or matrix type. There are no constructors (yet), it's the only way
+	// to create them.
+	bool broadcasts(const Expression& value, const Type& type) {
+		if(type.category != Type::Category::primitive) {
+			return false;
+		}
+
+		auto& vtype = builtin(typeOf(value));
+		auto& btype = builtin(type);
+		return isScalar(vtype) && !isScalar(btype) && vtype.type == btype.type;
+	}
+
+	// Writes the result of the last instruction directly into dst instead
+	// of a temporary. Only possible when the instruction computed the
+	// value on every path and reads all of a component before writing it.
+	bool retarget(const Result& value, Reg dst) {
+		if(!value.owned || code_.empty() || label_ == code_.size()) {
+			return false;
+		}
+
+		auto& last = code_.back();
+		auto compare = last.op >= Opcode::eqU && last.op <= Opcode::lessEqD;
+		auto whole = last.op < Opcode::matMulF && last.count == slots(*value.type);
+		if(last.dst != value.reg || !(compare || whole)) {
+			return false;
+		}
+
+		last.dst = dst;
+		return true;
+	}
+
+	Result lvalue(const Expression& e) {
+		if(auto* ident = dynamic_cast<const IdentifierExpression*>(&e)) {
+			auto it = vars_.find(ident->decl);
+			assert(it != vars_.end() && "Variable not known");
+			return {it->second, ident->decl->type, false};
+		} else if(auto* access = dynamic_cast<const MemberAccess*>(&e)) {
+			auto base = lvalue(*access->accessed);
+			auto& stype = static_cast<const StructType&>(*base.type);
+			auto reg = base.reg + slotOffset(stype, *access->accessor);
+			return {reg, access->accessor->type, false};
+		}
+
+		assert(!"Can only assign to variables and their members");
+		return {};
+	}
+
+	Program& program_;
+	std::vector<Instruction>& code_;
+	std::unordered_map<const VariableDeclaration*, Reg> vars_;
+	std::unordered_set<const Expression*> assigning_;
+	Reg next_ {};
+	Reg max_ {};
+	std::uint32_t label_ {none}; // last jump target
+};
+
+unsigned Program::add(const Function& func) {
+	auto index = declare(func);
+	for(; compiled_ < functions_.size(); ++compiled_) {
+		Compiler(*this).function(compiled_);
+	}
+
+	return index;
+}
+
+unsigned Program::declare(const Function& func) {
+	auto [it, inserted] = indices_.emplace(&func, unsigned(functions_.size()));
+	if(inserted) {
+		functions_.push_back({&func});
+	}
+
+	return it->second;
+}
+
+void Program::write(Printer& p) const {
+	for(auto f = 0u; f < functions_.size(); ++f) {
+		auto& func = functions_[f];
+		auto end = (f + 1 < functions_.size()) ?
+			functions_[f + 1].entry : std::uint32_t(code_.size());
+		p << func.decl->name() << ": " << func.registerCount << " registers";
+		p.indent();
+		for(auto i = func.entry; i < end; ++i) {
+			auto& in = code_[i];
+			p.newline();
+			p << i << ": " << name(in.op);
+			switch(in.op) {
+				case Opcode::constant:
+					p << " r" << in.dst << ", " << in.a << ", " << in.b;
+					break;
+				case Opcode::move: case Opcode::splat:
+				case Opcode::negU: case Opcode::negF: case Opcode::negD:
+					p << " r" << in.dst << ", r" << in.a;
+					break;
+				case Opcode::jump:
+					p << " " << in.dst;
+					break;
+				case Opcode::jumpIf: case Opcode::jumpIfNot:
+					p << " r" << in.a << ", " << in.dst;
+					break;
+				case Opcode::call:
+					p << " r" << in.dst << ", " << functions_[in.a].decl->name();
+					break;
+				case Opcode::ret:
+					p << " r" << in.a;
+					break;
+				default:
+					p << " r" << in.dst << ", r" << in.a << ", r" << in.b;
+					break;
+			}
+
+			if(in.count != 1u) {
+				p << " (" << std::uint32_t(in.count) << ")";
+			}
+		}
+
+		p.unindent();
+		p.newline();
+	}
+}
+
+namespace {
+
+template<typename F>
+void each(const Instruction& in, Value* r, F&& f) {
+	auto* dst = r + in.dst;
+	auto* a = r + in.a;
+	auto* b = r + in.b;
+	for(auto i = 0u; i < in.count; ++i) {
+		f(dst[i], a[i], b[i]);
+	}
+}
+
+// Writes whether the predicate holds for all components
+template<typename F>
+void all(const Instruction& in, Value* r, F&& f) {
+	auto* a = r + in.a;
+	auto* b = r + in.b;
+	auto res = true;
+	for(auto i = 0u; i < in.count; ++i) {
+		res = res && f(a[i], b[i]);
+	}
+	r[in.dst].b = res;
+}
+
+template<typename T>
+void matMul(const Instruction& in, Value* r, T Value::* member) {
+	auto rows = unsigned(in.count);
+	auto inner = in.aux & 0xFu;
+	auto cols = unsigned(in.aux) >> 4u;
+	auto* dst = r + in.dst;
+	auto* a = r + in.a;
+	auto* b = r + in.b;
+	for(auto c = 0u; c < cols; ++c) {
+		for(auto row = 0u; row < rows; ++row) {
+			T sum {};
+			for(auto k = 0u; k < inner; ++k) {
+				sum += a[k * rows + row].*member * b[c * inner + k].*member;
+			}
+			dst[c * rows + row].*member = sum;
+		}
+	}
+}
+
+i32 shiftRight(i32 a, u32 shift) {
+	// arithmetic
+	return a < 0 ? ~i32(~u32(a) >> shift) : i32(u32(a) >> shift);
+}
+
+} // anon namespace
+
+nytl::span<const Value> Machine::run(unsigned function, nytl::span<const Value> args) {
+	auto& functions = program_.functions();
+	assert(function < functions.size());
+	auto& entry = functions[function];
+	assert(args.size() == entry.paramSlots);
+
+	if(registers_.size() < entry.registerCount) {
+		registers_.resize(entry.registerCount);
+	}
+
+	std::copy(args.begin(), args.end(), registers_.begin());
+	frames_.clear();
+
+	constexpr auto min = std::numeric_limits<i32>::min();
+	auto* code = program_.code().data();
+	auto* pc = code + entry.entry;
+	auto base = std::size_t(0u);
+	auto* r = registers_.data();
+	while(true) {
+		auto& in = *pc++;
+		switch(in.op) {
+			case Opcode::constant: {
+				auto bits = std::uint64_t(in.a) | (std::uint64_t(in.b) << 32u);
+				std::memcpy(&r[in.dst], &bits, sizeof(bits));
+				break;
+			} case Opcode::move:
+				std::memmove(&r[in.dst], &r[in.a], in.count * sizeof(Value));
+				break;
+			case Opcode::splat:
+				std::fill_n(r + in.dst, in.count, r[in.a]);
+				break;
+
+			case Opcode::addU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u + b.u; }); break;
+			case Opcode::subU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u - b.u; }); break;
+			case Opcode::mulU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u * b.u; }); break;
+			case Opcode::divU: each(in, r, [](auto& d, auto a, auto b) { d.u = b.u ? a.u / b.u : 0u; }); break;
+			case Opcode::modU: each(in, r, [](auto& d, auto a, auto b) { d.u = b.u ? a.u % b.u : 0u; }); break;
+			case Opcode::negU: each(in, r, [](auto& d, auto a, auto) { d.u = 0u - a.u; }); break;
+			case Opcode::divI:
+				each(in, r, [&](auto& d, auto a, auto b) {
+					d.i = !b.i ? 0 : (a.i == min && b.i == -1) ? min : a.i / b.i;
+				});
+				break;
+			case Opcode::modI:
+				each(in, r, [&](auto& d, auto a, auto b) {
+					d.i = (!b.i || (a.i == min && b.i == -1)) ? 0 : a.i % b.i;
+				});
+				break;
+			case Opcode::shrI: each(in, r, [](auto& d, auto a, auto b) { d.i = shiftRight(a.i, b.u & 31u); }); break;
+			case Opcode::andU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u & b.u; }); break;
+			case Opcode::orU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u | b.u; }); break;
+			case Opcode::xorU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u ^ b.u; }); break;
+			case Opcode::shlU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u << (b.u & 31u); }); break;
+			case Opcode::shrU: each(in, r, [](auto& d, auto a, auto b) { d.u = a.u >> (b.u & 31u); }); break;
+
+			case Opcode::addF: each(in, r, [](auto& d, auto a, auto b) { d.f = a.f + b.f; }); break;
+			case Opcode::subF: each(in, r, [](auto& d, auto a, auto b) { d.f = a.f - b.f; }); break;
+			case Opcode::mulF: each(in, r, [](auto& d, auto a, auto b) { d.f = a.f * b.f; }); break;
+			case Opcode::divF: each(in, r, [](auto& d, auto a, auto b) { d.f = a.f / b.f; }); break;
+			case Opcode::modF: each(in, r, [](auto& d, auto a, auto b) { d.f = std::fmod(a.f, b.f); }); break;
+			case Opcode::negF: each(in, r, [](auto& d, auto a, auto) { d.f = -a.f; }); break;
+
+			case Opcode::addD: each(in, r, [](auto& d, auto a, auto b) { d.d = a.d + b.d; }); break;
+			case Opcode::subD: each(in, r, [](auto& d, auto a, auto b) { d.d = a.d - b.d; }); break;
+			case Opcode::mulD: each(in, r, [](auto& d, auto a, auto b) { d.d = a.d * b.d; }); break;
+			case Opcode::divD: each(in, r, [](auto& d, auto a, auto b) { d.d = a.d / b.d; }); break;
+			case Opcode::modD: each(in, r, [](auto& d, auto a, auto b) { d.d = std::fmod(a.d, b.d); }); break;
+			case Opcode::negD: each(in, r, [](auto& d, auto a, auto) { d.d = -a.d; }); break;
+
+			case Opcode::andB: each(in, r, [](auto& d, auto a, auto b) { d.b = a.b && b.b; }); break;
+			case Opcode::orB: each(in, r, [](auto& d, auto a, auto b) { d.b = a.b || b.b; }); break;
+			case Opcode::xorB: each(in, r, [](auto& d, auto a, auto b) { d.b = a.b != b.b; }); break;
+
+			case Opcode::matMulF: matMul(in, r, &Value::f); break;
+			case Opcode::matMulD: matMul(in, r, &Value::d); break;
+
+			case Opcode::eqU: all(in, r, [](auto a, auto b) { return a.u == b.u; }); break;
+			case Opcode::eqF: all(in, r, [](auto a, auto b) { return a.f == b.f; }); break;
+			case Opcode::eqD: all(in, r, [](auto a, auto b) { return a.d == b.d; }); break;
+			case Opcode::eqB: all(in, r, [](auto a, auto b) { return a.b == b.b; }); break;
+			case Opcode::neqU: all(in, r, [](auto a, auto b) { return a.u == b.u; }); r[in.dst].b = !r[in.dst].b; break;
+			case Opcode::neqF: all(in, r, [](auto a, auto b) { return a.f == b.f; }); r[in.dst].b = !r[in.dst].b; break;
+			case Opcode::neqD: all(in, r, [](auto a, auto b) { return a.d == b.d; }); r[in.dst].b = !r[in.dst].b; break;
+			case Opcode::neqB: all(in, r, [](auto a, auto b) { return a.b == b.b; }); r[in.dst].b = !r[in.dst].b; break;
+			case Opcode::lessI: r[in.dst].b = r[in.a].i < r[in.b].i; break;
+			case Opcode::lessU: r[in.dst].b = r[in.a].u < r[in.b].u; break;
+			case Opcode::lessF: r[in.dst].b = r[in.a].f < r[in.b].f; break;
+			case Opcode::lessD: r[in.dst].b = r[in.a].d < r[in.b].d; break;
+			case Opcode::lessEqI: r[in.dst].b = r[in.a].i <= r[in.b].i; break;
+			case Opcode::lessEqU: r[in.dst].b = r[in.a].u <= r[in.b].u; break;
+			case Opcode::lessEqF: r[in.dst].b = r[in.a].f <= r[in.b].f; break;
+			case Opcode::lessEqD: r[in.dst].b = r[in.a].d <= r[in.b].d; break;
+
+			case Opcode::jump:
+				pc = code + in.dst;
+				break;
+			case Opcode::jumpIf:
+				if(r[in.a].b) {
+					pc = code + in.dst;
+				}
+				break;
+			case Opcode::jumpIfNot:
+				if(!r[in.a].b) {
+					pc = code + in.dst;
+				}
+				break;
+			case Opcode::call: {
+				auto& callee = functions[in.a];
+				frames_.push_back({pc, base});
+				base += in.dst;
+				if(registers_.size() < base + callee.registerCount) {
+					registers_.resize(std::max(base + callee.registerCount,
+						2 * registers_.size()));
+				}
+
+				r = registers_.data() + base;
+				pc = code + callee.entry;
+				break;
+			} case Opcode::ret: {
+				std::memmove(r, &r[in.a], in.count * sizeof(Value));
+				if(frames_.empty()) {
+					return {r, in.count};
+				}
+
+				auto frame = frames_.back();
+				frames_.pop_back();
+				pc = frame.pc;
+				base = frame.base;
+				r = registers_.data() + base;
+				break;
+			} default:
+				assert(!"Invalid opcode");
+				return {};
+		}
+	}
+}
+
+void write(Printer& p, const Type& type, const Value* values) {
+	if(type.category == Type::Category::eStruct) {
+		auto& stype = static_cast<const StructType&>(type);
+		p << "{";
+		auto first = true;
+		for(auto& member : stype.members) {
+			if(!first) {
+				p << ", ";
+			}
+
+			write(p, *member.type, values);
+			values += slots(*member.type);
+			first = false;
+		}
+		p << "}";
+		return;
+	}
+
+	auto& btype = builtin(type);
+	auto component = [&](const Value& v) {
+		switch(btype.type) {
+			case BT::f32: p << v.f; break;
+			case BT::f64: p << v.d; break;
+			case BT::i32: p << v.i; break;
+			case BT::u32: p << v.u; break;
+			case BT::eBool: p << v.b; break;
+			default: break;
+		}
+	};
+
+	if(isScalar(btype)) {
+		component(values[0]);
+		return;
+	}
+
+	// matrices column by column
+	auto vector = [&](const Value* column) {
+		p << "(";
+		for(auto r = 0u; r < btype.rows; ++r) {
+			if(r > 0) {
+				p << ", ";
+			}
+			component(column[r]);
+		}
+		p << ")";
+	};
+
+	if(btype.cols == 1) {
+		vector(values);
+		return;
+	}
+
+	p << "(";
+	for(auto c = 0u; c < btype.cols; ++c) {
+		if(c > 0) {
+			p << ", ";
+		}
+		vector(values + c * btype.rows);
+	}
+	p << ")";
+}
+
+} // namespace ast::vm
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "ast.hpp"
+#include "fold.hpp"
+#include "span.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Register based bytecode to run functions on the cpu.
+// Every register holds one scalar component. Vectors and matrices
+// (column by column) use consecutive registers, structs their members
+// in order. Instructions are typed and work on 'count' consecutive
+// components at once, so vector ops are single instructions.
+// Each function call gets a register window: the arguments are placed
+// at the start of the callee's registers and the result is returned
+// in the same place.
+namespace ast::vm {
+
+using Value = Constant::Component;
+using Reg = std::uint32_t;
+
+enum class Opcode : std::uint8_t {
+	// aux: 1 for 64-bit components (f64), 0 otherwise
+	constant, // dst = a | (b << 32), the raw bits of one Value
+	move, // dst[i] = a[i]
+	splat, // dst[i] = a[0]
+
+	// componentwise, dst[i] = a[i] op b[i]
+	// i32 shares the u32 instructions where two's complement allows it.
+	// Integer division by zero results in 0, shift amounts are taken
+	// modulo 32.
+	addU, subU, mulU, divU, modU, negU,
+	divI, modI, shrI,
+	andU, orU, xorU, shlU, shrU,
+	addF, subF, mulF, divF, modF, negF,
+	addD, subD, mulD, divD, modD, negD,
+	andB, orB, xorB,
+
+	// dst = a * b, matrices are column major, vectors are single
+	// columns or (on the left side) rows.
+	// aux: (inner dimension) | (columns of b << 4), count: rows of a
+	matMulF, matMulD,
+
+	// dst[0] (bool) = a[i] op b[i] for all i
+	eqU, eqF, eqD, eqB,
+	// dst[0] (bool) = a[i] != b[i] for any i
+	neqU, neqF, neqD, neqB,
+	// scalars only, greater is less with swapped operands
+	lessI, lessU, lessF, lessD,
+	lessEqI, lessEqU, lessEqF, lessEqD,
+
+	// Conditional jumps have where both paths join again in b, so
+	// that they can be executed in lockstep.
+	jump, // pc = dst
+	jumpIf, // if a[0]: pc = dst
+	jumpIfNot, // if !a[0]: pc = dst
+	call, // calls function a, the window starts at dst
+	ret, // returns a[0..count] to the start of the window
+
+	count
+};
+
+std::string_view name(Opcode op);
+
+struct Instruction {
+	Opcode op;
+	std::uint8_t aux {};
+	std::uint16_t count {1}; // number of components
+	Reg dst {};
+	Reg a {};
+	Reg b {};
+};
+
+struct FunctionEntry {
+	const Function* decl;
+	std::uint32_t entry {}; // index of the first instruction
+	std::uint32_t registerCount {}; // size of the window
+	std::uint32_t paramSlots {};
+	std::uint32_t resultSlots {};
+};
+
+// Number of registers a value of the given type occupies.
+unsigned slots(const Type& type);
+
+// Compiled functions, shared by all machines running them.
+class Program {
+public:
+	// Compiles the function and all functions it calls, if that
+	// wasn't done already. Returns its index.
+	// The functions must not have type errors, operands of different
+	// scalar types or mismatching dimensions are asserted.
+	unsigned add(const Function& func);
+
+	const std::vector<Instruction>& code() const { return code_; }
+	const std::vector<FunctionEntry>& functions() const { return functions_; }
+
+	// Outputs the bytecode in a readable form
+	void write(Printer& p) const;
+
+private:
+	class Compiler;
+
+	// Returns the index of the function, it's compiled by the next add
+	unsigned declare(const Function& func);
+
+	std::vector<Instruction> code_;
+	std::vector<FunctionEntry> functions_;
+	std::unordered_map<const Function*, unsigned> indices_;
+	unsigned compiled_ {};
+};
+
+// Runs functions of a program. Keeps its registers between runs,
+// one machine per thread.
+class Machine {
+public:
+	explicit Machine(const Program& program) : program_(program) {}
+
+	// The arguments are given as one flat range of values, in
+	// the register layout of the parameters. The returned result is
+	// valid until the next run.
+	nytl::span<const Value> run(unsigned function, nytl::span<const Value> args);
+
+private:
+	struct Frame {
+		const Instruction* pc;
+		std::size_t base;
+	};
+
+	const Program& program_;
+	std::vector<Value> registers_;
+	std::vector<Frame> frames_;
+};
+
+// Outputs a value of the given type, e.g. '(1.000000, 2.000000)'
+// for a vec2.
+void write(Printer& p, const Type& type, const Value* values);
+
+} // namespace ast::vm